@@ -0,0 +1,277 @@
+// Forward-mode automatic differentiation for the model functions of ssm_nlg
+//
+// Instead of coding the Jacobians Z_gn and T_gn by hand, define Z and T once
+// as a functor with a templated call operator, using std::vector for the
+// states and the output, and generate the value, the Jacobian, and the joint
+// evaluation of both from it. For example, in the growth model of the
+// vignette:
+//
+// // [[Rcpp::depends(RcppArmadillo, bssm)]]
+// #include <RcppArmadillo.h>
+// #include <bssm_ad.h>
+//
+// struct T_model {
+//   static const unsigned int n_states = 2; // dimension of alpha
+//   static const unsigned int n_out = 2;    // dimension of the output
+//   template <class Type>
+//   void operator()(const unsigned int t, const std::vector<Type>& alpha,
+//     const arma::vec& theta, const arma::vec& known_params,
+//     const arma::mat& known_tv_params, std::vector<Type>& out) const {
+//     using std::exp;
+//     double dT = known_params(0);
+//     double K = known_params(1);
+//     Type r = exp(alpha[0]) / (1.0 + exp(alpha[0]));
+//     out[0] = alpha[0];
+//     out[1] = K * alpha[1] * exp(r * dT) / (K + alpha[1] * (exp(r * dT) - 1.0));
+//   }
+// };
+//
+// and in create_xptrs:
+//
+//   Rcpp::Named("T_fn") = bssm_ad::xptr<T_model>(&bssm_ad::value<T_model>),
+//   Rcpp::Named("T_gn") = bssm_ad::xptr<T_model>(&bssm_ad::jacobian<T_model>),
+//   Rcpp::Named("T_joint") = bssm_ad::xptr<T_model>(&bssm_ad::joint<T_model>),
+//
+// The pointer T_joint can then be given to ssm_nlg, which uses it whenever
+// both T and its Jacobian are needed. The pointers created with xptr carry
+// n_states of the functor, which ssm_nlg compares with the number of states
+// of the model. The functions themselves do not check the length of alpha,
+// as they can be called in parallel regions where R cannot be called.
+//
+// Unqualified calls to exp, log etc. (with using std::exp etc.) work for both
+// double and the dual numbers. Comparisons of dual numbers compare the values
+// only, so branches are differentiated piecewise.
+
+#ifndef BSSM_AD_H
+#define BSSM_AD_H
+
+#include <RcppArmadillo.h>
+#include <cmath>
+#include <vector>
+
+// typedef for a pointer of function evaluating T or Z and its Jacobian jointly
+typedef void (*njoint_fnPtr)(const unsigned int t, const arma::vec& alpha,
+  const arma::vec& theta, const arma::vec& known_params,
+  const arma::mat& known_tv_params, arma::vec& value, arma::mat& gradient);
+
+namespace bssm_ad {
+
+// dual number with N partial derivatives
+template <unsigned int N>
+class dual {
+
+public:
+
+  double val;
+  double grad[N];
+
+  dual() : val(0.0) {
+    for (unsigned int i = 0; i < N; i++) grad[i] = 0.0;
+  }
+  dual(const double x) : val(x) {
+    for (unsigned int i = 0; i < N; i++) grad[i] = 0.0;
+  }
+
+  // independent variable i with value x
+  static dual variable(const double x, const unsigned int i) {
+    dual out(x);
+    out.grad[i] = 1.0;
+    return out;
+  }
+
+  dual& operator+=(const dual& y) {
+    val += y.val;
+    for (unsigned int i = 0; i < N; i++) grad[i] += y.grad[i];
+    return *this;
+  }
+  dual& operator-=(const dual& y) {
+    val -= y.val;
+    for (unsigned int i = 0; i < N; i++) grad[i] -= y.grad[i];
+    return *this;
+  }
+  dual& operator*=(const dual& y) {
+    for (unsigned int i = 0; i < N; i++) grad[i] = grad[i] * y.val + val * y.grad[i];
+    val *= y.val;
+    return *this;
+  }
+  dual& operator/=(const dual& y) {
+    double inv = 1.0 / y.val;
+    val *= inv;
+    for (unsigned int i = 0; i < N; i++) grad[i] = (grad[i] - val * y.grad[i]) * inv;
+    return *this;
+  }
+};
+
+// apply chain rule with value f(x.val) and derivative df(x.val)
+template <unsigned int N>
+inline dual<N> chain(const dual<N>& x, const double f, const double df) {
+  dual<N> out(f);
+  for (unsigned int i = 0; i < N; i++) out.grad[i] = df * x.grad[i];
+  return out;
+}
+
+template <unsigned int N>
+inline dual<N> operator+(dual<N> x, const dual<N>& y) { return x += y; }
+template <unsigned int N>
+inline dual<N> operator-(dual<N> x, const dual<N>& y) { return x -= y; }
+template <unsigned int N>
+inline dual<N> operator*(dual<N> x, const dual<N>& y) { return x *= y; }
+template <unsigned int N>
+inline dual<N> operator/(dual<N> x, const dual<N>& y) { return x /= y; }
+
+template <unsigned int N>
+inline dual<N> operator+(dual<N> x, const double y) { x.val += y; return x; }
+template <unsigned int N>
+inline dual<N> operator+(const double x, dual<N> y) { y.val += x; return y; }
+template <unsigned int N>
+inline dual<N> operator-(dual<N> x, const double y) { x.val -= y; return x; }
+template <unsigned int N>
+inline dual<N> operator-(const double x, const dual<N>& y) { return dual<N>(x) -= y; }
+template <unsigned int N>
+inline dual<N> operator*(dual<N> x, const double y) {
+  x.val *= y;
+  for (unsigned int i = 0; i < N; i++) x.grad[i] *= y;
+  return x;
+}
+template <unsigned int N>
+inline dual<N> operator*(const double x, const dual<N>& y) { return y * x; }
+template <unsigned int N>
+inline dual<N> operator/(const dual<N>& x, const double y) { return x * (1.0 / y); }
+template <unsigned int N>
+inline dual<N> operator/(const double x, const dual<N>& y) { return dual<N>(x) /= y; }
+
+template <unsigned int N>
+inline dual<N> operator-(const dual<N>& x) { return x * -1.0; }
+template <unsigned int N>
+inline dual<N> operator+(const dual<N>& x) { return x; }
+
+template <unsigned int N>
+inline bool operator<(const dual<N>& x, const dual<N>& y) { return x.val < y.val; }
+template <unsigned int N>
+inline bool operator>(const dual<N>& x, const dual<N>& y) { return x.val > y.val; }
+template <unsigned int N>
+inline bool operator<=(const dual<N>& x, const dual<N>& y) { return x.val <= y.val; }
+template <unsigned int N>
+inline bool operator>=(const dual<N>& x, const dual<N>& y) { return x.val >= y.val; }
+template <unsigned int N>
+inline bool operator<(const dual<N>& x, const double y) { return x.val < y; }
+template <unsigned int N>
+inline bool operator>(const dual<N>& x, const double y) { return x.val > y; }
+template <unsigned int N>
+inline bool operator<(const double x, const dual<N>& y) { return x < y.val; }
+template <unsigned int N>
+inline bool operator>(const double x, const dual<N>& y) { return x > y.val; }
+
+template <unsigned int N>
+inline dual<N> exp(const dual<N>& x) {
+  double f = std::exp(x.val);
+  return chain(x, f, f);
+}
+template <unsigned int N>
+inline dual<N> log(const dual<N>& x) {
+  return chain(x, std::log(x.val), 1.0 / x.val);
+}
+template <unsigned int N>
+inline dual<N> sqrt(const dual<N>& x) {
+  double f = std::sqrt(x.val);
+  return chain(x, f, 0.5 / f);
+}
+template <unsigned int N>
+inline dual<N> pow(const dual<N>& x, const double y) {
+  return chain(x, std::pow(x.val, y), y * std::pow(x.val, y - 1.0));
+}
+template <unsigned int N>
+inline dual<N> pow(const dual<N>& x, const dual<N>& y) {
+  return exp(y * log(x));
+}
+template <unsigned int N>
+inline dual<N> sin(const dual<N>& x) {
+  return chain(x, std::sin(x.val), std::cos(x.val));
+}
+template <unsigned int N>
+inline dual<N> cos(const dual<N>& x) {
+  return chain(x, std::cos(x.val), -std::sin(x.val));
+}
+template <unsigned int N>
+inline dual<N> tanh(const dual<N>& x) {
+  double f = std::tanh(x.val);
+  return chain(x, f, 1.0 - f * f);
+}
+template <unsigned int N>
+inline dual<N> atan(const dual<N>& x) {
+  return chain(x, std::atan(x.val), 1.0 / (1.0 + x.val * x.val));
+}
+template <unsigned int N>
+inline dual<N> abs(const dual<N>& x) {
+  return chain(x, std::abs(x.val), x.val < 0 ? -1.0 : 1.0);
+}
+
+// stop if the number of states does not match the functor F, 
+// only to be called on the main thread
+template <class F>
+void check_n_states(const unsigned int n_states) {
+  if (n_states != F::n_states) {
+    Rcpp::stop("Length of alpha does not match n_states of the model function.");
+  }
+}
+
+// external pointer to the function fn generated from the functor F, 
+// with n_states of F as attribute "n_states"
+template <class F, class P>
+Rcpp::XPtr<P> xptr(P fn) {
+  Rcpp::XPtr<P> ptr(new P(fn));
+  ptr.attr("n_states") = F::n_states;
+  return ptr;
+}
+
+// value of the function F at alpha
+template <class F>
+arma::vec value(const unsigned int t, const arma::vec& alpha,
+  const arma::vec& theta, const arma::vec& known_params,
+  const arma::mat& known_tv_params) {
+
+  std::vector<double> x(alpha.begin(), alpha.end());
+  std::vector<double> out(F::n_out);
+  F()(t, x, theta, known_params, known_tv_params, out);
+  return arma::vec(out);
+}
+
+// value and Jacobian of the function F at alpha in one pass
+template <class F>
+void joint(const unsigned int t, const arma::vec& alpha,
+  const arma::vec& theta, const arma::vec& known_params,
+  const arma::mat& known_tv_params, arma::vec& value, arma::mat& gradient) {
+
+  typedef dual<F::n_states> dual_type;
+  std::vector<dual_type> x(F::n_states);
+  for (unsigned int i = 0; i < F::n_states; i++) {
+    x[i] = dual_type::variable(alpha(i), i);
+  }
+  std::vector<dual_type> out(F::n_out);
+  F()(t, x, theta, known_params, known_tv_params, out);
+
+  value.set_size(F::n_out);
+  gradient.set_size(F::n_out, F::n_states);
+  for (unsigned int i = 0; i < F::n_out; i++) {
+    value(i) = out[i].val;
+    for (unsigned int j = 0; j < F::n_states; j++) {
+      gradient(i, j) = out[i].grad[j];
+    }
+  }
+}
+
+// Jacobian of the function F at alpha
+template <class F>
+arma::mat jacobian(const unsigned int t, const arma::vec& alpha,
+  const arma::vec& theta, const arma::vec& known_params,
+  const arma::mat& known_tv_params) {
+
+  arma::vec value;
+  arma::mat gradient;
+  joint<F>(t, alpha, theta, known_params, known_tv_params, value, gradient);
+  return gradient;
+}
+
+}
+
+#endif
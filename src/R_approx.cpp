@@ -46,12 +46,14 @@ Rcpp::List gaussian_approx_model(const Rcpp::List model_, const int model_type)
 
 // [[Rcpp::export]]
 Rcpp::List gaussian_approx_model_nlg(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP Z_joint, SEXP T_joint,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const unsigned int n_states,
   const unsigned int n_etas,  const arma::uvec& time_varying,
   const unsigned int max_iter,
   const double conv_tol, const unsigned int iekf_iter,
+  const unsigned int n_threads,
   const Rcpp::Function update_fn, const Rcpp::Function prior_fn) {
 
   Rcpp::XPtr<nvec_fnPtr> xpfun_Z(Z);
@@ -67,6 +69,8 @@ Rcpp::List gaussian_approx_model_nlg(const arma::mat& y, SEXP Z, SEXP H,
   ssm_nlg model(y, *xpfun_Z, *xpfun_H, *xpfun_T, *xpfun_R, *xpfun_Zg, *xpfun_Tg,
     *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, known_tv_params, n_states, n_etas,
     time_varying, update_fn, prior_fn, 1, iekf_iter, max_iter, conv_tol);
+  model.set_joint_fns(Z_joint, T_joint);
+  model.approx_threads = n_threads;
 
   model.approximate();
   if(!arma::is_finite(model.mode_estimate)) {
@@ -79,3 +83,33 @@ Rcpp::List gaussian_approx_model_nlg(const arma::mat& y, SEXP Z, SEXP H,
     Rcpp::Named("R") = model.approx_model.R, Rcpp::Named("a1") = model.approx_model.a1,
     Rcpp::Named("P1") = model.approx_model.P1);
 }
+
+// log-density of the states and observations used in the mode finder, 
+// with the state-independent factors precomputed at alpha_factors
+// [[Rcpp::export]]
+double log_signal_pdf_nlg(const arma::mat& y, SEXP Z, SEXP H,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
+  const arma::mat& known_tv_params, const unsigned int n_states,
+  const unsigned int n_etas,  const arma::uvec& time_varying,
+  const arma::mat& alpha, const arma::mat& alpha_factors,
+  const Rcpp::Function update_fn, const Rcpp::Function prior_fn) {
+
+  Rcpp::XPtr<nvec_fnPtr> xpfun_Z(Z);
+  Rcpp::XPtr<nmat_fnPtr> xpfun_H(H);
+  Rcpp::XPtr<nvec_fnPtr> xpfun_T(T);
+  Rcpp::XPtr<nmat_fnPtr> xpfun_R(R);
+  Rcpp::XPtr<nmat_fnPtr> xpfun_Zg(Zg);
+  Rcpp::XPtr<nmat_fnPtr> xpfun_Tg(Tg);
+  Rcpp::XPtr<a1_fnPtr> xpfun_a1(a1);
+  Rcpp::XPtr<P1_fnPtr> xpfun_P1(P1);
+  Rcpp::XPtr<prior_fnPtr> xpfun_prior(log_prior_pdf);
+
+  ssm_nlg model(y, *xpfun_Z, *xpfun_H, *xpfun_T, *xpfun_R, *xpfun_Zg, *xpfun_Tg,
+    *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, known_tv_params, n_states, n_etas,
+    time_varying, update_fn, prior_fn, 1);
+
+  signal_factors factors;
+  model.precompute_signal_factors(alpha_factors, factors);
+  return model.log_signal_pdf(alpha, factors);
+}
@@ -419,7 +419,8 @@ Rcpp::List bsf_smoother(const Rcpp::List model_,
 
 // [[Rcpp::export]]
 Rcpp::List bsf_nlg(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP T_batch, SEXP Z_batch,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const unsigned int n_states,
   const unsigned int n_etas,  const arma::uvec& time_varying,
@@ -440,6 +441,7 @@ Rcpp::List bsf_nlg(const arma::mat& y, SEXP Z, SEXP H,
   ssm_nlg model(y, *xpfun_Z, *xpfun_H, *xpfun_T, *xpfun_R, *xpfun_Zg, *xpfun_Tg,
     *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, known_tv_params, n_states, n_etas,
     time_varying, update_fn, prior_fn, seed);
+  model.set_batch_fns(T_batch, Z_batch);
   
   unsigned int m = model.m;
   unsigned n = model.n;
@@ -466,7 +468,8 @@ Rcpp::List bsf_nlg(const arma::mat& y, SEXP Z, SEXP H,
 }
 // [[Rcpp::export]]
 Rcpp::List bsf_smoother_nlg(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP T_batch, SEXP Z_batch,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const unsigned int n_states,
   const unsigned int n_etas,  const arma::uvec& time_varying,
@@ -487,6 +490,7 @@ Rcpp::List bsf_smoother_nlg(const arma::mat& y, SEXP Z, SEXP H,
   ssm_nlg model(y, *xpfun_Z, *xpfun_H, *xpfun_T, *xpfun_R, *xpfun_Zg, *xpfun_Tg,
     *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, known_tv_params, n_states, n_etas,
     time_varying, update_fn, prior_fn, seed);
+  model.set_batch_fns(T_batch, Z_batch);
   
   unsigned int m = model.m;
   unsigned n = model.n;
@@ -2,7 +2,8 @@
 
 // [[Rcpp::export]]
 Rcpp::List ekf_nlg(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP Z_joint, SEXP T_joint,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const unsigned int n_states,
   const unsigned int n_etas,  const arma::uvec& time_varying,
@@ -23,6 +24,7 @@ Rcpp::List ekf_nlg(const arma::mat& y, SEXP Z, SEXP H,
     *xpfun_Tg, *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, 
     known_tv_params, n_states, n_etas, time_varying, 
     update_fn, prior_fn, 1, iekf_iter);
+  model.set_joint_fns(Z_joint, T_joint);
 
   arma::mat at(model.m, model.n + 1);
   arma::mat att(model.m, model.n);
@@ -44,7 +46,8 @@ Rcpp::List ekf_nlg(const arma::mat& y, SEXP Z, SEXP H,
 
 // [[Rcpp::export]]
 Rcpp::List ekf_smoother_nlg(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP Z_joint, SEXP T_joint,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const unsigned int n_states,
   const unsigned int n_etas,  const arma::uvec& time_varying,
@@ -66,6 +69,7 @@ Rcpp::List ekf_smoother_nlg(const arma::mat& y, SEXP Z, SEXP H,
     *xpfun_Tg, *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, 
     known_tv_params, n_states, n_etas, time_varying, 
     update_fn, prior_fn, 1, iekf_iter);
+  model.set_joint_fns(Z_joint, T_joint);
 
   arma::mat alphahat(model.m, model.n + 1);
   arma::cube Vt(model.m, model.m, model.n + 1);
@@ -79,7 +83,8 @@ Rcpp::List ekf_smoother_nlg(const arma::mat& y, SEXP Z, SEXP H,
 
 // [[Rcpp::export]]
 Rcpp::List ekf_fast_smoother_nlg(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP Z_joint, SEXP T_joint,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const unsigned int n_states,
   const unsigned int n_etas,  const arma::uvec& time_varying,
@@ -101,6 +106,7 @@ Rcpp::List ekf_fast_smoother_nlg(const arma::mat& y, SEXP Z, SEXP H,
     *xpfun_Tg, *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, 
     known_tv_params, n_states, n_etas, time_varying, 
     update_fn, prior_fn, 1, iekf_iter);
+  model.set_joint_fns(Z_joint, T_joint);
 
   arma::mat alphahat(model.m, model.n + 1);
   double loglik = model.ekf_fast_smoother(alphahat);
@@ -24,7 +24,7 @@ Rcpp::List importance_sample_ng(const Rcpp::List model_,
   case 1: {
     ssm_ung model(model_, seed);
     model.approximate();
-    arma::cube alpha = model.approx_model.simulate_states(nsim);
+    arma::cube alpha = model.simulate_approx_states(nsim);
     model.update_scales();
     arma::vec weights = model.importance_weights(alpha);
     weights = arma::exp(weights - arma::accu(model.scales));
@@ -35,7 +35,7 @@ Rcpp::List importance_sample_ng(const Rcpp::List model_,
   case 2: {
     bsm_ng model(model_, seed);
     model.approximate();
-    arma::cube alpha = model.approx_model.simulate_states(nsim);
+    arma::cube alpha = model.simulate_approx_states(nsim);
     model.update_scales();
     arma::vec weights = model.importance_weights(alpha);
     weights = arma::exp(weights - arma::accu(model.scales));
@@ -45,7 +45,7 @@ Rcpp::List importance_sample_ng(const Rcpp::List model_,
   case 3: {
     svm model(model_, seed);
     model.approximate();
-    arma::cube alpha = model.approx_model.simulate_states(nsim);
+    arma::cube alpha = model.simulate_approx_states(nsim);
     model.update_scales();
     arma::vec weights = model.importance_weights(alpha);
     weights = arma::exp(weights - arma::accu(model.scales));
@@ -55,7 +55,7 @@ Rcpp::List importance_sample_ng(const Rcpp::List model_,
   case 4: {
     ar1_ng model(model_, seed);
     model.approximate();
-    arma::cube alpha = model.approx_model.simulate_states(nsim);
+    arma::cube alpha = model.simulate_approx_states(nsim);
     model.update_scales();
     arma::vec weights = model.importance_weights(alpha);
     weights = arma::exp(weights - arma::accu(model.scales));
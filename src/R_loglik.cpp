@@ -88,7 +88,9 @@ double nongaussian_loglik(const Rcpp::List model_,
 
 // [[Rcpp::export]]
 double nonlinear_loglik(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP Z_joint, SEXP T_joint,
+  SEXP T_batch, SEXP Z_batch,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const unsigned int n_states,
   const unsigned int n_etas,  const arma::uvec& time_varying,
@@ -111,6 +113,8 @@ double nonlinear_loglik(const arma::mat& y, SEXP Z, SEXP H,
   ssm_nlg model(y, *xpfun_Z, *xpfun_H, *xpfun_T, *xpfun_R, *xpfun_Zg, *xpfun_Tg,
     *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, known_tv_params, n_states, n_etas,
     time_varying, update_fn, prior_fn, seed);
+  model.set_joint_fns(Z_joint, T_joint);
+  model.set_batch_fns(T_batch, Z_batch);
   
   model.max_iter = max_iter;
   model.conv_tol = conv_tol;
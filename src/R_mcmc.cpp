@@ -11,12 +11,25 @@
 #include "model_svm.h"
 #include "model_ssm_nlg.h"
 
+// add the diagnostics of multiple chains to the output
+Rcpp::List chain_output(Rcpp::List out, const mcmc& mcmc_run) {
+  if (mcmc_run.chain_acceptance_rate.n_elem > 1) {
+    out.push_back(mcmc_run.chain_storage, "chain");
+    out.push_back(mcmc_run.chain_acceptance_rate, "chain_acceptance_rate");
+    if (mcmc_run.swap_rate.n_elem > 0) {
+      out.push_back(mcmc_run.swap_rate, "swap_rate");
+    }
+  }
+  return out;
+}
+
 // [[Rcpp::export]]
 Rcpp::List gaussian_mcmc(const Rcpp::List model_,
   const unsigned int output_type, const unsigned int iter, const unsigned int burnin,
   const unsigned int thin, const double gamma, const double target_acceptance,
   const arma::mat S, const unsigned int seed, const bool end_ram,
-  const unsigned int n_threads, const int model_type) {
+  const unsigned int n_threads, const int model_type,
+  const arma::vec betas, const unsigned int swap_interval) {
   
   arma::vec a1 = Rcpp::as<arma::vec>(model_["a1"]);
   unsigned int m = a1.n_elem;
@@ -31,6 +44,7 @@ Rcpp::List gaussian_mcmc(const Rcpp::List model_,
   }
   mcmc mcmc_run(iter, burnin, thin, n, m,
     target_acceptance, gamma, S, output_type);
+  mcmc_run.set_chains(betas, swap_interval, seed);
   
   switch (model_type) {
   case 0: {
@@ -40,27 +54,27 @@ Rcpp::List gaussian_mcmc(const Rcpp::List model_,
     switch (output_type) {
     case 1: {
       mcmc_run.state_posterior(model, n_threads); //sample states
-      return Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
+      return chain_output(Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
         Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     case 2: {
       //summary
       mcmc_run.state_summary(model);
-      return Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      return chain_output(Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     case 3: {
       //marginal of theta
-      return Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      return chain_output(Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     }
   } break;
@@ -71,27 +85,27 @@ Rcpp::List gaussian_mcmc(const Rcpp::List model_,
     switch (output_type) {
     case 1: {
       mcmc_run.state_posterior(model, n_threads); //sample states
-      return Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
+      return chain_output(Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
         Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     case 2: {
       //summary
       mcmc_run.state_summary(model);
-      return Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      return chain_output(Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     case 3: {
       //marginal of theta
-      return Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      return chain_output(Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     }
   } break;
@@ -101,27 +115,27 @@ Rcpp::List gaussian_mcmc(const Rcpp::List model_,
     switch (output_type) {
     case 1: {
       mcmc_run.state_posterior(model, n_threads); //sample states
-      return Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
+      return chain_output(Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
         Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     case 2: {
       //summary
       mcmc_run.state_summary(model);
-      return Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      return chain_output(Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     case 3: {
       //marginal of theta
-      return Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      return chain_output(Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     }
   } break;
@@ -131,27 +145,27 @@ Rcpp::List gaussian_mcmc(const Rcpp::List model_,
     switch (output_type) {
     case 1: {
       mcmc_run.state_posterior(model, n_threads); //sample states
-      return Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
+      return chain_output(Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
         Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     case 2: {
       //summary
       mcmc_run.state_summary(model);
-      return Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      return chain_output(Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     case 3: {
       //marginal of theta
-      return Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      return chain_output(Rcpp::List::create(Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
         Rcpp::Named("counts") = mcmc_run.count_storage,
         Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+        Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
     } break;
     }
   } break;
@@ -167,7 +181,8 @@ Rcpp::List nongaussian_pm_mcmc(const Rcpp::List model_,
   const unsigned int burnin, const unsigned int thin,
   const double gamma, const double target_acceptance, const arma::mat S,
   const unsigned int seed, const bool end_ram, const unsigned int n_threads,
-  const unsigned int sampling_method, const unsigned int model_type) {
+  const unsigned int sampling_method, const unsigned int model_type,
+  const arma::vec betas, const unsigned int swap_interval) {
   
   arma::vec a1 = Rcpp::as<arma::vec>(model_["a1"]);
   unsigned int m = a1.n_elem;
@@ -182,6 +197,7 @@ Rcpp::List nongaussian_pm_mcmc(const Rcpp::List model_,
   }
   mcmc mcmc_run(iter, burnin, thin, n, m,
     target_acceptance, gamma, S, output_type);
+  mcmc_run.set_chains(betas, swap_interval, seed);
   
   switch (model_type) {
   case 0: {
@@ -207,29 +223,29 @@ Rcpp::List nongaussian_pm_mcmc(const Rcpp::List model_,
   }
   switch (output_type) {
   case 1: {
-    return Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
+    return chain_output(Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
       Rcpp::Named("S") = mcmc_run.S,
-      Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 2: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
       Rcpp::Named("S") = mcmc_run.S,
-      Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 3: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
       Rcpp::Named("S") = mcmc_run.S,  
-      Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   }
   
@@ -244,7 +260,9 @@ Rcpp::List nongaussian_da_mcmc(const Rcpp::List model_,
   const unsigned int burnin, const unsigned int thin, const double gamma,
   const double target_acceptance, const arma::mat S, const unsigned int seed,
   const bool end_ram, const unsigned int n_threads,
-  const unsigned int sampling_method, const int model_type) {
+  const unsigned int sampling_method, const int model_type,
+  const arma::vec betas, const unsigned int swap_interval,
+  const bool speculative) {
   
   arma::vec a1 = Rcpp::as<arma::vec>(model_["a1"]);
   unsigned int m = a1.n_elem;
@@ -258,6 +276,8 @@ Rcpp::List nongaussian_da_mcmc(const Rcpp::List model_,
     n = y.n_rows;
   }
   mcmc mcmc_run(iter, burnin, thin, n, m, target_acceptance, gamma, S, output_type);
+  mcmc_run.set_chains(betas, swap_interval, seed);
+  mcmc_run.set_prefetch(speculative ? n_threads : 0);
   
   switch (model_type) {
   case 0: {
@@ -284,29 +304,29 @@ Rcpp::List nongaussian_da_mcmc(const Rcpp::List model_,
   
   switch (output_type) {
   case 1: {
-    return Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
+    return chain_output(Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
       Rcpp::Named("S") = mcmc_run.S,  
-      Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 2: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
       Rcpp::Named("S") = mcmc_run.S,  
-      Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 3: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
       Rcpp::Named("S") = mcmc_run.S,  
-      Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   }
   
@@ -323,7 +343,8 @@ Rcpp::List nongaussian_is_mcmc(const Rcpp::List model_,
   const double target_acceptance, const arma::mat S, const unsigned int seed,
   const bool end_ram, const unsigned int n_threads,
   const unsigned int sampling_method, const unsigned int is_type,
-  const int model_type, const bool approx) {
+  const int model_type, const bool approx,
+  const arma::vec betas, const unsigned int swap_interval) {
   
   arma::vec a1 = Rcpp::as<arma::vec>(model_["a1"]);
   unsigned int m = a1.n_elem;
@@ -341,6 +362,7 @@ Rcpp::List nongaussian_is_mcmc(const Rcpp::List model_,
   
   approx_mcmc mcmc_run(iter, burnin, thin, n, m, p,
     target_acceptance, gamma, S, output_type, sampling_method != 2);
+  mcmc_run.set_chains(betas, swap_interval, seed);
   if (nsim <= 1) {
     mcmc_run.alpha_storage.zeros();
     mcmc_run.weight_storage.ones();
@@ -492,30 +514,30 @@ Rcpp::List nongaussian_is_mcmc(const Rcpp::List model_,
   
   switch (output_type) {
   case 1: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("alpha") = mcmc_run.alpha_storage,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("weights") = mcmc_run.weight_storage,
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 2: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("weights") = mcmc_run.weight_storage,
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 3: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("weights") = mcmc_run.weight_storage,
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   }
   
@@ -524,7 +546,9 @@ Rcpp::List nongaussian_is_mcmc(const Rcpp::List model_,
 
 // [[Rcpp::export]]
 Rcpp::List nonlinear_pm_mcmc(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP Z_joint, SEXP T_joint,
+  SEXP T_batch, SEXP Z_batch,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const arma::uvec& time_varying,
   const unsigned int n_states, const unsigned int n_etas,
@@ -535,7 +559,8 @@ Rcpp::List nonlinear_pm_mcmc(const arma::mat& y, SEXP Z, SEXP H,
   const unsigned int max_iter, const double conv_tol,
   const unsigned int sampling_method, const unsigned int iekf_iter,
   const unsigned int output_type,
-  const Rcpp::Function update_fn, const Rcpp::Function prior_fn) {
+  const Rcpp::Function update_fn, const Rcpp::Function prior_fn,
+  const arma::vec betas, const unsigned int swap_interval) {
   
   
   Rcpp::XPtr<nvec_fnPtr> xpfun_Z(Z);
@@ -550,34 +575,38 @@ Rcpp::List nonlinear_pm_mcmc(const arma::mat& y, SEXP Z, SEXP H,
   
   ssm_nlg model(y, *xpfun_Z, *xpfun_H, *xpfun_T, *xpfun_R, *xpfun_Zg, *xpfun_Tg,
     *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, known_tv_params, n_states, n_etas,
-    time_varying, update_fn, prior_fn, seed);
+    time_varying, update_fn, prior_fn, seed, iekf_iter, max_iter, conv_tol);
+  model.set_joint_fns(Z_joint, T_joint);
+  model.set_batch_fns(T_batch, Z_batch);
+  model.approx_threads = n_threads;
   
   mcmc mcmc_run(iter, burnin, thin, model.n,
     model.m, target_acceptance, gamma, S, output_type);
+  mcmc_run.set_chains(betas, swap_interval, seed);
   mcmc_run.pm_mcmc(model, sampling_method, nsim, end_ram);
   
   switch (output_type) {
   case 1: {
-    return Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
+    return chain_output(Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 2: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 3: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   }
   
@@ -585,7 +614,9 @@ Rcpp::List nonlinear_pm_mcmc(const arma::mat& y, SEXP Z, SEXP H,
 }
 // [[Rcpp::export]]
 Rcpp::List nonlinear_da_mcmc(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP Z_joint, SEXP T_joint,
+  SEXP T_batch, SEXP Z_batch,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const arma::uvec& time_varying,
   const unsigned int n_states, const unsigned int n_etas,
@@ -596,7 +627,9 @@ Rcpp::List nonlinear_da_mcmc(const arma::mat& y, SEXP Z, SEXP H,
   const unsigned int max_iter, const double conv_tol,
   const unsigned int sampling_method, const unsigned int iekf_iter,
   const unsigned int output_type,
-  const Rcpp::Function update_fn, const Rcpp::Function prior_fn) {
+  const Rcpp::Function update_fn, const Rcpp::Function prior_fn,
+  const arma::vec betas, const unsigned int swap_interval,
+  const bool speculative) {
   
   
   Rcpp::XPtr<nvec_fnPtr> xpfun_Z(Z);
@@ -611,34 +644,39 @@ Rcpp::List nonlinear_da_mcmc(const arma::mat& y, SEXP Z, SEXP H,
   
   ssm_nlg model(y, *xpfun_Z, *xpfun_H, *xpfun_T, *xpfun_R, *xpfun_Zg, *xpfun_Tg,
     *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, known_tv_params, n_states, n_etas,
-    time_varying, update_fn, prior_fn, seed);
+    time_varying, update_fn, prior_fn, seed, iekf_iter, max_iter, conv_tol);
+  model.set_joint_fns(Z_joint, T_joint);
+  model.set_batch_fns(T_batch, Z_batch);
+  model.approx_threads = n_threads;
   
   mcmc mcmc_run(iter, burnin, thin, model.n,
     model.m, target_acceptance, gamma, S, output_type);
+  mcmc_run.set_chains(betas, swap_interval, seed);
+  mcmc_run.set_prefetch(speculative ? n_threads : 0);
   mcmc_run.da_mcmc(model, sampling_method, nsim, end_ram);
   
   switch (output_type) {
   case 1: {
-    return Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
+    return chain_output(Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 2: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 3: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   }
   
@@ -647,7 +685,8 @@ Rcpp::List nonlinear_da_mcmc(const arma::mat& y, SEXP Z, SEXP H,
 
 // [[Rcpp::export]]
 Rcpp::List nonlinear_ekf_mcmc(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP Z_joint, SEXP T_joint,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const arma::uvec& time_varying,
   const unsigned int n_states, const unsigned int n_etas,
@@ -656,7 +695,8 @@ Rcpp::List nonlinear_ekf_mcmc(const arma::mat& y, SEXP Z, SEXP H,
   const double gamma, const double target_acceptance, const arma::mat S,
   const bool end_ram, const unsigned int n_threads,
   const unsigned int iekf_iter, const unsigned int output_type,
-  const Rcpp::Function update_fn, const Rcpp::Function prior_fn) {
+  const Rcpp::Function update_fn, const Rcpp::Function prior_fn,
+  const unsigned int method) {
   
   
   Rcpp::XPtr<nvec_fnPtr> xpfun_Z(Z);
@@ -671,12 +711,13 @@ Rcpp::List nonlinear_ekf_mcmc(const arma::mat& y, SEXP Z, SEXP H,
   
   ssm_nlg model(y, *xpfun_Z, *xpfun_H, *xpfun_T, *xpfun_R, *xpfun_Zg, *xpfun_Tg,
     *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, known_tv_params, n_states, n_etas,
-    time_varying, update_fn, prior_fn, seed);
+    time_varying, update_fn, prior_fn, seed, iekf_iter);
+  model.set_joint_fns(Z_joint, T_joint);
   
   approx_mcmc mcmc_run(iter, burnin, thin, model.n,
     model.m, model.m, target_acceptance, gamma, S, output_type, false);
   
-  mcmc_run.ekf_mcmc(model, end_ram);
+  mcmc_run.ekf_mcmc(model, end_ram, method);
   
  if (output_type == 2) {
     
@@ -711,7 +752,9 @@ Rcpp::List nonlinear_ekf_mcmc(const arma::mat& y, SEXP Z, SEXP H,
 
 // [[Rcpp::export]]
 Rcpp::List nonlinear_is_mcmc(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP Z_joint, SEXP T_joint,
+  SEXP T_batch, SEXP Z_batch,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const arma::uvec& time_varying,
   const unsigned int n_states, const unsigned int n_etas,
@@ -723,7 +766,8 @@ Rcpp::List nonlinear_is_mcmc(const arma::mat& y, SEXP Z, SEXP H,
   const double conv_tol, const unsigned int iekf_iter,
   const unsigned int output_type,
   const Rcpp::Function update_fn, const Rcpp::Function prior_fn,
-  const bool approx) {
+  const bool approx,
+  const arma::vec betas, const unsigned int swap_interval) {
   
   Rcpp::XPtr<nvec_fnPtr> xpfun_Z(Z);
   Rcpp::XPtr<nmat_fnPtr> xpfun_H(H);
@@ -738,9 +782,13 @@ Rcpp::List nonlinear_is_mcmc(const arma::mat& y, SEXP Z, SEXP H,
   ssm_nlg model(y, *xpfun_Z, *xpfun_H, *xpfun_T, *xpfun_R, *xpfun_Zg, *xpfun_Tg,
     *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, known_tv_params, n_states, n_etas,
     time_varying, update_fn, prior_fn, seed, iekf_iter, max_iter, conv_tol);
+  model.set_joint_fns(Z_joint, T_joint);
+  model.set_batch_fns(T_batch, Z_batch);
+  model.approx_threads = n_threads;
 
   approx_mcmc mcmc_run(iter, burnin, thin, model.n,
     model.m, model.m, target_acceptance, gamma, S, output_type, sampling_method == 1);
+  mcmc_run.set_chains(betas, swap_interval, seed);
   
   mcmc_run.amcmc(model, sampling_method, end_ram);
   
@@ -759,36 +807,40 @@ Rcpp::List nonlinear_is_mcmc(const arma::mat& y, SEXP Z, SEXP H,
     if (sampling_method == 1) {
       mcmc_run.is_correction_psi(model, nsim, is_type, n_threads);
     } else {
-      mcmc_run.is_correction_bsf(model, nsim, is_type, n_threads);
+      if (sampling_method > 3) {
+        mcmc_run.is_correction_kf(model, sampling_method, nsim, is_type, n_threads);
+      } else {
+        mcmc_run.is_correction_bsf(model, nsim, is_type, n_threads);
+      }
     }
   } 
   
   switch (output_type) {
   case 1: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("alpha") = mcmc_run.alpha_storage,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("weights") = mcmc_run.weight_storage,
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 2: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("weights") = mcmc_run.weight_storage,
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   case 3: {
-    return Rcpp::List::create(
+    return chain_output(Rcpp::List::create(
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("weights") = mcmc_run.weight_storage,
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
-      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage), mcmc_run);
   } break;
   }
   
@@ -21,15 +21,15 @@ double R_milstein(const double x0, const unsigned int L, const double t,
     drift, diffusion, ddiffusion, positive, eng);
 }
 
+// returns the terminal values of the coarse and fine discretisations
+// driven by the Brownian path of the given particle and time step
 // [[Rcpp::export]]
-double R_milstein_joint(const double x0,
+arma::vec R_milstein_joint(const double x0,
   const unsigned int L_c, const unsigned int L_f, const double t,
   const arma::vec& theta,
   SEXP drift_pntr, SEXP diffusion_pntr, SEXP ddiffusion_pntr,
-  bool positive, const unsigned int seed) {
-
-  sitmo::prng_engine eng_c(seed);
-  sitmo::prng_engine eng_f(seed + 1);
+  bool positive, const unsigned int seed,
+  const unsigned int particle = 0, const unsigned int step = 0) {
 
   Rcpp::XPtr<fnPtr> xpfun_drift(drift_pntr);
   fnPtr drift = *xpfun_drift;
@@ -40,7 +40,9 @@ double R_milstein_joint(const double x0,
   Rcpp::XPtr<fnPtr> xpfun_ddiffusion(ddiffusion_pntr);
   fnPtr ddiffusion = *xpfun_ddiffusion;
 
-  return milstein_joint(x0, L_c, L_f, t, theta,
-    drift, diffusion, ddiffusion,
-    positive, eng_c, eng_f);
+  arma::vec x(2);
+  x.fill(x0);
+  milstein_joint(x(0), x(1), L_c, L_f, t, theta,
+    drift, diffusion, ddiffusion, positive, seed, particle, step);
+  return x;
 }
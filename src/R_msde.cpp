@@ -0,0 +1,235 @@
+#include "model_ssm_msde.h"
+
+#include "filter_smoother.h"
+#include "summary.h"
+#include "mcmc.h"
+#include "approx_mcmc.h"
+
+
+// [[Rcpp::export]]
+double loglik_msde(const arma::mat& y, const arma::vec& x0,
+  SEXP drift_pntr, SEXP diffusion_pntr,
+  SEXP log_prior_pdf_pntr, SEXP log_obs_density_pntr,
+  const arma::vec& theta, const unsigned int nsim,
+  const unsigned int L, const unsigned int scheme, const unsigned int seed) {
+
+  Rcpp::XPtr<vec_sde_fnPtr> xpfun_drift(drift_pntr);
+  Rcpp::XPtr<mat_sde_fnPtr> xpfun_diffusion(diffusion_pntr);
+  Rcpp::XPtr<prior_fnPtr> xpfun_prior(log_prior_pdf_pntr);
+  Rcpp::XPtr<mobs_fnPtr> xpfun_obs(log_obs_density_pntr);
+
+  ssm_msde model(y, theta, x0, *xpfun_drift, *xpfun_diffusion, 
+    *xpfun_obs, *xpfun_prior, L, L, scheme, seed);
+
+  unsigned int n = model.n;
+  arma::cube alpha(model.m, n + 1, nsim);
+  arma::mat weights(nsim, n + 1);
+  arma::umat indices(nsim, n);
+  return model.bsf_filter(nsim, L, alpha, weights, indices);
+}
+
+// [[Rcpp::export]]
+Rcpp::List bsf_msde(const arma::mat& y, const arma::vec& x0,
+  SEXP drift_pntr, SEXP diffusion_pntr,
+  SEXP log_prior_pdf_pntr, SEXP log_obs_density_pntr,
+  const arma::vec& theta, const unsigned int nsim,
+  const unsigned int L, const unsigned int scheme, const unsigned int seed) {
+
+  Rcpp::XPtr<vec_sde_fnPtr> xpfun_drift(drift_pntr);
+  Rcpp::XPtr<mat_sde_fnPtr> xpfun_diffusion(diffusion_pntr);
+  Rcpp::XPtr<prior_fnPtr> xpfun_prior(log_prior_pdf_pntr);
+  Rcpp::XPtr<mobs_fnPtr> xpfun_obs(log_obs_density_pntr);
+
+  ssm_msde model(y, theta, x0, *xpfun_drift, *xpfun_diffusion, 
+    *xpfun_obs, *xpfun_prior, L, L, scheme, seed);
+
+  unsigned int n = model.n;
+  unsigned int m = model.m;
+  arma::cube alpha(m, n + 1, nsim);
+  arma::mat weights(nsim, n + 1);
+  arma::umat indices(nsim, n);
+  double loglik = model.bsf_filter(nsim, L, alpha, weights, indices);
+
+  arma::mat at(m, n + 1);
+  arma::mat att(m, n + 1);
+  arma::cube Pt(m, m, n + 1);
+  arma::cube Ptt(m, m, n + 1);
+  filter_summary(alpha, at, att, Pt, Ptt, weights);
+
+  arma::inplace_trans(at);
+  arma::inplace_trans(att);
+  return Rcpp::List::create(
+    Rcpp::Named("at") = at, Rcpp::Named("att") = att,
+    Rcpp::Named("Pt") = Pt, Rcpp::Named("Ptt") = Ptt,
+    Rcpp::Named("weights") = weights,
+    Rcpp::Named("logLik") = loglik, Rcpp::Named("alpha") = alpha);
+}
+
+// [[Rcpp::export]]
+Rcpp::List msde_pm_mcmc(const arma::mat& y, const arma::vec& x0,
+  SEXP drift_pntr, SEXP diffusion_pntr,
+  SEXP log_prior_pdf_pntr, SEXP log_obs_density_pntr,
+  const arma::vec& theta, const unsigned int nsim,
+  const unsigned int L, const unsigned int scheme,
+  const unsigned int seed, const unsigned int iter,
+  const unsigned int burnin, const unsigned int thin,
+  const double gamma, const double target_acceptance, const arma::mat S,
+  const bool end_ram, const unsigned int type) {
+
+  Rcpp::XPtr<vec_sde_fnPtr> xpfun_drift(drift_pntr);
+  Rcpp::XPtr<mat_sde_fnPtr> xpfun_diffusion(diffusion_pntr);
+  Rcpp::XPtr<prior_fnPtr> xpfun_prior(log_prior_pdf_pntr);
+  Rcpp::XPtr<mobs_fnPtr> xpfun_obs(log_obs_density_pntr);
+
+  ssm_msde model(y, theta, x0, *xpfun_drift, *xpfun_diffusion, 
+    *xpfun_obs, *xpfun_prior, L, L, scheme, seed);
+
+  mcmc mcmc_run(iter, burnin,
+    thin, model.n, model.m, target_acceptance, gamma, S, type);
+
+  mcmc_run.pm_mcmc(model, model.sampling_method, nsim, end_ram);
+
+  switch (type) {
+  case 1: {
+    return Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
+      Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      Rcpp::Named("counts") = mcmc_run.count_storage,
+      Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+  } break;
+  case 2: {
+    return Rcpp::List::create(
+      Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
+      Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      Rcpp::Named("counts") = mcmc_run.count_storage,
+      Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+  } break;
+  case 3: {
+    return Rcpp::List::create(
+      Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      Rcpp::Named("counts") = mcmc_run.count_storage,
+      Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+  } break;
+  }
+
+  return Rcpp::List::create(Rcpp::Named("error") = "error");
+}
+
+// [[Rcpp::export]]
+Rcpp::List msde_da_mcmc(const arma::mat& y, const arma::vec& x0,
+  SEXP drift_pntr, SEXP diffusion_pntr,
+  SEXP log_prior_pdf_pntr, SEXP log_obs_density_pntr,
+  const arma::vec& theta, const unsigned int nsim,
+  const arma::uvec& L_c, const unsigned int L_f, const unsigned int scheme, 
+  const unsigned int seed, const unsigned int iter,
+  const unsigned int burnin, const unsigned int thin,
+  const double gamma, const double target_acceptance, const arma::mat S,
+  const bool end_ram, const unsigned int type) {
+
+  Rcpp::XPtr<vec_sde_fnPtr> xpfun_drift(drift_pntr);
+  Rcpp::XPtr<mat_sde_fnPtr> xpfun_diffusion(diffusion_pntr);
+  Rcpp::XPtr<prior_fnPtr> xpfun_prior(log_prior_pdf_pntr);
+  Rcpp::XPtr<mobs_fnPtr> xpfun_obs(log_obs_density_pntr);
+
+  ssm_msde model(y, theta, x0, *xpfun_drift, *xpfun_diffusion, 
+    *xpfun_obs, *xpfun_prior, L_f, L_c(0), scheme, seed);
+  model.levels = arma::join_cols(L_c, arma::uvec({L_f}));
+
+  mcmc mcmc_run(iter, burnin,
+    thin, model.n, model.m, target_acceptance, gamma, S, type);
+
+  mcmc_run.da_mcmc(model, model.sampling_method, nsim, end_ram);
+
+  switch (type) {
+  case 1: {
+    return Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
+      Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      Rcpp::Named("counts") = mcmc_run.count_storage,
+      Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("stage_acceptance_rate") = mcmc_run.stage_acceptance_rate,
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+  } break;
+  case 2: {
+    return Rcpp::List::create(
+      Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
+      Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      Rcpp::Named("counts") = mcmc_run.count_storage,
+      Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("stage_acceptance_rate") = mcmc_run.stage_acceptance_rate,
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+  } break;
+  case 3: {
+    return Rcpp::List::create(
+      Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      Rcpp::Named("counts") = mcmc_run.count_storage,
+      Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("stage_acceptance_rate") = mcmc_run.stage_acceptance_rate,
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+  } break;
+  }
+  return Rcpp::List::create(Rcpp::Named("error") = "error");
+}
+
+// [[Rcpp::export]]
+Rcpp::List msde_is_mcmc(const arma::mat& y, const arma::vec& x0,
+  SEXP drift_pntr, SEXP diffusion_pntr,
+  SEXP log_prior_pdf_pntr, SEXP log_obs_density_pntr,
+  const arma::vec& theta, const unsigned int nsim,
+  const unsigned int L_c, const unsigned int L_f, const unsigned int scheme, 
+  const unsigned int seed, const unsigned int iter,
+  const unsigned int burnin, const unsigned int thin,
+  const double gamma, const double target_acceptance, const arma::mat S,
+  const bool end_ram, const unsigned int is_type, const unsigned int n_threads,
+  const unsigned int type) {
+
+  Rcpp::XPtr<vec_sde_fnPtr> xpfun_drift(drift_pntr);
+  Rcpp::XPtr<mat_sde_fnPtr> xpfun_diffusion(diffusion_pntr);
+  Rcpp::XPtr<prior_fnPtr> xpfun_prior(log_prior_pdf_pntr);
+  Rcpp::XPtr<mobs_fnPtr> xpfun_obs(log_obs_density_pntr);
+
+  ssm_msde model(y, theta, x0, *xpfun_drift, *xpfun_diffusion, 
+    *xpfun_obs, *xpfun_prior, L_f, L_c, scheme, seed);
+
+  approx_mcmc mcmc_run(iter, burnin, thin, model.n, model.m, 1,
+    target_acceptance, gamma, S, type);
+
+  mcmc_run.amcmc(model, nsim, end_ram);
+
+  if(is_type == 3) {
+    mcmc_run.expand();
+  }
+
+  mcmc_run.is_correction_bsf(model, nsim, is_type, n_threads);
+
+  switch (type) {
+  case 1: {
+    return Rcpp::List::create(Rcpp::Named("alpha") = mcmc_run.alpha_storage,
+      Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      Rcpp::Named("weights") = mcmc_run.weight_storage,
+      Rcpp::Named("counts") = mcmc_run.count_storage,
+      Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+  } break;
+  case 2: {
+    return Rcpp::List::create(
+      Rcpp::Named("alphahat") = mcmc_run.alphahat.t(), Rcpp::Named("Vt") = mcmc_run.Vt,
+      Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      Rcpp::Named("weights") = mcmc_run.weight_storage,
+      Rcpp::Named("counts") = mcmc_run.count_storage,
+      Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+  } break;
+  case 3: {
+    return Rcpp::List::create(
+      Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
+      Rcpp::Named("weights") = mcmc_run.weight_storage,
+      Rcpp::Named("counts") = mcmc_run.count_storage,
+      Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
+  } break;
+  }
+
+  return Rcpp::List::create(Rcpp::Named("error") = "error");
+}
@@ -157,9 +157,116 @@ Rcpp::List psi_smoother(const Rcpp::List model_,
   }
   return Rcpp::List::create(Rcpp::Named("error") = 0);
 }
+// number of allocations of the buffers of the filters and of the smoother 
+// of the approximating model when the Laplace approximation and psi-APF 
+// are recomputed n_rep times as in MCMC, used in testing that the buffers 
+// are reused
+template <class T>
+unsigned int count_psi_allocations(T& model, const unsigned int nsim, 
+  const unsigned int n_rep) {
+  
+  arma::cube alpha(model.m, model.n + 1, nsim);
+  arma::mat weights(nsim, model.n + 1);
+  arma::umat indices(nsim, model.n);
+  arma::vec theta = model.theta;
+  for (unsigned int i = 0; i < n_rep; i++) {
+    model.update_model(theta);
+    model.psi_filter(nsim, alpha, weights, indices);
+  }
+  return model.workspace.n_alloc + model.approx_model.workspace.n_alloc;
+}
+
+// [[Rcpp::export]]
+unsigned int psi_allocations(const Rcpp::List model_,
+  const unsigned int nsim, const unsigned int seed,
+  const unsigned int n_rep, const int model_type) {
+  
+  switch (model_type) {
+  case 0: {
+    ssm_mng model(model_, seed);
+    return count_psi_allocations(model, nsim, n_rep);
+  } break;
+  case 1: {
+    ssm_ung model(model_, seed);
+    return count_psi_allocations(model, nsim, n_rep);
+  } break;
+  case 2: {
+    bsm_ng model(model_, seed);
+    return count_psi_allocations(model, nsim, n_rep);
+  } break;
+  case 3: {
+    svm model(model_, seed);
+    return count_psi_allocations(model, nsim, n_rep);
+  } break;
+  case 4: {
+    ar1_ng model(model_, seed);
+    return count_psi_allocations(model, nsim, n_rep);
+  } break;
+  }
+  return 0;
+}
+
+// particles and log-likelihood estimates of the psi-APF or the bootstrap 
+// filter run repeatedly on the same model with the given numbers of 
+// particles, reseeding the engine before each run, used in testing that 
+// the reused buffers give the same results as the buffers of a new model
+template <class T>
+Rcpp::List repeated_filters(T& model, const arma::uvec& nsim, 
+  const unsigned int seed, const bool psi) {
+  
+  arma::vec loglik(nsim.n_elem);
+  Rcpp::List alphas(nsim.n_elem);
+  for (unsigned int i = 0; i < nsim.n_elem; i++) {
+    model.engine = sitmo::prng_engine(seed);
+    arma::cube alpha(model.m, model.n + 1, nsim(i));
+    arma::mat weights(nsim(i), model.n + 1);
+    arma::umat indices(nsim(i), model.n);
+    if (psi) {
+      loglik(i) = model.psi_filter(nsim(i), alpha, weights, indices);
+    } else {
+      loglik(i) = model.bsf_filter(nsim(i), alpha, weights, indices);
+    }
+    alphas[i] = alpha;
+  }
+  return Rcpp::List::create(
+    Rcpp::Named("logLik") = loglik, Rcpp::Named("alpha") = alphas);
+}
+
+// [[Rcpp::export]]
+Rcpp::List filters_reusing_workspace(const Rcpp::List model_,
+  const arma::uvec& nsim, const unsigned int seed, const bool psi, 
+  const int model_type) {
+  
+  switch (model_type) {
+  case 0: {
+    ssm_mng model(model_, seed);
+    return repeated_filters(model, nsim, seed, psi);
+  } break;
+  case 1: {
+    ssm_ung model(model_, seed);
+    return repeated_filters(model, nsim, seed, psi);
+  } break;
+  case 2: {
+    bsm_ng model(model_, seed);
+    return repeated_filters(model, nsim, seed, psi);
+  } break;
+  case 3: {
+    svm model(model_, seed);
+    return repeated_filters(model, nsim, seed, psi);
+  } break;
+  case 4: {
+    ar1_ng model(model_, seed);
+    return repeated_filters(model, nsim, seed, psi);
+  } break;
+  }
+  return Rcpp::List::create(Rcpp::Named("error") = 0);
+}
+
 // [[Rcpp::export]]
 Rcpp::List psi_smoother_nlg(const arma::mat& y, SEXP Z, SEXP H,
-  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP a1, SEXP P1,
+  SEXP T, SEXP R, SEXP Zg, SEXP Tg, SEXP Z_joint, SEXP T_joint,
+  SEXP T_batch, SEXP Z_batch,
+  SEXP a1, SEXP P1,
   const arma::vec& theta, SEXP log_prior_pdf, const arma::vec& known_params,
   const arma::mat& known_tv_params, const unsigned int n_states,
   const unsigned int n_etas,  const arma::uvec& time_varying,
@@ -182,6 +289,8 @@ Rcpp::List psi_smoother_nlg(const arma::mat& y, SEXP Z, SEXP H,
   ssm_nlg model(y, *xpfun_Z, *xpfun_H, *xpfun_T, *xpfun_R, *xpfun_Zg, *xpfun_Tg,
     *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, known_tv_params, n_states, n_etas,
     time_varying, update_fn, prior_fn, seed, iekf_iter, max_iter, conv_tol);
+  model.set_joint_fns(Z_joint, T_joint);
+  model.set_batch_fns(T_batch, Z_batch);
 
   unsigned int m = model.m;
   unsigned n = model.n;
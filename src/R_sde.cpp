@@ -9,7 +9,8 @@
 // [[Rcpp::export]]
 double loglik_sde(const arma::vec& y, const double x0,
   const bool positive, SEXP drift_pntr, SEXP diffusion_pntr,
-  SEXP ddiffusion_pntr, SEXP log_prior_pdf_pntr, SEXP log_obs_density_pntr,
+  SEXP ddiffusion_pntr, SEXP coef_batch_pntr, SEXP log_prior_pdf_pntr, 
+  SEXP log_obs_density_pntr,
   const arma::vec& theta, const unsigned int nsim,
   const unsigned int L, const unsigned int seed) {
 
@@ -23,6 +24,7 @@ double loglik_sde(const arma::vec& y, const double x0,
   ssm_sde model(y, theta, x0, positive,*xpfun_drift,
     *xpfun_diffusion, *xpfun_ddiffusion, *xpfun_obs, *xpfun_prior,
      L, L, seed);
+  model.set_batch_fn(coef_batch_pntr);
 
   unsigned int n = model.n;
   arma::cube alpha(1, n + 1, nsim);
@@ -34,7 +36,8 @@ double loglik_sde(const arma::vec& y, const double x0,
 // [[Rcpp::export]]
 Rcpp::List bsf_sde(const arma::vec& y, const double x0,
   const bool positive, SEXP drift_pntr, SEXP diffusion_pntr,
-  SEXP ddiffusion_pntr, SEXP log_prior_pdf_pntr, SEXP log_obs_density_pntr,
+  SEXP ddiffusion_pntr, SEXP coef_batch_pntr, SEXP log_prior_pdf_pntr, 
+  SEXP log_obs_density_pntr,
   const arma::vec& theta, const unsigned int nsim,
   const unsigned int L, const unsigned int seed) {
 
@@ -47,6 +50,7 @@ Rcpp::List bsf_sde(const arma::vec& y, const double x0,
   ssm_sde model(y, theta, x0, positive,*xpfun_drift,
     *xpfun_diffusion, *xpfun_ddiffusion, *xpfun_obs, *xpfun_prior,
      L, L, seed);
+  model.set_batch_fn(coef_batch_pntr);
 
   unsigned int n = model.n;
   arma::cube alpha(1, n + 1, nsim);
@@ -72,7 +76,8 @@ Rcpp::List bsf_sde(const arma::vec& y, const double x0,
 // [[Rcpp::export]]
 Rcpp::List bsf_smoother_sde(const arma::vec& y, const double x0,
   const bool positive, SEXP drift_pntr, SEXP diffusion_pntr,
-  SEXP ddiffusion_pntr, SEXP log_prior_pdf_pntr, SEXP log_obs_density_pntr,
+  SEXP ddiffusion_pntr, SEXP coef_batch_pntr, SEXP log_prior_pdf_pntr, 
+  SEXP log_obs_density_pntr,
   const arma::vec& theta, const unsigned int nsim,
   const unsigned int L, const unsigned int seed) {
 
@@ -85,6 +90,7 @@ Rcpp::List bsf_smoother_sde(const arma::vec& y, const double x0,
   ssm_sde model(y, theta, x0, positive,*xpfun_drift,
     *xpfun_diffusion, *xpfun_ddiffusion, *xpfun_obs, *xpfun_prior,
      L, L, seed);
+  model.set_batch_fn(coef_batch_pntr);
 
   unsigned int n = model.n;
   arma::cube alpha(1, n + 1, nsim);
@@ -109,7 +115,8 @@ Rcpp::List bsf_smoother_sde(const arma::vec& y, const double x0,
 // [[Rcpp::export]]
 Rcpp::List sde_pm_mcmc(const arma::vec& y, const double x0,
   const bool positive, SEXP drift_pntr, SEXP diffusion_pntr,
-  SEXP ddiffusion_pntr, SEXP log_prior_pdf_pntr, SEXP log_obs_density_pntr,
+  SEXP ddiffusion_pntr, SEXP coef_batch_pntr, SEXP log_prior_pdf_pntr, 
+  SEXP log_obs_density_pntr,
   const arma::vec& theta, const unsigned int nsim,
   const unsigned int L,
   const unsigned int seed, const unsigned int iter,
@@ -126,11 +133,12 @@ Rcpp::List sde_pm_mcmc(const arma::vec& y, const double x0,
   ssm_sde model(y, theta, x0, positive,*xpfun_drift,
     *xpfun_diffusion, *xpfun_ddiffusion, *xpfun_obs, *xpfun_prior,
      L, L, seed);
+  model.set_batch_fn(coef_batch_pntr);
 
   mcmc mcmc_run(iter, burnin,
     thin, model.n, 1, target_acceptance, gamma, S, type);
 
-  mcmc_run.pm_mcmc(model, 1, end_ram, nsim);
+  mcmc_run.pm_mcmc(model, model.sampling_method, nsim, end_ram);
 
   switch (type) {
   case 1: {
@@ -163,9 +171,10 @@ Rcpp::List sde_pm_mcmc(const arma::vec& y, const double x0,
 // [[Rcpp::export]]
 Rcpp::List sde_da_mcmc(const arma::vec& y, const double x0,
   const bool positive, SEXP drift_pntr, SEXP diffusion_pntr,
-  SEXP ddiffusion_pntr, SEXP log_prior_pdf_pntr, SEXP log_obs_density_pntr,
+  SEXP ddiffusion_pntr, SEXP coef_batch_pntr, SEXP log_prior_pdf_pntr, 
+  SEXP log_obs_density_pntr,
   const arma::vec& theta, const unsigned int nsim,
-  const unsigned int L_c, const unsigned int L_f, const unsigned int seed,
+  const arma::uvec& L_c, const unsigned int L_f, const unsigned int seed,
   const unsigned int iter,
   const unsigned int burnin, const unsigned int thin,
   const double gamma, const double target_acceptance, const arma::mat S,
@@ -179,12 +188,14 @@ Rcpp::List sde_da_mcmc(const arma::vec& y, const double x0,
 
   ssm_sde model(y, theta, x0, positive,*xpfun_drift,
     *xpfun_diffusion, *xpfun_ddiffusion, *xpfun_obs, *xpfun_prior,
-     L_f, L_c, seed);
+     L_f, L_c(0), seed);
+  model.set_batch_fn(coef_batch_pntr);
+  model.levels = arma::join_cols(L_c, arma::uvec({L_f}));
 
   mcmc mcmc_run(iter, burnin,
     thin, model.n, 1, target_acceptance, gamma, S, type);
 
-  mcmc_run.da_mcmc(model, 1, end_ram, nsim);
+  mcmc_run.da_mcmc(model, model.sampling_method, nsim, end_ram);
 
   switch (type) {
   case 1: {
@@ -192,6 +203,7 @@ Rcpp::List sde_da_mcmc(const arma::vec& y, const double x0,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("stage_acceptance_rate") = mcmc_run.stage_acceptance_rate,
       Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
   } break;
   case 2: {
@@ -200,6 +212,7 @@ Rcpp::List sde_da_mcmc(const arma::vec& y, const double x0,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("stage_acceptance_rate") = mcmc_run.stage_acceptance_rate,
       Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
   } break;
   case 3: {
@@ -207,6 +220,7 @@ Rcpp::List sde_da_mcmc(const arma::vec& y, const double x0,
       Rcpp::Named("theta") = mcmc_run.theta_storage.t(),
       Rcpp::Named("counts") = mcmc_run.count_storage,
       Rcpp::Named("acceptance_rate") = mcmc_run.acceptance_rate,
+      Rcpp::Named("stage_acceptance_rate") = mcmc_run.stage_acceptance_rate,
       Rcpp::Named("S") = mcmc_run.S,  Rcpp::Named("posterior") = mcmc_run.posterior_storage);
   } break;
   }
@@ -216,14 +230,15 @@ Rcpp::List sde_da_mcmc(const arma::vec& y, const double x0,
 // [[Rcpp::export]]
 Rcpp::List sde_is_mcmc(const arma::vec& y, const double x0,
   const bool positive, SEXP drift_pntr, SEXP diffusion_pntr,
-  SEXP ddiffusion_pntr, SEXP log_prior_pdf_pntr, SEXP log_obs_density_pntr,
+  SEXP ddiffusion_pntr, SEXP coef_batch_pntr, SEXP log_prior_pdf_pntr, 
+  SEXP log_obs_density_pntr,
   const arma::vec& theta, const unsigned int nsim,
   const unsigned int L_c, const unsigned int L_f, const unsigned int seed,
   const unsigned int iter,
   const unsigned int burnin, const unsigned int thin,
   const double gamma, const double target_acceptance, const arma::mat S,
   const bool end_ram, const unsigned int is_type, const unsigned int n_threads,
-  const unsigned int type) {
+  const unsigned int type, const bool mlmc) {
 
   Rcpp::XPtr<fnPtr> xpfun_drift(drift_pntr);
   Rcpp::XPtr<fnPtr> xpfun_diffusion(diffusion_pntr);
@@ -234,6 +249,8 @@ Rcpp::List sde_is_mcmc(const arma::vec& y, const double x0,
   ssm_sde model(y, theta, x0, positive,*xpfun_drift,
     *xpfun_diffusion, *xpfun_ddiffusion, *xpfun_obs, *xpfun_prior,
     L_f, L_c, seed);
+  model.set_batch_fn(coef_batch_pntr);
+  model.mlmc = mlmc;
 
   approx_mcmc mcmc_run(iter, burnin, thin, model.n, 1, 1,
     target_acceptance, gamma, S, type);
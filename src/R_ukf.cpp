@@ -23,13 +23,14 @@ Rcpp::List ukf_nlg(const arma::mat& y, SEXP Z, SEXP H,
   ssm_nlg model(y, *xpfun_Z, *xpfun_H, *xpfun_T, *xpfun_R, *xpfun_Zg, *xpfun_Tg,
     *xpfun_a1, *xpfun_P1,  theta, *xpfun_prior, known_params, known_tv_params, n_states, n_etas,
     time_varying, update_fn, prior_fn, 1);
-    
+  model.set_ukf_parameters(alpha, beta, kappa);
+  
   arma::mat at(model.m, model.n + 1);
   arma::mat att(model.m, model.n);
   arma::cube Pt(model.m, model.m, model.n + 1);
   arma::cube Ptt(model.m, model.m, model.n);
 
-  double logLik = model.ukf(at, att, Pt, Ptt, alpha, beta, kappa);
+  double logLik = model.ukf(at, att, Pt, Ptt);
 
   arma::inplace_trans(at);
   arma::inplace_trans(att);
@@ -10,11 +10,13 @@
 #include "model_ar1_ng.h"
 #include "model_ssm_nlg.h"
 #include "model_ssm_sde.h"
+#include "model_ssm_msde.h"
 
 #include "rep_mat.h"
 #include "distr_consts.h"
 #include "filter_smoother.h"
 #include "summary.h"
+#include "parallel_chains.h"
 
 approx_mcmc::approx_mcmc(const unsigned int iter,
   const unsigned int burnin, const unsigned int thin, const unsigned int n,
@@ -85,6 +87,34 @@ void approx_mcmc::expand() {
   }
 }
 
+void approx_mcmc::merge_chains(const std::vector<approx_mcmc>& chains,
+  const bool tempered) {
+  
+  mcmc::merge_chains(chains, tempered);
+  
+  unsigned int n_used = tempered ? 1 : chains.size();
+  approx_loglik_storage.set_size(n_stored);
+  weight_storage.set_size(n_stored);
+  prior_storage.set_size(n_stored);
+  if (store_modes) {
+    mode_storage.set_size(mode_storage.n_rows, mode_storage.n_cols, n_stored);
+  }
+  unsigned int start = 0;
+  for (unsigned int k = 0; k < n_used; k++) {
+    unsigned int n_k = chains[k].approx_loglik_storage.n_elem;
+    if (n_k > 0) {
+      unsigned int end = start + n_k - 1;
+      approx_loglik_storage.rows(start, end) = chains[k].approx_loglik_storage;
+      weight_storage.rows(start, end) = chains[k].weight_storage;
+      prior_storage.rows(start, end) = chains[k].prior_storage;
+      if (store_modes) {
+        mode_storage.slices(start, end) = chains[k].mode_storage;
+      }
+    }
+    start += n_k;
+  }
+}
+
 // run approximate MCMC for
 // non-linear and/or non-Gaussian state space model with linear-Gaussian states
 template void approx_mcmc::amcmc(ssm_ung model, const unsigned int method, const bool end_ram);
@@ -97,13 +127,26 @@ template void approx_mcmc::amcmc(ssm_mng model, const unsigned int method, const
 template<class T>
 void approx_mcmc::amcmc(T model, const unsigned int method, const bool end_ram) {
   
+  if (chain_betas.n_elem > 1 && !exchange) {
+    run_chains(*this, model, [&](approx_mcmc& chain, T& chain_model) {
+      chain.amcmc(chain_model, method, end_ram);
+    });
+    return;
+  }
+  
   // get the current values of theta
   arma::vec theta = model.theta;
+  double logprior;
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+{
   model.update_model(theta); // just in case
   // compute the log[p(theta)]
-  double logprior = model.log_prior_pdf(theta);
+  logprior = model.log_prior_pdf(theta);
+}
   if (!arma::is_finite(logprior)) {
-    Rcpp::stop("Initial prior probability is not finite.");
+    stop_chain("Initial prior probability is not finite.");
   }
   // placeholders
   arma::cube alpha(1, 1, 1);
@@ -114,7 +157,7 @@ void approx_mcmc::amcmc(T model, const unsigned int method, const bool end_ram)
   arma::vec ll = model.log_likelihood(method, 0, alpha, weights, indices);
   double approx_loglik = ll(0);
   if (!std::isfinite(approx_loglik))
-    Rcpp::stop("Initial log-likelihood is not finite.");
+    stop_chain("Initial log-likelihood is not finite.");
   
   
   std::normal_distribution<> normal(0.0, 1.0);
@@ -127,8 +170,9 @@ void approx_mcmc::amcmc(T model, const unsigned int method, const bool end_ram)
   double acceptance_prob = 0.0;
   
   for (unsigned int i = 1; i <= iter; i++) {
+    bool changed = false;
     
-    if (i % 16 == 0) {
+    if (!exchange && i % 16 == 0) {
       Rcpp::checkUserInterrupt();
     }
     
@@ -141,21 +185,29 @@ void approx_mcmc::amcmc(T model, const unsigned int method, const bool end_ram)
     // propose new theta
     arma::vec theta_prop = theta + S * u;
     // compute prior
-    double logprior_prop = model.log_prior_pdf(theta_prop);
+    double logprior_prop;
+    // needs critical as the prior might be an R function
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    logprior_prop = model.log_prior_pdf(theta_prop);
     if (logprior_prop > -std::numeric_limits<double>::infinity() && !std::isnan(logprior_prop)) {
       // update parameters
+#ifdef _OPENMP
+#pragma omp critical
+#endif
       model.update_model(theta_prop);
       
       arma::vec ll = model.log_likelihood(method, 0, alpha, weights, indices);
       double approx_loglik_prop = ll(0);
-      acceptance_prob = std::min(1.0, std::exp(approx_loglik_prop - approx_loglik +
+      acceptance_prob = std::min(1.0, std::exp(beta * (approx_loglik_prop - approx_loglik) +
         logprior_prop - logprior));
       
       if (unif(model.engine) < acceptance_prob) {
         if (i > burnin) {
           acceptance_rate++;
-          n_values++;
         }
+        changed = true;
         approx_loglik = approx_loglik_prop;
         logprior = logprior_prop;
         theta = theta_prop;
@@ -164,6 +216,28 @@ void approx_mcmc::amcmc(T model, const unsigned int method, const bool end_ram)
       }
     } else acceptance_prob = 0.0;
     
+    // swap move between the tempered chains
+    if (exchange && swap_interval > 0 && i % swap_interval == 0) {
+      chain_state state;
+      state.theta = theta;
+      state.logprior = logprior;
+      state.loglik = approx_loglik * arma::ones(1);
+      state.alpha = mode;
+      bool swapped;
+      if (!exchange->swap(chain_id, state, swapped)) break;
+      if (swapped) {
+        theta = state.theta;
+        logprior = state.logprior;
+        approx_loglik = state.loglik(0);
+        mode = state.alpha;
+        changed = true;
+        new_value = true;
+      }
+    }
+    
+    // thinning counts the iterations where the state changed, by an 
+    // accepted proposal, a swap, or both
+    if (i > burnin && changed) n_values++;
     if (i > burnin && n_values % thin == 0) {
       //new block
       if (new_value) {
@@ -213,15 +287,16 @@ void approx_mcmc::is_correction_psi(T model, const unsigned int nsim,
   arma::cube Valpha(model.m, model.m, model.n + 1, arma::fill::zeros);
   double sum_w = 0.0;
   
+  // each sample has its own stream, so the results do not depend on n_threads
+  uint64_t key = draw_key(model.engine);
+
 #ifdef _OPENMP
 #pragma omp parallel num_threads(n_threads) default(shared) firstprivate(model)
 {
   
-  model.engine = sitmo::prng_engine(omp_get_thread_num() + 1);
-  
-  
 #pragma omp for schedule(dynamic)
   for (unsigned int i = 0; i < theta_storage.n_cols; i++) {
+    set_streams(model, key, chain_id, i);
     
     // needs critical as updating might call R function
     #pragma omp critical
@@ -270,6 +345,7 @@ void approx_mcmc::is_correction_psi(T model, const unsigned int nsim,
 #else
 
 for (unsigned int i = 0; i < theta_storage.n_cols; i++) {
+  set_streams(model, key, chain_id, i);
   
   model.update_model(theta_storage.col(i));
   model.approximate_for_is(mode_storage.slice(i));
@@ -339,17 +415,48 @@ template <class T>
 void approx_mcmc::is_correction_bsf(T model, const unsigned int nsim,
   const unsigned int is_type, const unsigned int n_threads) {
   
+  is_correction_filter(model, nsim, is_type, n_threads, 
+    [](T& model, const unsigned int nsim, arma::cube& alpha, 
+      arma::mat& weights, arma::umat& indices) {
+      return model.bsf_filter(nsim, alpha, weights, indices);
+    });
+}
+
+// IS-correction using EKF (method = 4) or UKF (method = 5) based 
+// particle filter, for approximate chains based on EKF or UKF
+void approx_mcmc::is_correction_kf(ssm_nlg model, const unsigned int method, 
+  const unsigned int nsim, const unsigned int is_type, 
+  const unsigned int n_threads) {
+  
+  is_correction_filter(model, nsim, is_type, n_threads, 
+    [method](ssm_nlg& model, const unsigned int nsim, arma::cube& alpha, 
+      arma::mat& weights, arma::umat& indices) {
+      if (method == 5) {
+        return model.ukf_filter(nsim, alpha, weights, indices);
+      }
+      return model.ekf_filter(nsim, alpha, weights, indices);
+    });
+}
+
+// IS-correction where the weights are based on the particle filter given 
+// as function filter(model, nsim, alpha, weights, indices)
+template <class T, class F>
+void approx_mcmc::is_correction_filter(T model, const unsigned int nsim,
+  const unsigned int is_type, const unsigned int n_threads, F filter) {
+  
   arma::cube Valpha(model.m, model.m, model.n + 1, arma::fill::zeros);
   double sum_w = 0.0;
   
+  // each sample has its own stream, so the results do not depend on n_threads
+  uint64_t key = draw_key(model.engine);
+
 #ifdef _OPENMP
 #pragma omp parallel num_threads(n_threads) default(shared) firstprivate(model)
 {
   
-  model.engine = sitmo::prng_engine(omp_get_thread_num() + 1);
-  
 #pragma omp for schedule(dynamic)
   for (unsigned int i = 0; i < theta_storage.n_cols; i++) {
+    set_streams(model, key, chain_id, i);
     
     // needs critical as updating might call R function
 #pragma omp critical
@@ -366,7 +473,7 @@ arma::cube alpha_i(model.m, model.n + 1, nsimc);
 arma::mat weights_i(nsimc, model.n + 1);
 arma::umat indices(nsimc, model.n);
 
-double loglik = model.bsf_filter(nsim, alpha_i, weights_i, indices);
+double loglik = filter(model, nsim, alpha_i, weights_i, indices);
 weight_storage(i) = std::exp(loglik - approx_loglik_storage(i));
 if (output_type != 3) {
   filter_smoother(alpha_i, indices);
@@ -396,6 +503,7 @@ if (output_type != 3) {
 }
 #else
 for (unsigned int i = 0; i < theta_storage.n_cols; i++) {
+  set_streams(model, key, chain_id, i);
   
   // needs critical as updating might call R function
 #pragma omp critical
@@ -412,7 +520,7 @@ arma::cube alpha_i(model.m, model.n + 1, nsimc);
 arma::mat weights_i(nsimc, model.n + 1);
 arma::umat indices(nsimc, model.n);
 
-double loglik = model.bsf_filter(nsim, alpha_i, weights_i, indices);
+double loglik = filter(model, nsim, alpha_i, weights_i, indices);
 weight_storage(i) = std::exp(loglik - approx_loglik_storage(i));
 
 if (output_type != 3) {
@@ -463,16 +571,16 @@ void approx_mcmc::is_correction_spdk(T model, const unsigned int nsim,
   arma::cube Valpha(model.m, model.m, model.n + 1, arma::fill::zeros);
   double sum_w = 0.0;
   
+  // each sample has its own stream, so the results do not depend on n_threads
+  uint64_t key = draw_key(model.engine);
+
 #ifdef _OPENMP
 #pragma omp parallel num_threads(n_threads) default(shared) firstprivate(model)
 {
   
-  model.engine = sitmo::prng_engine(omp_get_thread_num() + 1);
-  
-  model.approx_model.engine = model.engine;
-  
 #pragma omp for schedule(dynamic)
   for (unsigned int i = 0; i < theta_storage.n_cols; i++) {
+    set_streams(model, key, chain_id, i);
     
     // needs critical as updating might call R function
 #pragma omp critical
@@ -517,7 +625,9 @@ if (output_type != 3) {
 #else
 
 for (unsigned int i = 0; i < theta_storage.n_cols; i++) {
+  set_streams(model, key, chain_id, i);
   
+  model.update_model(theta_storage.col(i));
   model.approximate_for_is(mode_storage.slice(i));
   
   unsigned int nsimc = nsim;
@@ -567,15 +677,16 @@ template void approx_mcmc::approx_state_posterior(ssm_mng model, const unsigned
 template <class T>
 void approx_mcmc::approx_state_posterior(T model, const unsigned int n_threads) {
   
+  // each sample has its own stream, so the results do not depend on n_threads
+  uint64_t key = draw_key(model.engine);
+
 #ifdef _OPENMP
 #pragma omp parallel num_threads(n_threads) default(shared) firstprivate(model)
 {
   
-  model.engine = sitmo::prng_engine(omp_get_thread_num() + 1);
-  
-  
 #pragma omp for schedule(dynamic)
   for (unsigned int i = 0; i < theta_storage.n_cols; i++) {
+    set_streams(model, key, chain_id, i);
 #pragma omp critical
 {
   model.update_model(theta_storage.col(i));
@@ -586,6 +697,7 @@ void approx_mcmc::approx_state_posterior(T model, const unsigned int n_threads)
 }
 #else
 for (unsigned int i = 0; i < theta_storage.n_cols; i++) {
+  set_streams(model, key, chain_id, i);
   model.update_model(theta_storage.col(i));
   model.approximate_for_is(mode_storage.slice(i));
   alpha_storage.slice(i) = model.approx_model.simulate_states(1).slice(0).t();
@@ -632,7 +744,8 @@ void approx_mcmc::approx_state_summary(T model) {
   Vt += Valpha / sum_w; // Var[E(alpha)] + E[Var(alpha)]
 }
 
-void approx_mcmc::ekf_mcmc(ssm_nlg model, const bool end_ram) {
+void approx_mcmc::ekf_mcmc(ssm_nlg model, const bool end_ram, 
+  const unsigned int method) {
   
   
   arma::vec theta = model.theta;
@@ -640,9 +753,9 @@ void approx_mcmc::ekf_mcmc(ssm_nlg model, const bool end_ram) {
   
   model.update_model(theta); // just in case
   // compute the log-likelihood
-  double loglik = model.ekf_loglik();
+  double loglik = method == 5 ? model.ukf_loglik() : model.ekf_loglik();
   if (!arma::is_finite(loglik)) {
-    Rcpp::stop("Initial approximate likelihood is not finite.");
+    stop_chain("Initial approximate likelihood is not finite.");
   }
   double acceptance_prob = 0.0;
   std::normal_distribution<> normal(0.0, 1.0);
@@ -670,7 +783,8 @@ void approx_mcmc::ekf_mcmc(ssm_nlg model, const bool end_ram) {
     if (logprior_prop > -std::numeric_limits<double>::infinity() && !std::isnan(logprior_prop)) {
       // update parameters
       model.theta = theta_prop;
-      double loglik_prop = model.ekf_loglik();
+      double loglik_prop = 
+        method == 5 ? model.ukf_loglik() : model.ekf_loglik();
       
       if (loglik_prop > -std::numeric_limits<double>::infinity() && !std::isnan(loglik_prop)) {
         
@@ -719,13 +833,16 @@ void approx_mcmc::ekf_mcmc(ssm_nlg model, const bool end_ram) {
 
 void approx_mcmc::ekf_state_sample(ssm_nlg model, const unsigned int n_threads) {
 
+  // each sample has its own stream, so the results do not depend on n_threads
+  uint64_t key = draw_key(model.engine);
+
 #ifdef _OPENMP
 #pragma omp parallel num_threads(n_threads) default(shared) firstprivate(model)
 {
-  model.engine = sitmo::prng_engine(omp_get_thread_num() + 1);
   
 #pragma omp for schedule(dynamic)
   for (unsigned int i = 0; i < theta_storage.n_cols; i++) {
+    set_streams(model, key, chain_id, i);
 #pragma omp critical
 {
   model.update_model(theta_storage.col(i));
@@ -738,6 +855,7 @@ void approx_mcmc::ekf_state_sample(ssm_nlg model, const unsigned int n_threads)
 #else
 
 for (unsigned int i = 0; i < theta_storage.n_cols; i++) {
+  set_streams(model, key, chain_id, i);
   
   model.update_model(theta_storage.col(i));
   model.approximate_by_ekf();
@@ -780,14 +898,16 @@ void approx_mcmc::ekf_state_summary(ssm_nlg model) {
 
 
 // run approximate MCMC for SDE model
-void approx_mcmc::amcmc(ssm_sde model, const unsigned int nsim, const bool end_ram) {
+// coarse level of the SDE model is used as an approximation
+template<class T>
+void approx_mcmc::sde_amcmc(T model, const unsigned int nsim, const bool end_ram) {
   
-  unsigned int m = 1;
+  unsigned int m = model.m;
   unsigned n = model.n;
   // compute the log[p(theta)]
   double logprior = model.log_prior_pdf(model.theta);
   if (!arma::is_finite(logprior)) {
-    Rcpp::stop("Initial prior probability is not finite.");
+    stop_chain("Initial prior probability is not finite.");
   }
   
   arma::cube alpha(m, n + 1, nsim);
@@ -795,7 +915,7 @@ void approx_mcmc::amcmc(ssm_sde model, const unsigned int nsim, const bool end_r
   arma::umat indices(nsim, n);
   double loglik = model.bsf_filter(nsim, model.L_c, alpha, weights, indices);
   if (!std::isfinite(loglik))
-    Rcpp::stop("Initial log-likelihood is not finite.");
+    stop_chain("Initial log-likelihood is not finite.");
   
   double acceptance_prob = 0.0;
   bool new_value = true;
@@ -867,32 +987,60 @@ void approx_mcmc::amcmc(ssm_sde model, const unsigned int nsim, const bool end_r
   acceptance_rate /= (iter - burnin);
 }
 
-template<>
-void approx_mcmc::is_correction_bsf<ssm_sde>(ssm_sde model, const unsigned int nsim,
+void approx_mcmc::amcmc(ssm_sde model, const unsigned int nsim, const bool end_ram) {
+  sde_amcmc(model, nsim, end_ram);
+}
+
+void approx_mcmc::amcmc(ssm_msde model, const unsigned int nsim, const bool end_ram) {
+  sde_amcmc(model, nsim, end_ram);
+}
+
+// IS-weight based on the finest level of the SDE model
+double sde_weight(ssm_sde& model, const unsigned int nsim, 
+  const double approx_loglik, arma::cube& alpha, arma::mat& weights, 
+  arma::umat& indices) {
+  if (model.mlmc) {
+    return model.mlmc_weight(nsim, approx_loglik, alpha, weights, indices);
+  }
+  double loglik = model.bsf_filter(nsim, model.L_f, alpha, weights, indices);
+  return std::exp(loglik - approx_loglik);
+}
+
+double sde_weight(ssm_msde& model, const unsigned int nsim, 
+  const double approx_loglik, arma::cube& alpha, arma::mat& weights, 
+  arma::umat& indices) {
+  double loglik = model.bsf_filter(nsim, model.L_f, alpha, weights, indices);
+  return std::exp(loglik - approx_loglik);
+}
+
+template<class T>
+void approx_mcmc::sde_is_correction(T model, const unsigned int nsim,
   const unsigned int is_type, const unsigned int n_threads) {
   
-  arma::cube Valpha(1, 1, model.n + 1, arma::fill::zeros);
+  unsigned int m = model.m;
+  arma::cube Valpha(m, m, model.n + 1, arma::fill::zeros);
   double sum_w = 0.0;
   
+  // each sample has its own stream, so the results do not depend on n_threads
+  uint64_t key = draw_key(model.engine);
+
 #ifdef _OPENMP
 #pragma omp parallel num_threads(n_threads) default(shared) firstprivate(model)
 {
   
-  model.engine = sitmo::prng_engine(omp_get_thread_num() + 1);
-  model.coarse_engine = sitmo::prng_engine(omp_get_thread_num() + n_threads + 1);
-  
 #pragma omp for schedule(dynamic)
   for (unsigned int i = 0; i < n_stored; i++) {
+    set_streams(model, key, chain_id, i);
     model.theta = theta_storage.col(i);
     unsigned int nsimc = nsim;
     if (is_type == 1) {
       nsimc *= count_storage(i);
     }
-    arma::cube alpha_i(1, model.n + 1, nsimc);
+    arma::cube alpha_i(m, model.n + 1, nsimc);
     arma::mat weights_i(nsimc, model.n + 1);
     arma::umat indices(nsimc, model.n);
-    double loglik = model.bsf_filter(nsim, model.L_f, alpha_i, weights_i, indices);
-    weight_storage(i) = std::exp(loglik - approx_loglik_storage(i));
+    weight_storage(i) = sde_weight(model, nsimc, approx_loglik_storage(i), 
+      alpha_i, weights_i, indices);
     
     if (output_type != 3) {
       filter_smoother(alpha_i, indices);
@@ -901,8 +1049,8 @@ void approx_mcmc::is_correction_bsf<ssm_sde>(ssm_sde model, const unsigned int n
         std::discrete_distribution<unsigned int> sample(w.begin(), w.end());
         alpha_storage.slice(i) = alpha_i.slice(sample(model.engine)).t();
       } else {
-        arma::mat alphahat_i(1, model.n + 1);
-        arma::cube Vt_i(1, 1, model.n + 1);
+        arma::mat alphahat_i(m, model.n + 1);
+        arma::cube Vt_i(m, m, model.n + 1);
         weighted_summary(alpha_i, alphahat_i, Vt_i, w);
 #pragma omp critical
 {
@@ -921,16 +1069,17 @@ void approx_mcmc::is_correction_bsf<ssm_sde>(ssm_sde model, const unsigned int n
 }
 #else
 for (unsigned int i = 0; i < n_stored; i++) {
+  set_streams(model, key, chain_id, i);
   model.theta = theta_storage.col(i);
   unsigned int nsimc = nsim;
   if (is_type == 1) {
     nsimc *= count_storage(i);
   }
-  arma::cube alpha_i(1, model.n + 1, nsimc);
+  arma::cube alpha_i(m, model.n + 1, nsimc);
   arma::mat weights_i(nsimc, model.n + 1);
   arma::umat indices(nsimc, model.n);
-  double loglik = model.bsf_filter(nsim, model.L_f, alpha_i, weights_i, indices);
-  weight_storage(i) = std::exp(loglik - approx_loglik_storage(i));
+  weight_storage(i) = sde_weight(model, nsimc, approx_loglik_storage(i), 
+    alpha_i, weights_i, indices);
   
   if (output_type != 3) {
     filter_smoother(alpha_i, indices);
@@ -939,8 +1088,8 @@ for (unsigned int i = 0; i < n_stored; i++) {
       std::discrete_distribution<unsigned int> sample(w.begin(), w.end());
       alpha_storage.slice(i) = alpha_i.slice(sample(model.engine)).t();
     } else {
-      arma::mat alphahat_i(1, model.n + 1);
-      arma::cube Vt_i(1, 1, model.n + 1);
+      arma::mat alphahat_i(m, model.n + 1);
+      arma::cube Vt_i(m, m, model.n + 1);
       weighted_summary(alpha_i, alphahat_i, Vt_i, w);
       
       arma::mat diff = alphahat_i - alphahat;
@@ -959,6 +1108,19 @@ for (unsigned int i = 0; i < n_stored; i++) {
 if (output_type == 2) {
   Vt += Valpha / theta_storage.n_cols; // Var[E(alpha)] + E[Var(alpha)]
 }
-posterior_storage = prior_storage + approx_loglik_storage + arma::log(weight_storage);
+// the multilevel weights can be negative, the log-posterior of those is -Inf
+posterior_storage = prior_storage + approx_loglik_storage + 
+  arma::log(arma::clamp(weight_storage, 0.0, arma::datum::inf));
 }
 
+template<>
+void approx_mcmc::is_correction_bsf<ssm_sde>(ssm_sde model, const unsigned int nsim,
+  const unsigned int is_type, const unsigned int n_threads) {
+  sde_is_correction(model, nsim, is_type, n_threads);
+}
+
+template<>
+void approx_mcmc::is_correction_bsf<ssm_msde>(ssm_msde model, const unsigned int nsim,
+  const unsigned int is_type, const unsigned int n_threads) {
+  sde_is_correction(model, nsim, is_type, n_threads);
+}
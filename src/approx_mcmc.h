@@ -5,6 +5,7 @@
 #include "mcmc.h"
 #include "model_ssm_nlg.h"
 #include "model_ssm_sde.h"
+#include "model_ssm_msde.h"
 
 class approx_mcmc: public mcmc {
 
@@ -17,12 +18,16 @@ public:
     const unsigned int output_type = 1, const bool store_modes = true);
 
   void expand();
+  
+  // combine the output of parallel chains
+  void merge_chains(const std::vector<approx_mcmc>& chains, const bool tempered);
 
   //approximate mcmc
   template<class T>
   void amcmc(T model, const unsigned int method, const bool end_ram);
 
   void amcmc(ssm_sde model, const unsigned int nsim, const bool end_ram);
+  void amcmc(ssm_msde model, const unsigned int nsim, const bool end_ram);
     
   template <class T>
   void is_correction_psi(T model, const unsigned int nsim,
@@ -32,6 +37,10 @@ public:
   void is_correction_bsf(T model, const unsigned int nsim,
     const unsigned int is_type, const unsigned int n_threads);
 
+  void is_correction_kf(ssm_nlg model, const unsigned int method, 
+    const unsigned int nsim, const unsigned int is_type, 
+    const unsigned int n_threads);
+
   template <class T>
   void is_correction_spdk(T model, const unsigned int nsim,
     const unsigned int is_type, const unsigned int n_threads);
@@ -46,7 +55,9 @@ public:
   
   void ekf_state_sample(ssm_nlg model, const unsigned int n_threads);
     
-  void ekf_mcmc(ssm_nlg model, const bool end_ram);
+  // approximate MCMC based on EKF (method = 4) or UKF (method = 5)
+  void ekf_mcmc(ssm_nlg model, const bool end_ram, 
+    const unsigned int method = 4);
   
   arma::vec weight_storage;
   arma::cube mode_storage;
@@ -54,6 +65,18 @@ public:
 private:
 
   void trim_storage();
+  
+  template <class T, class F>
+  void is_correction_filter(T model, const unsigned int nsim,
+    const unsigned int is_type, const unsigned int n_threads, F filter);
+  
+  // shared implementations for the SDE models
+  template<class T>
+  void sde_amcmc(T model, const unsigned int nsim, const bool end_ram);
+  template<class T>
+  void sde_is_correction(T model, const unsigned int nsim,
+    const unsigned int is_type, const unsigned int n_threads);
+  
   arma::vec approx_loglik_storage;
   arma::vec prior_storage;
   const bool store_modes;
@@ -0,0 +1,84 @@
+#include "block_tridiag.h"
+
+void block_tridiag::set_size(const unsigned int m, const unsigned int n) {
+
+  if (diag.n_rows != m || diag.n_slices != n) {
+    diag.set_size(m, m, n);
+    offdiag.set_size(m, m, n - 1);
+    L_diag.set_size(m, m, n);
+    L_offdiag.set_size(m, m, n - 1);
+    rhs.set_size(m, n);
+    mean.set_size(m, n);
+  }
+  valid = false;
+}
+
+// Q = L L' where L is block lower bidiagonal with blocks L_t (lower
+// triangular) on the diagonal and B_t = Q_t+1,t L_t'^{-1} below it, so that
+// L_t+1 L_t+1' = Q_t+1,t+1 - B_t B_t'
+bool block_tridiag::factorize() {
+
+  unsigned int n = diag.n_slices;
+  valid = false;
+  logdet = 0.0;
+  arma::mat S;
+  arma::mat Lt;
+  for (unsigned int t = 0; t < n; t++) {
+    S = diag.slice(t);
+    if (t > 0) {
+      L_offdiag.slice(t - 1) = arma::solve(arma::trimatl(L_diag.slice(t - 1)),
+        offdiag.slice(t - 1).t()).t();
+      S -= L_offdiag.slice(t - 1) * L_offdiag.slice(t - 1).t();
+    }
+    if (!S.is_finite() || !arma::chol(Lt, arma::symmatu(S), "lower")) {
+      return false;
+    }
+    L_diag.slice(t) = Lt;
+    logdet += 2.0 * arma::accu(arma::log(Lt.diag()));
+  }
+  return true;
+}
+
+// forward substitution L w = b followed by backward substitution L' x = w
+void block_tridiag::solve() {
+
+  unsigned int n = diag.n_slices;
+  mean.col(0) = arma::solve(arma::trimatl(L_diag.slice(0)), rhs.col(0));
+  for (unsigned int t = 1; t < n; t++) {
+    mean.col(t) = arma::solve(arma::trimatl(L_diag.slice(t)),
+      rhs.col(t) - L_offdiag.slice(t - 1) * mean.col(t - 1));
+  }
+  mean.col(n - 1) = arma::solve(arma::trimatu(L_diag.slice(n - 1).t()),
+    mean.col(n - 1));
+  for (int t = n - 2; t >= 0; t--) {
+    mean.col(t) = arma::solve(arma::trimatu(L_diag.slice(t).t()),
+      mean.col(t) - L_offdiag.slice(t).t() * mean.col(t + 1));
+  }
+  valid = true;
+}
+
+void block_tridiag::sample(const arma::mat& z, arma::mat& x,
+  const double sign) const {
+
+  unsigned int n = diag.n_slices;
+  arma::vec v = arma::solve(arma::trimatu(L_diag.slice(n - 1).t()),
+    z.col(n - 1));
+  x.col(n - 1) = mean.col(n - 1) + sign * v;
+  for (int t = n - 2; t >= 0; t--) {
+    v = arma::solve(arma::trimatu(L_diag.slice(t).t()),
+      z.col(t) - L_offdiag.slice(t).t() * v);
+    x.col(t) = mean.col(t) + sign * v;
+  }
+}
+
+bool inv_sympd_logdet(const arma::mat& A, arma::mat& Ainv, double& logdet) {
+
+  arma::mat L;
+  if (!A.is_finite() || !arma::chol(L, arma::symmatu(A), "lower")) {
+    return false;
+  }
+  arma::mat Linv = arma::inv(arma::trimatl(L));
+  Ainv = Linv.t() * Linv;
+  logdet = 2.0 * arma::accu(arma::log(L.diag()));
+  return true;
+}
@@ -0,0 +1,58 @@
+// block tridiagonal precision matrix of the states of a linear-Gaussian model
+
+#ifndef BLOCK_TRIDIAG_H
+#define BLOCK_TRIDIAG_H
+
+#include "bssm.h"
+
+// The joint posterior precision Q of alpha_1, ..., alpha_n of a
+// linear-Gaussian state space model is block tridiagonal with m x m blocks,
+// so the smoothed means solve Q x = b and can be computed with a block
+// Cholesky factorization Q = L L' in O(n m^3) operations, which also gives
+// log|Q| and exact draws x + L'^{-1} z from the smoothing distribution.
+// The buffers are sized only if the dimensions change, so the object can be
+// reused over the iterations of the mode finder and over the MCMC iterations.
+class block_tridiag {
+
+public:
+
+  block_tridiag() : valid(false), logdet(0.0), constant(0.0) {}
+
+  // diagonal blocks Q_tt, t = 1, ..., n
+  arma::cube diag;
+  // subdiagonal blocks Q_t+1,t, t = 1, ..., n - 1
+  arma::cube offdiag;
+  // right-hand side b
+  arma::mat rhs;
+  // diagonal and subdiagonal blocks of L
+  arma::cube L_diag;
+  arma::cube L_offdiag;
+  // solution of Q x = b, i.e. the smoothed means
+  arma::mat mean;
+  // does the factorization and the solution match the current model
+  bool valid;
+  // log|Q|
+  double logdet;
+  // terms of the joint log-density of the observations and the states which 
+  // do not depend on the states, plus 0.5 n m log(2 pi)
+  double constant;
+
+  void set_size(const unsigned int m, const unsigned int n);
+  // factorize Q, returns false if Q is not positive definite
+  bool factorize();
+  // solve Q x = b for mean, requires factorize
+  void solve();
+  // first n columns of x = mean + sign * L'^{-1} z where z is m x n matrix,
+  // requires solve
+  void sample(const arma::mat& z, arma::mat& x, const double sign = 1.0) const;
+  // log-density of the observations given Q, b and constant, requires solve
+  double log_likelihood() const {
+    return constant + 0.5 * arma::accu(rhs % mean) - 0.5 * logdet;
+  }
+};
+
+// inverse and log-determinant of symmetric positive definite A, returns false 
+// if A is not positive definite
+bool inv_sympd_logdet(const arma::mat& A, arma::mat& Ainv, double& logdet);
+
+#endif
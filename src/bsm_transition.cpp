@@ -0,0 +1,91 @@
+#include "bsm_transition.h"
+
+bsm_transition::bsm_transition() : m(0), slope(false), noise(false), s(0), 
+  q(0) {
+}
+
+bsm_transition::bsm_transition(const unsigned int m, const bool slope, 
+  const bool seasonal, const bool noise) : 
+  m(m), slope(slope), noise(noise), s(1 + slope), 
+  q(seasonal ? m - 1 - slope - noise : 0) {
+}
+
+arma::mat bsm_transition::dense() const {
+  
+  arma::mat T(m, m, arma::fill::zeros);
+  T(0, 0) = 1.0;
+  if (slope) {
+    T(0, 1) = 1.0;
+    T(1, 1) = 1.0;
+  }
+  for (unsigned int j = 0; j < q; j++) {
+    T(s, s + j) = -1.0;
+  }
+  for (unsigned int j = 1; j < q; j++) {
+    T(s + j, s + j - 1) = 1.0;
+  }
+  return T;
+}
+
+void bsm_transition::times(const double* x, double* y) const {
+  
+  y[0] = slope ? x[0] + x[1] : x[0];
+  if (slope) {
+    y[1] = x[1];
+  }
+  if (q > 0) {
+    double sum = 0.0;
+    for (unsigned int j = 0; j < q; j++) {
+      sum += x[s + j];
+    }
+    for (unsigned int j = q - 1; j > 0; j--) {
+      y[s + j] = x[s + j - 1];
+    }
+    y[s] = -sum;
+  }
+  if (noise) {
+    y[m - 1] = 0.0;
+  }
+}
+
+void bsm_transition::trans_times(const double* x, double* y) const {
+  
+  if (slope) {
+    y[1] = x[0] + x[1];
+  }
+  y[0] = x[0];
+  for (unsigned int j = 0; j < q; j++) {
+    y[s + j] = (j < q - 1) ? x[s + j + 1] - x[s] : -x[s];
+  }
+  if (noise) {
+    y[m - 1] = 0.0;
+  }
+}
+
+arma::vec bsm_transition::times(const arma::vec& x) const {
+  arma::vec y(m);
+  times(x.memptr(), y.memptr());
+  return y;
+}
+
+arma::vec bsm_transition::trans_times(const arma::vec& x) const {
+  arma::vec y(m);
+  trans_times(x.memptr(), y.memptr());
+  return y;
+}
+
+arma::mat bsm_transition::sandwich(const arma::mat& A) const {
+  
+  // B = T A, then T A T' = (T B')'
+  arma::mat B(m, m);
+  for (unsigned int j = 0; j < m; j++) {
+    times(A.colptr(j), B.colptr(j));
+  }
+  arma::inplace_trans(B);
+  arma::mat TAT(m, m);
+  for (unsigned int j = 0; j < m; j++) {
+    times(B.colptr(j), TAT.colptr(j));
+  }
+  arma::inplace_trans(TAT);
+  return TAT;
+}
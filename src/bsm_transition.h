@@ -0,0 +1,45 @@
+// transition matrix of the basic structural time series model
+
+#ifndef BSM_TRANSITION_H
+#define BSM_TRANSITION_H
+
+#include "bssm.h"
+
+// The transition matrix of bsm_lg and bsm_ng models consists of the local 
+// level or local linear trend block, the dummy seasonal block (first row of 
+// -1s and a shift matrix below it), and optionally of an additional noise 
+// state with zero transition. The products with T are then computed in O(m) 
+// operations, so that T P T' costs O(m^2) instead of O(m^3).
+class bsm_transition {
+  
+public:
+  
+  // inactive structure (general dense T)
+  bsm_transition();
+  bsm_transition(const unsigned int m, const bool slope, const bool seasonal, 
+    const bool noise);
+  
+  bool active() const { return m > 0; }
+  // the corresponding dense matrix
+  arma::mat dense() const;
+  
+  // y = T x and y = T' x
+  void times(const double* x, double* y) const;
+  void trans_times(const double* x, double* y) const;
+  
+  arma::vec times(const arma::vec& x) const;
+  arma::vec trans_times(const arma::vec& x) const;
+  // T A T'
+  arma::mat sandwich(const arma::mat& A) const;
+  
+private:
+  
+  unsigned int m;
+  bool slope;
+  bool noise;
+  // index of the first seasonal state and the number of seasonal states
+  unsigned int s;
+  unsigned int q;
+};
+
+#endif
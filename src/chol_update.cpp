@@ -0,0 +1,45 @@
+#include "chol_update.h"
+
+// Rank-one update (sign = 1) or downdate (sign = -1) of lower triangular 
+// Cholesky factor L, so that L L' + sign * x x' = L_new L_new'. 
+// Returns false if the downdated matrix is not positive definite, in which 
+// case L is left in an unspecified state.
+bool chol_update(arma::mat& L, arma::vec x, const double sign) {
+  
+  unsigned int n = x.n_elem;
+  for (unsigned int k = 0; k < n; k++) {
+    // zero row and column, nothing to rotate
+    if (L(k, k) == 0.0 && x(k) == 0.0) continue;
+    double r2 = L(k, k) * L(k, k) + sign * x(k) * x(k);
+    // a downdate to a zero diagonal element is not positive definite either
+    if (r2 < 0.0 || (sign < 0.0 && r2 <= 0.0) || L(k, k) == 0.0) return false;
+    double r = std::sqrt(r2);
+    double c = r / L(k, k);
+    double s = x(k) / L(k, k);
+    L(k, k) = r;
+    if (k + 1 < n) {
+      L.col(k).tail(n - k - 1) = 
+        (L.col(k).tail(n - k - 1) + sign * s * x.tail(n - k - 1)) / c;
+      x.tail(n - k - 1) = c * x.tail(n - k - 1) - s * L.col(k).tail(n - k - 1);
+    }
+  }
+  return true;
+}
+
+// Lower triangular factor L with non-negative diagonal so that L L' = A A', 
+// computed from the QR decomposition of A'
+arma::mat qr_chol(const arma::mat& A) {
+  
+  unsigned int n = A.n_rows;
+  arma::mat Q;
+  arma::mat R;
+  arma::qr_econ(Q, R, A.t());
+  
+  arma::mat L(n, n, arma::fill::zeros);
+  unsigned int k = std::min(n, R.n_rows);
+  for (unsigned int i = 0; i < k; i++) {
+    double sign = R(i, i) < 0.0 ? -1.0 : 1.0;
+    L.col(i).tail(n - i) = sign * R.row(i).tail(n - i).t();
+  }
+  return L;
+}
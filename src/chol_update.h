@@ -0,0 +1,9 @@
+#ifndef CHOL_UPDATE_H
+#define CHOL_UPDATE_H
+
+#include "bssm.h"
+
+bool chol_update(arma::mat& L, arma::vec x, const double sign);
+arma::mat qr_chol(const arma::mat& A);
+
+#endif
@@ -18,4 +18,9 @@ double binomial_log_const(const arma::vec& y, const arma::vec& u);
 double negbin_log_const(const arma::vec& y, const arma::vec& u, double phi);
 double gamma_log_const(const arma::vec& y, const arma::vec& u, double phi);
 
+// log(1 + exp(x)) of the binomial log-density, without overflow for large x
+inline double log1p_exp(const double x) {
+  return x > 0 ? x + std::log1p(std::exp(-x)) : std::log1p(std::exp(x));
+}
+
 #endif
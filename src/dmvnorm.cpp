@@ -76,6 +76,43 @@ double precompute_dmvnorm(const arma::mat& sigma, arma::mat& Linv, const arma::u
     arma::accu(arma::log(Linv.diag()));
   return constant;
 }
+// as precompute_dmvnorm, but using only the observed elements obs of x,
+// in which case the decomposition of the covariance submatrix is computed
+// as in dmvnorm; index contains the elements of x used in fast_dmvnorm
+double precompute_dmvnorm_obs(const arma::mat& sigma, const arma::uvec& obs,
+  arma::mat& Linv, arma::uvec& index) { 
+  
+  unsigned int p = obs.n_elem;
+  if (p == sigma.n_cols) {
+    index = arma::find(sigma.diag() > (std::numeric_limits<double>::epsilon() * p * sigma.diag().max()));
+    Linv.set_size(index.n_elem, index.n_elem);
+    return precompute_dmvnorm(sigma, Linv, index);
+  }
+  
+  index = obs;
+  arma::mat sigma2 = sigma * sigma.t();
+  return precompute_dmvnorm_cov(sigma2(obs, obs), Linv);
+}
+
+// as precompute_dmvnorm, but for a (possibly singular) covariance matrix 
+// instead of its Cholesky factor, as in dmvnorm with lwr = false;
+// all elements of x are used in fast_dmvnorm
+double precompute_dmvnorm_cov(const arma::mat& sigma, arma::mat& Linv) { 
+  
+  unsigned int p = sigma.n_cols;
+  arma::mat U(p, p);
+  arma::mat V(p, p);
+  arma::vec s(p);
+  bool success = arma::svd_econ(U, s, V, sigma, "left");
+  if (!success) {
+    Linv.zeros(0, p);
+    return -std::numeric_limits<double>::infinity();
+  }
+  arma::uvec nonzero = arma::find(s > (std::numeric_limits<double>::epsilon() * p * s(0)));
+  Linv = arma::diagmat(1.0 / arma::sqrt(s(nonzero))) * U.cols(nonzero).t();
+  return -0.5 * (nonzero.n_elem * std::log(2.0 * M_PI) + arma::accu(arma::log(s(nonzero))));
+}
+
 //[[Rcpp::export]]
 double fast_dmvnorm(const arma::vec& x, const arma::vec& mean, 
   const arma::mat& Linv, const arma::uvec& nonzero, const double constant) { 
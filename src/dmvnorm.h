@@ -7,6 +7,9 @@ double dmvnorm(const arma::vec& x, const arma::vec& mean,
   const arma::mat& sigma, bool lwr, bool logd);
 double precompute_dmvnorm(const arma::mat& sigma, arma::mat& Linv, 
   const arma::uvec& nonzero);
+double precompute_dmvnorm_obs(const arma::mat& sigma, const arma::uvec& obs,
+  arma::mat& Linv, arma::uvec& index);
+double precompute_dmvnorm_cov(const arma::mat& sigma, arma::mat& Linv);
 double fast_dmvnorm(const arma::vec& x, const arma::vec& mean, 
   const arma::mat& Linv, const arma::uvec& nonzero, const double constant);
 #endif
@@ -0,0 +1,15 @@
+#include "ep_update.h"
+
+// Golub-Welsch: the nodes are the eigenvalues of the Jacobi matrix of the
+// probabilists' Hermite polynomials, and the weights are the squared first
+// elements of the normalized eigenvectors
+void gauss_hermite(const unsigned int n, arma::vec& nodes, arma::vec& weights) {
+
+  arma::mat J(n, n, arma::fill::zeros);
+  for (unsigned int i = 1; i < n; i++) {
+    J(i, i - 1) = J(i - 1, i) = std::sqrt(static_cast<double>(i));
+  }
+  arma::mat V;
+  arma::eig_sym(nodes, V, J);
+  weights = arma::square(V.row(0).t());
+}
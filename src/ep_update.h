@@ -0,0 +1,58 @@
+// moment matching updates of the Gaussian pseudo-observations
+// (expectation propagation)
+
+#ifndef EP_UPDATE_H
+#define EP_UPDATE_H
+
+#include "bssm.h"
+
+// Gauss-Hermite nodes and weights for expectations over N(0, 1)
+void gauss_hermite(const unsigned int n, arma::vec& nodes, arma::vec& weights);
+
+// The pseudo-observation y_t with variance HH_t of the approximating model is
+// a Gaussian site with precision tau = 1 / HH_t and nu = y_t / HH_t in the
+// signal. Given the smoothed mean and variance of the signal, remove the site
+// to get the cavity distribution, match the mean and variance of the cavity
+// times the observation density (computed by quadrature), and move tau and
+// nu towards the site which gives these moments by the fraction damping.
+// Returns false and leaves the site unchanged if the cavity or the new site
+// would have a non-positive precision.
+template <class F>
+bool ep_site_update(const double mean, const double var, F log_density,
+  const arma::vec& nodes, const arma::vec& weights, const double damping,
+  double& tau, double& nu) {
+
+  double tau_cavity = 1.0 / var - tau;
+  double nu_cavity = mean / var - nu;
+  if (!(tau_cavity > 0.0)) {
+    return false;
+  }
+  double mean_cavity = nu_cavity / tau_cavity;
+  double sd_cavity = std::sqrt(1.0 / tau_cavity);
+
+  arma::vec s = mean_cavity + sd_cavity * nodes;
+  arma::vec lw(nodes.n_elem);
+  for (unsigned int i = 0; i < nodes.n_elem; i++) {
+    lw(i) = std::log(weights(i)) + log_density(s(i));
+  }
+  if (!lw.is_finite()) {
+    return false;
+  }
+  arma::vec w = arma::exp(lw - lw.max());
+  w /= arma::accu(w);
+  double mean_tilted = arma::dot(w, s);
+  double var_tilted = arma::dot(w, arma::square(s - mean_tilted));
+  if (!(var_tilted > 0.0)) {
+    return false;
+  }
+  double tau_new = 1.0 / var_tilted - tau_cavity;
+  if (!(tau_new > 0.0)) {
+    return false;
+  }
+  double nu_new = mean_tilted / var_tilted - nu_cavity;
+  tau = (1.0 - damping) * tau + damping * tau_new;
+  nu = (1.0 - damping) * nu + damping * nu_new;
+  return true;
+}
+
+#endif
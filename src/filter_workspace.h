@@ -0,0 +1,129 @@
+// reusable buffers for the temporaries of the particle filters
+
+#ifndef FILTER_WORKSPACE_H
+#define FILTER_WORKSPACE_H
+
+#include "bssm.h"
+
+// The workspace is owned by the model and sized at the start of each filter
+// call, which allocates memory only if the dimensions have changed.
+// The buffers are then reused at all time points instead of allocating
+// new temporaries for each time point and particle. As the models are copied
+// once per chain, the buffers also persist over the MCMC iterations.
+class filter_workspace {
+
+public:
+
+  filter_workspace() : n_alloc(0) {}
+
+  // uniform random numbers used in resampling
+  arma::vec r;
+  arma::vec normalized_weights;
+  // resampled particles
+  arma::mat alphatmp;
+  // means of the transition of the resampled particles
+  arma::mat state_mean;
+  // standard normal variates for the states and the disturbances
+  arma::mat um;
+  arma::mat uk;
+  // means and Cholesky factors of the proposals of EKF-based filter
+  arma::mat att;
+  arma::cube Ptt;
+  // normalizing constants of the proposals, and the precomputed factors and 
+  // constants of the transition densities when R depends on the state
+  arma::vec proposal_const;
+  std::vector<arma::mat> transition_Linv;
+  arma::vec transition_const;
+  // smoothed means, conditional covariances (Cholesky) and cross-covariances
+  // of the approximating model used in the psi-APF
+  arma::mat alphahat;
+  arma::cube Vt;
+  arma::cube Ct;
+  // smoothed states of the approximating model in the Laplace approximation
+  arma::mat smooth;
+  // observations minus the regression effects, prediction error variances, 
+  // Kalman gains, prediction errors, smoothing recursion and the predicted 
+  // covariance of the fast smoother of univariate linear-Gaussian models
+  arma::vec y_tmp;
+  arma::vec Ft;
+  arma::mat Kt;
+  arma::vec vt;
+  arma::mat rt;
+  arma::mat Pt;
+
+  // number of times memory has been allocated for the buffers, resizing 
+  // within the existing memory is not counted
+  unsigned int n_alloc;
+
+  void set_size(const unsigned int m, const unsigned int k,
+    const unsigned int nsim) {
+    resize(r, nsim);
+    resize(normalized_weights, nsim);
+    resize(alphatmp, m, nsim);
+    resize(state_mean, m, nsim);
+    resize(um, m, nsim);
+    resize(uk, k, nsim);
+  }
+
+  void set_ekf_size(const unsigned int m, const unsigned int nsim) {
+    resize(att, m, nsim);
+    resize(Ptt, m, m, nsim);
+    resize(proposal_const, nsim);
+    resize(transition_const, nsim);
+    if (transition_Linv.size() != nsim) {
+      transition_Linv.resize(nsim);
+      n_alloc++;
+    }
+  }
+
+  void set_psi_size(const unsigned int m, const unsigned int n) {
+    resize(alphahat, m, n + 1);
+    resize(Vt, m, m, n + 1);
+    resize(Ct, m, m, n + 1);
+  }
+
+  void set_smooth_size(const unsigned int m, const unsigned int n) {
+    resize(smooth, m, n + 1);
+  }
+
+  void set_fast_smoother_size(const unsigned int m, const unsigned int n) {
+    resize(y_tmp, n);
+    resize(Ft, n);
+    resize(Kt, m, n);
+    resize(vt, n);
+    resize(rt, m, n);
+    resize(Pt, m, m);
+  }
+
+private:
+
+  // Armadillo keeps the memory if the number of elements does not change, 
+  // and small objects use memory inside the object, so an allocation 
+  // is detected by the change of the memory address (the first sizing 
+  // is always counted)
+  void resize(arma::vec& x, const unsigned int n) {
+    if (x.n_elem != n) {
+      const double* mem = x.memptr();
+      x.set_size(n);
+      n_alloc += (x.memptr() != mem);
+    }
+  }
+  void resize(arma::mat& x, const unsigned int n_rows,
+    const unsigned int n_cols) {
+    if (x.n_rows != n_rows || x.n_cols != n_cols) {
+      const double* mem = x.memptr();
+      x.set_size(n_rows, n_cols);
+      n_alloc += (x.memptr() != mem);
+    }
+  }
+  void resize(arma::cube& x, const unsigned int n_rows,
+    const unsigned int n_cols, const unsigned int n_slices) {
+    if (x.n_rows != n_rows || x.n_cols != n_cols || x.n_slices != n_slices) {
+      const double* mem = x.memptr();
+      x.set_size(n_rows, n_cols, n_slices);
+      n_alloc += (x.memptr() != mem);
+    }
+  }
+};
+
+#endif
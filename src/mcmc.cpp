@@ -21,6 +21,9 @@
 
 #include "model_ssm_nlg.h"
 #include "model_ssm_sde.h"
+#include "model_ssm_msde.h"
+
+#include "parallel_chains.h"
 
 mcmc::mcmc(
   const unsigned int iter, 
@@ -36,6 +39,8 @@ mcmc::mcmc(
   n_samples(std::floor(double(iter - burnin) / double(thin))),
   n_par(S.n_rows),
   target_acceptance(target_acceptance), gamma(gamma), n_stored(0),
+  chain_betas(arma::ones(1)), swap_interval(0), chain_seed(1),
+  exchange(nullptr), chain_id(0), beta(1.0), prefetch(0),
   posterior_storage(arma::vec(n_samples)),
   theta_storage(arma::mat(n_par, n_samples)),
   count_storage(arma::uvec(n_samples, arma::fill::zeros)),
@@ -45,6 +50,37 @@ mcmc::mcmc(
   acceptance_rate(0.0), output_type(output_type) {
 }
 
+void mcmc::set_chains(const arma::vec& betas, const unsigned int swap_interval,
+  const unsigned int seed) {
+  
+  if (betas.n_elem == 0 || betas(0) != 1.0) {
+    Rcpp::stop("The first chain should have inverse temperature of one.");
+  }
+  bool tempering = arma::any(betas != 1.0);
+  if (tempering && swap_interval == 0) {
+    Rcpp::stop("Tempered chains need a positive swap interval.");
+  }
+  chain_betas = betas;
+  // swaps between untempered chains are not needed
+  this->swap_interval = tempering ? swap_interval : 0;
+  chain_seed = seed;
+}
+
+void mcmc::stop_chain(const std::string& msg) const {
+  if (exchange) {
+    throw std::runtime_error(msg);
+  }
+  Rcpp::stop(msg);
+}
+
+void mcmc::set_prefetch(const unsigned int n_threads) {
+#ifdef _OPENMP
+  prefetch = n_threads > 1 ? n_threads : 0;
+#else
+  prefetch = 0;
+#endif
+}
+
 
 void mcmc::trim_storage() {
   theta_storage.resize(n_par, n_stored);
@@ -62,28 +98,29 @@ template void mcmc::state_posterior(ssm_mlg model, const unsigned int n_threads)
 template <class T>
 void mcmc::state_posterior(T model, const unsigned int n_threads) {
   
+  // each sample has its own stream, so the results do not depend on n_threads
+  uint64_t key = draw_key(model.engine);
+  
   if(n_threads > 1) {
 #ifdef _OPENMP
 #pragma omp parallel num_threads(n_threads) default(shared) firstprivate(model)
 {
-  model.engine = sitmo::prng_engine(omp_get_thread_num() + 1);
-  unsigned int thread_size = unsigned(std::floor(double(n_stored) / n_threads));
-  unsigned int start = omp_get_thread_num() * thread_size;
-  unsigned int end = (omp_get_thread_num() + 1) * thread_size - 1;
-  if(omp_get_thread_num() == static_cast<int>(n_threads - 1)) {
-    end = n_stored - 1;
-  }
   
-  arma::mat theta_piece = theta_storage(arma::span::all, arma::span(start, end));
-  arma::cube alpha_piece = alpha_storage.slices(start, end);
-  state_sampler(model, theta_piece, alpha_piece);
-  alpha_storage.slices(start, end) = alpha_piece;
+#pragma omp for schedule(static)
+  for (unsigned int i = 0; i < n_stored; i++) {
+#pragma omp critical
+{
+  model.update_model(theta_storage.col(i));
+}
+    set_streams(model, key, chain_id, i);
+    alpha_storage.slice(i) = model.simulate_states(1).slice(0).t();
+  }
 }
 #else
-    state_sampler(model, theta_storage, alpha_storage);
+    state_sampler(model, theta_storage, alpha_storage, key);
 #endif
   } else {
-    state_sampler(model, theta_storage, alpha_storage);
+    state_sampler(model, theta_storage, alpha_storage, key);
   }
 }
 
@@ -122,16 +159,21 @@ void mcmc::state_summary(T model) {
   Vt += Valpha / sum_w; // Var[E(alpha)] + E[Var(alpha)]
 }
 
-template void mcmc::state_sampler(ssm_ulg model, const arma::mat& theta, arma::cube& alpha);
-template void mcmc::state_sampler(bsm_lg model, const arma::mat& theta, arma::cube& alpha);
-template void mcmc::state_sampler(ar1_lg model, const arma::mat& theta, arma::cube& alpha);
-template void mcmc::state_sampler(ssm_mlg model, const arma::mat& theta, arma::cube& alpha);
+template void mcmc::state_sampler(ssm_ulg model, const arma::mat& theta, 
+  arma::cube& alpha, const uint64_t key);
+template void mcmc::state_sampler(bsm_lg model, const arma::mat& theta, 
+  arma::cube& alpha, const uint64_t key);
+template void mcmc::state_sampler(ar1_lg model, const arma::mat& theta, 
+  arma::cube& alpha, const uint64_t key);
+template void mcmc::state_sampler(ssm_mlg model, const arma::mat& theta, 
+  arma::cube& alpha, const uint64_t key);
 template <class T>
 
-void mcmc::state_sampler(T model, const arma::mat& theta, arma::cube& alpha) {
+void mcmc::state_sampler(T model, const arma::mat& theta, arma::cube& alpha, 
+  const uint64_t key) {
   for (unsigned int i = 0; i < theta.n_cols; i++) {
-    //arma::vec theta_i = theta.col(i);
     model.update_model(theta.col(i));
+    set_streams(model, key, chain_id, i);
     alpha.slice(i) = model.simulate_states(1).slice(0).t();
   }
 }
@@ -148,16 +190,30 @@ template void mcmc::mcmc_gaussian(ssm_mlg model, const bool end_ram);
 
 template<class T>
 void mcmc::mcmc_gaussian(T model, const bool end_ram) {
+  
+  if (chain_betas.n_elem > 1 && !exchange) {
+    run_chains(*this, model, [&](mcmc& chain, T& chain_model) {
+      chain.mcmc_gaussian(chain_model, end_ram);
+    });
+    return;
+  }
+  
   arma::vec theta = model.theta;
+  double logprior;
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+{
   model.update_model(theta); // just in case
-  double logprior = model.log_prior_pdf(theta); 
+  logprior = model.log_prior_pdf(theta); 
+}
   double loglik = model.log_likelihood();
   
   if (!std::isfinite(logprior))
-    Rcpp::stop("Initial prior probability is not finite.");
+    stop_chain("Initial prior probability is not finite.");
   
   if (!std::isfinite(loglik))
-    Rcpp::stop("Initial log-likelihood is not finite.");
+    stop_chain("Initial log-likelihood is not finite.");
   
   std::normal_distribution<> normal(0.0, 1.0);
   std::uniform_real_distribution<> unif(0.0, 1.0);
@@ -167,8 +223,9 @@ void mcmc::mcmc_gaussian(T model, const bool end_ram) {
   unsigned int n_values = 0;
 
   for (unsigned int i = 1; i <= iter; i++) {
+    bool changed = false;
     
-    if (i % 16 == 0) {
+    if (!exchange && i % 16 == 0) {
       Rcpp::checkUserInterrupt();
     }
     
@@ -181,12 +238,19 @@ void mcmc::mcmc_gaussian(T model, const bool end_ram) {
     arma::vec theta_prop = theta + S * u;
     // compute prior
     double logprior_prop;
+    // needs critical as the prior might be an R function
+#ifdef _OPENMP
+#pragma omp critical
+#endif
     logprior_prop = model.log_prior_pdf(theta_prop); 
     
     if (logprior_prop > -std::numeric_limits<double>::infinity() && 
       !std::isnan(logprior_prop)) {
       
       // update model based on the proposal
+#ifdef _OPENMP
+#pragma omp critical
+#endif
       model.update_model(theta_prop);
       
       // compute log-likelihood with proposed theta
@@ -195,13 +259,13 @@ void mcmc::mcmc_gaussian(T model, const bool end_ram) {
       //compute the acceptance probability
       // use explicit min(...) as we need this value later
       acceptance_prob =
-        std::min(1.0, std::exp(loglik_prop - loglik + logprior_prop - logprior));
+        std::min(1.0, std::exp(beta * (loglik_prop - loglik) + logprior_prop - logprior));
       //accept
       if (unif(model.engine) < acceptance_prob) {
         if (i > burnin) {
           acceptance_rate++;
-          n_values++;
         }
+        changed = true;
         loglik = loglik_prop;
         logprior = logprior_prop;
         theta = theta_prop;
@@ -210,6 +274,26 @@ void mcmc::mcmc_gaussian(T model, const bool end_ram) {
       }
     } else acceptance_prob = 0.0;
     
+    // swap move between the tempered chains
+    if (exchange && swap_interval > 0 && i % swap_interval == 0) {
+      chain_state state;
+      state.theta = theta;
+      state.logprior = logprior;
+      state.loglik = loglik * arma::ones(1);
+      bool swapped;
+      if (!exchange->swap(chain_id, state, swapped)) break;
+      if (swapped) {
+        theta = state.theta;
+        logprior = state.logprior;
+        loglik = state.loglik(0);
+        changed = true;
+        new_value = true;
+      }
+    }
+    
+    // thinning counts the iterations where the state changed, by an 
+    // accepted proposal, a swap, or both
+    if (i > burnin && changed) n_values++;
     if (i > burnin && n_values % thin == 0) {
       //new block
       if (new_value) {
@@ -269,6 +353,11 @@ template void mcmc::pm_mcmc(ssm_sde model,
   const unsigned int nsim,
   const bool end_ram);
 
+template void mcmc::pm_mcmc(ssm_msde model,
+  const unsigned int method,
+  const unsigned int nsim,
+  const bool end_ram);
+
 template<class T>
 void mcmc::pm_mcmc(
     T model,
@@ -276,16 +365,29 @@ void mcmc::pm_mcmc(
     const unsigned int nsim,
     const bool end_ram) {
   
+  if (chain_betas.n_elem > 1 && !exchange) {
+    run_chains(*this, model, [&](mcmc& chain, T& chain_model) {
+      chain.pm_mcmc(chain_model, method, nsim, end_ram);
+    });
+    return;
+  }
+  
   unsigned int m = model.m;
   unsigned int n = model.n;
   
   // get the current values of theta
   arma::vec theta = model.theta;
+  double logprior;
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+{
   model.update_model(theta); // just in case
   // compute the log[p(theta)]
-  double logprior = model.log_prior_pdf(theta);
+  logprior = model.log_prior_pdf(theta);
+}
   if (!arma::is_finite(logprior)) {
-    Rcpp::stop("Initial prior probability is not finite.");
+    stop_chain("Initial prior probability is not finite.");
   }
   arma::cube alpha(m, n + 1, nsim);
   arma::mat weights(nsim, n + 1);
@@ -296,7 +398,7 @@ void mcmc::pm_mcmc(
   arma::vec ll = model.log_likelihood(method, nsim, alpha, weights, indices);
 
   if (!std::isfinite(ll(0)))
-    Rcpp::stop("Initial log-likelihood is not finite.");
+    stop_chain("Initial log-likelihood is not finite.");
   
   arma::mat alphahat_i(m, (output_type != 3) * n + 1);
   arma::cube Vt_i(m, m, (output_type != 3) * n + 1);
@@ -314,8 +416,9 @@ void mcmc::pm_mcmc(
   std::normal_distribution<> normal(0.0, 1.0);
   std::uniform_real_distribution<> unif(0.0, 1.0);
   for (unsigned int i = 1; i <= iter; i++) {
+    bool changed = false;
     
-    if (i % 16 == 0) {
+    if (!exchange && i % 16 == 0) {
       Rcpp::checkUserInterrupt();
     }
     
@@ -328,11 +431,19 @@ void mcmc::pm_mcmc(
     // propose new theta
     arma::vec theta_prop = theta + S * u;
     // compute prior
-    double logprior_prop = model.log_prior_pdf(theta_prop);
+    double logprior_prop;
+    // needs critical as the prior might be an R function
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    logprior_prop = model.log_prior_pdf(theta_prop);
 
     if (logprior_prop > -std::numeric_limits<double>::infinity() && !std::isnan(logprior_prop)) {
       
       // update parameters
+#ifdef _OPENMP
+#pragma omp critical
+#endif
       model.update_model(theta_prop);
       
       // compute the log-likelihood (unbiased and approximate)
@@ -340,19 +451,19 @@ void mcmc::pm_mcmc(
 
       //compute the acceptance probability for RAM using the approximate ll
       acceptance_prob = std::min(1.0, std::exp(
-        ll_prop(1) - ll(1) +
+        beta * (ll_prop(1) - ll(1)) +
           logprior_prop - logprior));
       
       //accept
-      double log_alpha = ll_prop(0) - ll(0) +
+      double log_alpha = beta * (ll_prop(0) - ll(0)) +
         logprior_prop - logprior;
       
       //accept
       if (log(unif(model.engine)) < log_alpha) {
         if (i > burnin) {
           acceptance_rate++;
-          n_values++;
         }
+        changed = true;
         if (output_type != 3) {
           sample_or_summarise(
             output_type == 1, method, alpha, weights.col(n), indices,
@@ -366,6 +477,29 @@ void mcmc::pm_mcmc(
       }
     } else acceptance_prob = 0.0;
     
+    // swap move between the tempered chains
+    if (exchange && swap_interval > 0 && i % swap_interval == 0) {
+      chain_state state;
+      state.theta = theta;
+      state.logprior = logprior;
+      state.loglik = ll;
+      state.alpha = sampled_alpha;
+      state.alphahat = alphahat_i;
+      state.Vt = Vt_i;
+      bool swapped;
+      if (!exchange->swap(chain_id, state, swapped)) break;
+      if (swapped) {
+        theta = state.theta;
+        logprior = state.logprior;
+        ll = state.loglik;
+        sampled_alpha = state.alpha;
+        alphahat_i = state.alphahat;
+        Vt_i = state.Vt;
+        changed = true;
+        new_value = true;
+      }
+    }
+    
     // note: thinning does not affect this
     if (i > burnin && output_type == 2) {
       arma::mat diff = alphahat_i - alphahat;
@@ -376,6 +510,9 @@ void mcmc::pm_mcmc(
       }
     }
     
+    // thinning counts the iterations where the state changed, by an 
+    // accepted proposal, a swap, or both
+    if (i > burnin && changed) n_values++;
     if (i > burnin && n_values % thin == 0) {
       //new block
       if (new_value) {
@@ -440,16 +577,29 @@ void mcmc::da_mcmc(T model,
   const unsigned int nsim,
   const bool end_ram) {
   
+  if (chain_betas.n_elem > 1 && !exchange) {
+    run_chains(*this, model, [&](mcmc& chain, T& chain_model) {
+      chain.da_mcmc(chain_model, method, nsim, end_ram);
+    });
+    return;
+  }
+  
   unsigned int m = model.m;
   unsigned int n = model.n;
   
   // get the current values of theta
   arma::vec theta = model.theta;
+  double logprior;
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+{
   model.update_model(theta); // just in case
   // compute the log[p(theta)]
-  double logprior = model.log_prior_pdf(theta);
+  logprior = model.log_prior_pdf(theta);
+}
   if (!arma::is_finite(logprior)) {
-    Rcpp::stop("Initial prior probability is not finite.");
+    stop_chain("Initial prior probability is not finite.");
   }
   arma::cube alpha(m, n + 1, nsim);
   arma::mat weights(nsim, n + 1);
@@ -460,7 +610,7 @@ void mcmc::da_mcmc(T model,
   arma::vec ll =
     model.log_likelihood(method, nsim, alpha, weights, indices);
   if (!std::isfinite(ll(0)))
-    Rcpp::stop("Initial log-likelihood is not finite.");
+    stop_chain("Initial log-likelihood is not finite.");
   
   arma::mat alphahat_i(m, (output_type != 3) * n + 1);
   arma::cube Vt_i(m, m, (output_type != 3) * n + 1);
@@ -478,60 +628,221 @@ void mcmc::da_mcmc(T model,
   unsigned int n_values = 0;
   std::normal_distribution<> normal(0.0, 1.0);
   std::uniform_real_distribution<> unif(0.0, 1.0);
+  
+  // Speculative evaluation of the first stage: once the adaptation of S has 
+  // ended, the proposals are drawn ahead assuming that the current ones are 
+  // rejected, and their approximate log-likelihoods are computed in parallel 
+  // (also while the unbiased estimate of an accepted proposal is computed). 
+  // When a proposal is finally accepted, the remaining ones are discarded.
+  // Each slot of the buffer has its own copy of the model.
+  bool speculate = prefetch > 1 && !exchange && end_ram && burnin < iter;
+  unsigned int n_spec = speculate ? prefetch : 1;
+  std::vector<T> spec_models;
+  sitmo::prng_engine spec_engine;
+  arma::mat spec_theta(n_par, n_spec);
+  arma::vec spec_logprior(n_spec);
+  arma::mat spec_unif(2, n_spec);
+  arma::vec spec_approx(n_spec);
+  arma::uvec spec_ready(n_spec, arma::fill::zeros);
+  // proposals spec_head, ..., spec_end - 1 are in slots i % n_spec
+  unsigned int spec_head = 0;
+  unsigned int spec_end = 0;
+  
+  // draw proposals from the current theta until spec_end == last
+  auto spec_draw = [&](const unsigned int last) {
+    for (; spec_end < last; spec_end++) {
+      unsigned int k = spec_end % n_spec;
+      arma::vec u(n_par);
+      for(unsigned int j = 0; j < n_par; j++) {
+        u(j) = normal(spec_engine);
+      }
+      spec_theta.col(k) = theta + S * u;
+      spec_unif(0, k) = unif(spec_engine);
+      spec_unif(1, k) = unif(spec_engine);
+      spec_logprior(k) = model.log_prior_pdf(spec_theta.col(k));
+      spec_ready(k) = 0;
+    }
+  };
+  // compute the approximate log-likelihoods of the pending proposals, and 
+  // the unbiased estimate of the proposal in slot filter_slot (if any)
+  auto spec_run = [&](const int filter_slot, arma::vec& ll_filter) {
+    std::vector<int> tasks;
+    if (filter_slot >= 0) tasks.push_back(-1);
+    for (unsigned int j = spec_head; j < spec_end; j++) {
+      if (!spec_ready(j % n_spec)) tasks.push_back(j % n_spec);
+    }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(n_spec) default(shared)
+#endif
+    for (unsigned int t = 0; t < tasks.size(); t++) {
+      if (tasks[t] < 0) {
+        ll_filter = spec_models[filter_slot].log_likelihood(method, nsim, 
+          alpha, weights, indices);
+      } else {
+        unsigned int k = tasks[t];
+        spec_approx(k) = -std::numeric_limits<double>::infinity();
+        if (spec_logprior(k) > -std::numeric_limits<double>::infinity() && 
+          !std::isnan(spec_logprior(k))) {
+          // nsim = 0 does not touch the simulation output
+          arma::cube alpha_k;
+          arma::mat weights_k;
+          arma::umat indices_k;
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+          spec_models[k].update_model(spec_theta.col(k));
+          spec_approx(k) = spec_models[k].log_likelihood(method, 0, 
+            alpha_k, weights_k, indices_k)(1);
+        }
+        spec_ready(k) = 1;
+      }
+    }
+  };
+  
   for (unsigned int i = 1; i <= iter; i++) {
+    bool changed = false;
     
-    if (i % 16 == 0) {
+    if (!exchange && i % 16 == 0) {
       Rcpp::checkUserInterrupt();
     }
     
-    // sample from standard normal distribution
+    // standard normal draws of the proposal, used also in RAM
     arma::vec u(n_par);
-    for(unsigned int j = 0; j < n_par; j++) {
-      u(j) = normal(model.engine);
-    }
     
-    // propose new theta
-    arma::vec theta_prop = theta + S * u;
-    // compute prior
-    double logprior_prop = model.log_prior_pdf(theta_prop);
+    if (speculate && i > burnin) {
+      
+      if (spec_models.empty()) {
+        // copies are made here as copying R objects is not thread safe
+        spec_models.assign(n_spec, model);
+        uint64_t spec_key = draw_key(model.engine);
+        spec_engine = stream_engine(spec_key, chain_id, n_spec);
+        for (unsigned int k = 0; k < n_spec; k++) {
+          set_streams(spec_models[k], spec_key, chain_id, k);
+        }
+      }
+      arma::vec ll_prop;
+      if (spec_head == spec_end || !spec_ready(spec_head % n_spec)) {
+        spec_draw(spec_head + n_spec);
+        spec_run(-1, ll_prop);
+      }
+      unsigned int k = spec_head % n_spec;
+      spec_head++;
+      double logprior_prop = spec_logprior(k);
+      
+      if (logprior_prop > -std::numeric_limits<double>::infinity() && !std::isnan(logprior_prop)) {
+        
+        acceptance_prob = std::min(1.0, std::exp(beta * (spec_approx(k) - ll(1)) +
+          logprior_prop - logprior));
+        
+        if (spec_unif(0, k) < acceptance_prob) {
+          
+          // slot k is kept free while its unbiased estimate is computed
+          spec_draw(spec_head + n_spec - 1);
+          spec_run(k, ll_prop);
+          
+          double log_alpha = beta * (ll_prop(0) + ll(1) - ll(0) - ll_prop(1));
+          
+          if (std::log(spec_unif(1, k)) < log_alpha) {
+            if (i > burnin) {
+              acceptance_rate++;
+            }
+            changed = true;
+            if (output_type != 3) {
+              sample_or_summarise(
+                output_type == 1, method, alpha, weights.col(n), indices,
+                sampled_alpha, alphahat_i, Vt_i, spec_models[k].engine);
+            }
+            ll = ll_prop;
+            logprior = logprior_prop;
+            theta = spec_theta.col(k);
+            new_value = true;
+            // the pending proposals assumed rejection
+            spec_head = spec_end;
+          }
+        }
+      } else acceptance_prob = 0.0;
+      
+    } else {
+      
+      // sample from standard normal distribution
+      for(unsigned int j = 0; j < n_par; j++) {
+        u(j) = normal(model.engine);
+      }
     
-    if (logprior_prop > -std::numeric_limits<double>::infinity() && !std::isnan(logprior_prop)) {
+      // propose new theta
+      arma::vec theta_prop = theta + S * u;
+      // compute prior
+      double logprior_prop;
+      // needs critical as the prior might be an R function
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      logprior_prop = model.log_prior_pdf(theta_prop);
+    
+      if (logprior_prop > -std::numeric_limits<double>::infinity() && !std::isnan(logprior_prop)) {
       
-      // update parameters
-      model.update_model(theta_prop);
-      // compute the approximate log-likelihood (nsim = 0)
-      arma::vec ll_prop = model.log_likelihood(method, 0, alpha, weights, indices);
+        // update parameters
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+        model.update_model(theta_prop);
+        // compute the approximate log-likelihood (nsim = 0)
+        arma::vec ll_prop = model.log_likelihood(method, 0, alpha, weights, indices);
       
-      // initial acceptance probability, also used in RAM
-      acceptance_prob = std::min(1.0, std::exp(ll_prop(1) - ll(1) +
-        logprior_prop - logprior));
-      // initial acceptance
-      if (unif(model.engine) < acceptance_prob) {
+        // initial acceptance probability, also used in RAM
+        acceptance_prob = std::min(1.0, std::exp(beta * (ll_prop(1) - ll(1)) +
+          logprior_prop - logprior));
+        // initial acceptance
+        if (unif(model.engine) < acceptance_prob) {
         
-        // compute the unbiased log-likelihood estimate
-        ll_prop = model.log_likelihood(method, nsim, alpha, weights, indices);
+          // compute the unbiased log-likelihood estimate
+          ll_prop = model.log_likelihood(method, nsim, alpha, weights, indices);
         
-        // second stage acceptance log-probability
-        double log_alpha = ll_prop(0) + ll(1) - ll(0) - ll_prop(1);
+          // second stage acceptance log-probability
+          double log_alpha = beta * (ll_prop(0) + ll(1) - ll(0) - ll_prop(1));
         
-        if (log(unif(model.engine)) < log_alpha) {
-          if (i > burnin) {
-            acceptance_rate++;
-            n_values++;
-          }
-          if (output_type != 3) {
-            sample_or_summarise(
-              output_type == 1, method, alpha, weights.col(n), indices,
-              sampled_alpha, alphahat_i, Vt_i, model.engine);
+          if (log(unif(model.engine)) < log_alpha) {
+            if (i > burnin) {
+              acceptance_rate++;
+            }
+            changed = true;
+            if (output_type != 3) {
+              sample_or_summarise(
+                output_type == 1, method, alpha, weights.col(n), indices,
+                sampled_alpha, alphahat_i, Vt_i, model.engine);
+            }
+            ll = ll_prop;
+            logprior = logprior_prop;
+            theta = theta_prop;
+            new_value = true;
           }
-          ll = ll_prop;
-          logprior = logprior_prop;
-          theta = theta_prop;
-          new_value = true;
-        }
         
+        }
+      } else acceptance_prob = 0.0;
+    }
+    
+    // swap move between the tempered chains
+    if (exchange && swap_interval > 0 && i % swap_interval == 0) {
+      chain_state state;
+      state.theta = theta;
+      state.logprior = logprior;
+      state.loglik = ll;
+      state.alpha = sampled_alpha;
+      state.alphahat = alphahat_i;
+      state.Vt = Vt_i;
+      bool swapped;
+      if (!exchange->swap(chain_id, state, swapped)) break;
+      if (swapped) {
+        theta = state.theta;
+        logprior = state.logprior;
+        ll = state.loglik;
+        sampled_alpha = state.alpha;
+        alphahat_i = state.alphahat;
+        Vt_i = state.Vt;
+        changed = true;
+        new_value = true;
       }
-    } else acceptance_prob = 0.0;
+    }
     
     // note: thinning does not affect this
     if (i > burnin && output_type == 2) {
@@ -543,6 +854,9 @@ void mcmc::da_mcmc(T model,
       }
     }
     
+    // thinning counts the iterations where the state changed, by an 
+    // accepted proposal, a swap, or both
+    if (i > burnin && changed) n_values++;
     if (i > burnin && n_values % thin == 0) {
       //new block
       if (new_value) {
@@ -570,8 +884,9 @@ void mcmc::da_mcmc(T model,
   acceptance_rate /= (iter - burnin);
 }
 
-template <>
-void mcmc::da_mcmc<ssm_sde>(ssm_sde model, const unsigned int method,
+// delayed acceptance for SDE models using the levels of the model
+template<class T>
+void mcmc::multilevel_da_mcmc(T model, const unsigned int method,
   const unsigned int nsim, const bool end_ram){
   
   // get the current values of theta
@@ -580,7 +895,7 @@ void mcmc::da_mcmc<ssm_sde>(ssm_sde model, const unsigned int method,
   // compute the log[p(theta)]
   double logprior = model.log_prior_pdf(theta);
   if (!arma::is_finite(logprior)) {
-    Rcpp::stop("Initial prior probability is not finite.");
+    stop_chain("Initial prior probability is not finite.");
   }
   
   unsigned int m = model.m;
@@ -590,11 +905,16 @@ void mcmc::da_mcmc<ssm_sde>(ssm_sde model, const unsigned int method,
   arma::mat weights(nsim, n + 1);
   arma::umat indices(nsim, n + 1);
   
-  double ll_c = model.bsf_filter(nsim, model.L_c, alpha, weights, indices);
-  double ll_f = model.bsf_filter(nsim, model.L_f, alpha, weights, indices);
+  // log-likelihood estimates from the coarsest to the finest level
+  unsigned int n_levels = model.levels.n_elem;
+  arma::vec ll(n_levels);
+  stage_acceptance_rate.zeros(n_levels);
+  for (unsigned int k = 0; k < n_levels; k++) {
+    ll(k) = model.bsf_filter(nsim, model.levels(k), alpha, weights, indices);
+  }
   
-  if (!std::isfinite(ll_f))
-    Rcpp::stop("Initial log-likelihood is not finite.");
+  if (!std::isfinite(ll(n_levels - 1)))
+    stop_chain("Initial log-likelihood is not finite.");
   
   arma::mat alphahat_i(m, (output_type != 3) * n + 1);
   arma::cube Vt_i(m, m, (output_type != 3) * n + 1);
@@ -633,21 +953,28 @@ void mcmc::da_mcmc<ssm_sde>(ssm_sde model, const unsigned int method,
       
       // update parameters
       model.update_model(theta_prop);
-      double ll_c_prop = model.bsf_filter(nsim, model.L_c, alpha, weights, indices);
+      arma::vec ll_prop(n_levels);
+      ll_prop(0) = model.bsf_filter(nsim, model.levels(0), alpha, weights, indices);
     
       // initial acceptance probability, also used in RAM
-      acceptance_prob = std::min(1.0, std::exp(ll_c_prop - ll_c +
+      acceptance_prob = std::min(1.0, std::exp(ll_prop(0) - ll(0) +
         logprior_prop - logprior));
       // initial acceptance
       if (unif(model.engine) < acceptance_prob) {
         
-        // compute the log-likelihood estimate using finer mesh
-        double ll_f_prop = model.bsf_filter(nsim, model.L_f, alpha, weights, indices);
-        
-        // second stage acceptance log-probability
-        double log_alpha = ll_f_prop + ll_c - ll_f - ll_c_prop;
+        if (i > burnin) stage_acceptance_rate(0)++;
+        // compute the log-likelihood estimates using finer meshes, 
+        // rejecting as soon as one of the stages rejects
+        bool accept = true;
+        for (unsigned int k = 1; k < n_levels && accept; k++) {
+          ll_prop(k) = model.bsf_filter(nsim, model.levels(k), alpha, weights, indices);
+          // acceptance log-probability of stage k
+          double log_alpha = ll_prop(k) + ll(k - 1) - ll(k) - ll_prop(k - 1);
+          accept = log(unif(model.engine)) < log_alpha;
+          if (accept && i > burnin) stage_acceptance_rate(k)++;
+        }
         
-        if (log(unif(model.engine)) < log_alpha) {
+        if (accept) {
           if (i > burnin) {
             acceptance_rate++;
             n_values++;
@@ -657,8 +984,7 @@ void mcmc::da_mcmc<ssm_sde>(ssm_sde model, const unsigned int method,
               output_type == 1, method, alpha, weights.col(n), indices,
               sampled_alpha, alphahat_i, Vt_i, model.engine);
           }
-          ll_f = ll_f_prop;
-          ll_c = ll_c_prop;
+          ll = ll_prop;
           logprior = logprior_prop;
           theta = theta_prop;
           new_value = true;
@@ -680,7 +1006,7 @@ void mcmc::da_mcmc<ssm_sde>(ssm_sde model, const unsigned int method,
     if (i > burnin && n_values % thin == 0) {
       //new block
       if (new_value) {
-        posterior_storage(n_stored) = logprior + ll_f;
+        posterior_storage(n_stored) = logprior + ll(n_levels - 1);
         theta_storage.col(n_stored) = theta;
         count_storage(n_stored) = 1;
         if (output_type == 1) {
@@ -702,4 +1028,17 @@ void mcmc::da_mcmc<ssm_sde>(ssm_sde model, const unsigned int method,
   }
   trim_storage();
   acceptance_rate /= (iter - burnin);
+  stage_acceptance_rate /= (iter - burnin);
+}
+
+template <>
+void mcmc::da_mcmc<ssm_sde>(ssm_sde model, const unsigned int method,
+  const unsigned int nsim, const bool end_ram){
+  multilevel_da_mcmc(model, method, nsim, end_ram);
+}
+
+template <>
+void mcmc::da_mcmc<ssm_msde>(ssm_msde model, const unsigned int method,
+  const unsigned int nsim, const bool end_ram){
+  multilevel_da_mcmc(model, method, nsim, end_ram);
 }
@@ -3,12 +3,25 @@
 
 #include "bssm.h"
 
+class chain_exchange;
+
 class mcmc {
   
 protected:
   
   virtual void trim_storage();
   
+  // run the chains in parallel using the given sampler and merge the results
+  template <class M, class T, class F>
+  void run_chains(M& main_chain, const T& model, F sampler);
+  template <class M>
+  void merge_chains(const std::vector<M>& chains, const bool tempered);
+  
+  // delayed acceptance of SDE models with multiple discretization levels
+  template<class T>
+  void multilevel_da_mcmc(T model, const unsigned int method, 
+    const unsigned int nsim, const bool end_ram);
+  
   const unsigned int iter;
   const unsigned int burnin;
   const unsigned int thin;
@@ -18,6 +31,24 @@ protected:
   const double gamma;
   unsigned int n_stored;
   
+  // settings for multiple chains
+  arma::vec chain_betas;
+  unsigned int swap_interval;
+  unsigned int chain_seed;
+  // non-null when this is one of the parallel chains
+  chain_exchange* exchange;
+  unsigned int chain_id;
+  // inverse temperature of this chain
+  double beta;
+  // number of proposals whose approximate log-likelihoods are evaluated
+  // ahead in delayed acceptance
+  unsigned int prefetch;
+  
+  // Rcpp::stop is not safe on the worker threads of the parallel chains, so
+  // there the error is thrown as a C++ exception which run_chains catches and
+  // passes to R after the parallel region
+  void stop_chain(const std::string& msg) const;
+  
 public:
   
   // constructor
@@ -25,6 +56,15 @@ public:
     const unsigned int thin, const unsigned int n, const unsigned int m,
     const double target_acceptance, const double gamma, const arma::mat& S, 
     const unsigned int output_type = 1);
+  
+  // run multiple chains in parallel with inverse temperatures betas,
+  // swaps between the chains are proposed every swap_interval iterations
+  void set_chains(const arma::vec& betas, const unsigned int swap_interval,
+    const unsigned int seed);
+  
+  // evaluate the approximate log-likelihoods of the upcoming proposals of
+  // delayed acceptance in parallel using n_threads threads (0 or 1 disables)
+  void set_prefetch(const unsigned int n_threads);
 
   // sample states given theta
   template <class T>
@@ -32,7 +72,8 @@ public:
   template <class T>
   void state_summary(T model);
   template <class T>
-  void state_sampler(T model, const arma::mat& theta, arma::cube& alpha);
+  void state_sampler(T model, const arma::mat& theta, arma::cube& alpha,
+    const uint64_t key);
 
   // gaussian mcmc
   template<class T>
@@ -55,6 +96,14 @@ public:
   arma::mat S;
   double acceptance_rate;
   unsigned int output_type;
+  // acceptance rates of the stages of multilevel delayed acceptance,
+  // element k is the proportion of proposals which passed stages 0, ..., k
+  arma::vec stage_acceptance_rate;
+  
+  // diagnostics of multiple chains
+  arma::uvec chain_storage;
+  arma::vec chain_acceptance_rate;
+  arma::vec swap_rate;
   
 };
 
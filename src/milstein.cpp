@@ -40,67 +40,125 @@ double milstein_worker(double x, arma::vec& dB, double dt, unsigned int n,
   fnPtr ddiffusion, bool positive) {
 
   for(unsigned int k = 0; k < n; k++) {
-    x += drift(x, theta) * dt + diffusion(x, theta) * dB(k) +
-      0.5 * diffusion(x, theta) * ddiffusion(x, theta) * (dB(k) * dB(k) - dt);
+    double sigma = diffusion(x, theta);
+    x += drift(x, theta) * dt + sigma * dB(k) +
+      0.5 * sigma * ddiffusion(x, theta) * (dB(k) * dB(k) - dt);
     if(positive) x = std::abs(x);
   }
   return x;
 }
 
-
-// Simulate a realisation of the differences of a Brownian bridge on [0,t] with a
-// uniform mesh of n points
-arma::vec brownian_bridge(const double t, const double sd, const unsigned int n,
-  const double X_t, sitmo::prng_engine& eng) {
-
+// Milstein discretisations of [0,t] using 2^L levels for all particles x,
+// which are replaced by the terminal values. All particles are advanced
+// one step at a time so no temporary storage for the increments is needed.
+// If coef_batch is given, the coefficients of all particles are computed 
+// with one call per step. The increments are drawn in the same order in 
+// both cases, so the results do not depend on whether coef_batch is used.
+void milstein_batch(arma::vec& x, const unsigned int L, const double t,
+  const arma::vec& theta,
+  fnPtr drift, fnPtr diffusion, fnPtr ddiffusion,
+  bool positive, sitmo::prng_engine& eng, coef_batch_fnPtr coef_batch) {
+  
+  unsigned int n = std::pow(2, L);
   double dt = t / n;
-  arma::vec dB(n);
-  std::normal_distribution<> normal(0.0, sd);
-
-  for (unsigned int i = 0; i < n; i++){
-    dB(i) = normal(eng);
+  std::normal_distribution<> normal(0.0, std::sqrt(dt));
+  
+  if (coef_batch) {
+    unsigned int nsim = x.n_elem;
+    arma::vec dB(nsim);
+    arma::vec mu(nsim);
+    arma::vec sigma(nsim);
+    arma::vec dsigma(nsim);
+    for (unsigned int k = 0; k < n; k++) {
+      for (unsigned int i = 0; i < nsim; i++) {
+        dB(i) = normal(eng);
+      }
+      coef_batch(x, theta, mu, sigma, dsigma);
+      x += mu * dt + sigma % dB + 0.5 * sigma % dsigma % (dB % dB - dt);
+      if(positive) x = arma::abs(x);
+    }
+  } else {
+    for (unsigned int k = 0; k < n; k++) {
+      for (unsigned int i = 0; i < x.n_elem; i++) {
+        double dB = normal(eng);
+        double sigma = diffusion(x(i), theta);
+        x(i) += drift(x(i), theta) * dt + sigma * dB +
+          0.5 * sigma * ddiffusion(x(i), theta) * (dB * dB - dt);
+        if(positive) x(i) = std::abs(x(i));
+      }
+    }
   }
+}
+
 
-  double B_t = arma::accu(dB);
-  return(dB - dt / t * (B_t - X_t));
+// Brownian increments of [0,t] on a mesh of 2^L points for the given particle 
+// and time step, using Levy's construction: the increment of the whole interval 
+// is halved L times by simulating the midpoints of the Brownian bridges. 
+// The normal variate of the kth midpoint at level l is drawn from the 
+// counter-based engine keyed by (key, particle, step) with the counter set to 
+// (l, k), so the increments do not depend on the order of the computations and 
+// the increments of the coarser meshes are obtained as sums of the finer ones.
+void levy_increments(const unsigned int L, const double t, 
+  const uint64_t key, const uint64_t particle, const uint64_t step,
+  arma::vec& dB) {
+  
+  sitmo::prng_engine eng;
+  eng.set_key(key, particle, step, 0);
+  std::normal_distribution<> normal(0.0, 1.0);
+  auto draw = [&](const unsigned int l, const unsigned int k) {
+    eng.set_counter(0, l, k, 0);
+    normal.reset();
+    return normal(eng);
+  };
+  
+  unsigned int n = std::pow(2, L);
+  dB.set_size(n);
+  double dt = t;
+  dB(0) = std::sqrt(dt) * draw(0, 0);
+  for (unsigned int l = 1; l <= L; l++) {
+    // split each increment D into D/2 + z and D/2 - z with z ~ N(0, dt/4),
+    // backwards so that the unsplit increments are not overwritten
+    for (unsigned int k = std::pow(2, l - 1); k-- > 0;) {
+      double D = dB(k);
+      double z = 0.5 * std::sqrt(dt) * draw(l, k);
+      dB(2 * k) = 0.5 * D + z;
+      dB(2 * k + 1) = 0.5 * D - z;
+    }
+    dt /= 2;
+  }
 }
 
-// Milstein scheme using coarse mesh filled with Brownian bridge
-// At the start of the joint filtering, the coarse engine eng_c
-// should be restarted with the original seed used in coarce filter
-// in essense we end up simulating lot's of extra increments (2^L_c) but
-// we save even more (?) in memory as we don't need to store all the increments
+// Brownian increments of [0,t] on the coarse (2^L_c) and fine (2^L_f) meshes, 
+// where the coarse increments are the sums of the fine ones
+void joint_increments(const unsigned int L_c, const unsigned int L_f, 
+  const double t, const uint64_t key, const uint64_t particle, 
+  const uint64_t step, arma::vec& dB_c, arma::vec& dB_f) {
+  
+  levy_increments(L_f, t, key, particle, step, dB_f);
+  unsigned int n_d = std::pow(2, L_f - L_c);
+  dB_c = arma::sum(arma::reshape(dB_f, n_d, dB_f.n_elem / n_d), 0).t();
+}
 
-// note that this approach does not work with thinning and/or parallelisation
-// in those cases we need to discard some states in the engine...
-double milstein_joint(const double x0,
+// Coupled Milstein discretisations of [0,t] on the coarse and fine meshes 
+// driven by the same Brownian path, x_c and x_f are the starting points 
+// and are replaced by the terminal values. 
+// As the path is defined by (key, particle, step), the particles can be 
+// propagated in any order, or the same path regenerated later.
+void milstein_joint(double& x_c, double& x_f,
   const unsigned int L_c, const unsigned int L_f, const double t,
   const arma::vec& theta,
   fnPtr drift, fnPtr diffusion, fnPtr ddiffusion,
-  bool positive, sitmo::prng_engine& eng_c, sitmo::prng_engine& eng_f) {
-
+  bool positive, const uint64_t key, const uint64_t particle, 
+  const uint64_t step) {
+  
+  arma::vec dB_c;
+  arma::vec dB_f;
+  joint_increments(L_c, L_f, t, key, particle, step, dB_c, dB_f);
+  
   unsigned int n_c = std::pow(2, L_c);
-  double dt_c = t / n_c;
   unsigned int n_f = std::pow(2, L_f);
-  double dt_f = t / n_f;
-  unsigned int n_d = std::pow(2, L_f - L_c);
-
-  // Coarse-level path, with fixed seed
-
-  std::normal_distribution<> normal(0.0, std::sqrt(dt_c));
-  arma::vec dB_c(n_c);
-  for (unsigned int i = 0; i < n_c; i++){
-    dB_c(i) = normal(eng_c);
-  }
-
-  // fine-level path, independent engine
-  arma::mat dB_f_(n_d, n_c);
-  for (unsigned int k = 0; k < n_c; k++){
-    dB_f_.col(k) = brownian_bridge(dt_c, dt_f, n_d, dB_c(k), eng_f);
-  }
-  arma::vec dB_f = arma::vectorise(dB_f_);
-
-  // Calculate the actual path of the finer mesh:
-  return milstein_worker(x0, dB_f, dt_f, n_f,
+  x_c = milstein_worker(x_c, dB_c, t / n_c, n_c,
+    theta, drift, diffusion, ddiffusion, positive);
+  x_f = milstein_worker(x_f, dB_f, t / n_f, n_f,
     theta, drift, diffusion, ddiffusion, positive);
 }
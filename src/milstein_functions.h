@@ -6,6 +6,11 @@
 
 // typedef for a pointer of drift/diffusion functions
 typedef double (*fnPtr)(const double x, const arma::vec&);
+// typedef for a pointer of function which evaluates the drift, diffusion and 
+// derivative of diffusion at all particles x at once, writing the results to 
+// the preallocated vectors drift, diffusion and ddiffusion
+typedef void (*coef_batch_fnPtr)(const arma::vec& x, const arma::vec& theta, 
+  arma::vec& drift, arma::vec& diffusion, arma::vec& ddiffusion);
 
 // Functions for the Milstein scheme
 
@@ -27,19 +32,35 @@ double milstein(const double x0, const unsigned int L, const double t,
   fnPtr drift, fnPtr diffusion, fnPtr ddiffusion,
   bool positive, sitmo::prng_engine& eng);
 
+// Milstein discretisations of all particles x, advanced one step at a time,
+// coef_batch is used for the coefficients if not null
+void milstein_batch(arma::vec& x, const unsigned int L, const double t,
+  const arma::vec& theta,
+  fnPtr drift, fnPtr diffusion, fnPtr ddiffusion,
+  bool positive, sitmo::prng_engine& eng, 
+  coef_batch_fnPtr coef_batch = nullptr);
+
 // A worker which uses simulated Brownian differences
 double milstein_worker(double x, arma::vec& dB, double dt, unsigned int n,
   const arma::vec& theta, fnPtr drift, fnPtr diffusion,
   fnPtr ddiffusion, bool positive);
 
-arma::vec brownian_bridge(const double t, const double sd, const unsigned int n,
-  const double X_t, sitmo::prng_engine& eng);
+// Brownian increments on the mesh of 2^L points defined by a counter-based engine
+void levy_increments(const unsigned int L, const double t, 
+  const uint64_t key, const uint64_t particle, const uint64_t step,
+  arma::vec& dB);
+
+void joint_increments(const unsigned int L_c, const unsigned int L_f, 
+  const double t, const uint64_t key, const uint64_t particle, 
+  const uint64_t step, arma::vec& dB_c, arma::vec& dB_f);
 
-double milstein_joint(const double x0,
+// Coupled coarse and fine discretisations using the same Brownian path
+void milstein_joint(double& x_c, double& x_f,
   const unsigned int L_c, const unsigned int L_f, const double t,
   const arma::vec& theta,
   fnPtr drift, fnPtr diffusion, fnPtr ddiffusion,
-  bool positive, sitmo::prng_engine& eng_c, sitmo::prng_engine& eng_f);
+  bool positive, const uint64_t key, const uint64_t particle, 
+  const uint64_t step);
 
 
 #endif
@@ -0,0 +1,24 @@
+#include "missing_pattern.h"
+#include <map>
+
+missing_pattern::missing_pattern(const arma::mat& y) : id(y.n_cols) {
+
+  std::map<std::vector<bool>, unsigned int> patterns;
+  std::vector<bool> is_na(y.n_rows);
+
+  for (unsigned int t = 0; t < y.n_cols; t++) {
+    for (unsigned int i = 0; i < y.n_rows; i++) {
+      is_na[i] = !arma::is_finite(y(i, t));
+    }
+    std::map<std::vector<bool>, unsigned int>::iterator it =
+      patterns.find(is_na);
+    if (it == patterns.end()) {
+      id(t) = obs.size();
+      patterns.insert(std::make_pair(is_na, id(t)));
+      obs.push_back(arma::find_finite(y.col(t)));
+      na.push_back(arma::find_nonfinite(y.col(t)));
+    } else {
+      id(t) = it->second;
+    }
+  }
+}
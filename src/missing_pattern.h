@@ -0,0 +1,41 @@
+// index of the missingness patterns of the observations
+
+#ifndef MISSING_PATTERN_H
+#define MISSING_PATTERN_H
+
+#include "bssm.h"
+
+// The observations do not change during the MCMC, so the indices of the
+// missing and observed series are computed once when the model is built
+// instead of calling find_nonfinite at each time point of each filter call.
+// Time points with the same missingness pattern share the index vectors, so
+// quantities depending only on the pattern can be cached per pattern.
+class missing_pattern {
+
+public:
+
+  missing_pattern() {}
+  // y is p x n matrix of observations
+  missing_pattern(const arma::mat& y);
+
+  // pattern of each time point
+  arma::uvec id;
+  // indices of the observed and missing series of each pattern
+  std::vector<arma::uvec> obs;
+  std::vector<arma::uvec> na;
+
+  unsigned int n_patterns() const { return obs.size(); }
+
+  const arma::uvec& observed(const unsigned int t) const { return obs[id(t)]; }
+  const arma::uvec& missing(const unsigned int t) const { return na[id(t)]; }
+  // is some series observed at time t
+  bool any_observed(const unsigned int t) const {
+    return obs[id(t)].n_elem > 0;
+  }
+  // is some series missing at time t
+  bool any_missing(const unsigned int t) const {
+    return na[id(t)].n_elem > 0;
+  }
+};
+
+#endif
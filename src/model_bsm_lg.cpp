@@ -16,6 +16,7 @@ bsm_lg::bsm_lg(const Rcpp::List model, const unsigned int seed) :
   seasonal_est(seasonal && fixed(3) == 0)
   {
   
+  set_bsm_transition(slope, seasonal, false);
 }
 
 // update the model given theta
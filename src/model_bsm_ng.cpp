@@ -11,6 +11,7 @@ bsm_ng::bsm_ng(const Rcpp::List model, const unsigned int seed) :
   fixed(Rcpp::as<arma::uvec>(model["fixed"])), level_est(fixed(0) == 0),
   slope_est(slope && fixed(1) == 0), seasonal_est(seasonal && fixed(2) == 0),
   phi_est(Rcpp::as<bool>(model["phi_est"])) {
+  approx_model.set_bsm_transition(slope, seasonal, noise);
 }
 
 void bsm_ng::update_model(const arma::vec& new_theta) {
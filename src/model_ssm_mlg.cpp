@@ -1,6 +1,8 @@
 #include "model_ssm_mlg.h"
 #include "psd_chol.h"
+#include "rnorm.h"
 #include "conditional_dist.h"
+#include "dmvnorm.h"
 
 // General constructor of ssm_mlg object from Rcpp::List
 ssm_mlg::ssm_mlg(
@@ -8,7 +10,7 @@ ssm_mlg::ssm_mlg(
   const unsigned int seed,
   const double zero_tol) 
   :
-    y((Rcpp::as<arma::mat>(model["y"])).t()), Z(Rcpp::as<arma::cube>(model["Z"])),
+    y((Rcpp::as<arma::mat>(model["y"])).t()), y_pattern(y), Z(Rcpp::as<arma::cube>(model["Z"])),
     H(Rcpp::as<arma::cube>(model["H"])), T(Rcpp::as<arma::cube>(model["T"])),
     R(Rcpp::as<arma::cube>(model["R"])), a1(Rcpp::as<arma::vec>(model["a1"])),
     P1(Rcpp::as<arma::mat>(model["P1"])), D(Rcpp::as<arma::mat>(model["D"])),
@@ -19,6 +21,7 @@ ssm_mlg::ssm_mlg(
     theta(Rcpp::as<arma::vec>(model["theta"])), 
     engine(seed), zero_tol(zero_tol),
     HH(arma::cube(p, p, Htv * (n - 1) + 1)), RR(arma::cube(m, m, Rtv * (n - 1) + 1)),
+    cache_obs_density(false),
     update_fn(Rcpp::as<Rcpp::Function>(model["update_fn"])), 
     prior_fn(Rcpp::as<Rcpp::Function>(model["prior_fn"])) {
   
@@ -38,7 +41,7 @@ ssm_mlg::ssm_mlg(const arma::mat& y, const arma::cube& Z,
   const Rcpp::Function prior_fn,
   const double zero_tol) 
   :
-    y(y), Z(Z), H(H), T(T), R(R), a1(a1), P1(P1), D(D), C(C),
+    y(y), y_pattern(y), Z(Z), H(H), T(T), R(R), a1(a1), P1(P1), D(D), C(C),
     n(y.n_cols), m(a1.n_elem), k(R.n_cols), p(y.n_rows),
     Ztv(Z.n_slices > 1), Htv(H.n_slices > 1), 
     Ttv(T.n_slices > 1), Rtv(R.n_slices > 1),
@@ -46,6 +49,7 @@ ssm_mlg::ssm_mlg(const arma::mat& y, const arma::cube& Z,
     theta(theta), engine(seed), zero_tol(zero_tol), 
     HH(arma::cube(p, p, Htv * (n - 1) + 1)), 
     RR(arma::cube(m, m, Rtv * (n - 1) + 1)),
+    cache_obs_density(false),
     update_fn(update_fn), prior_fn(prior_fn) {
   
   compute_HH();
@@ -87,6 +91,89 @@ void ssm_mlg::update_model(const arma::vec& new_theta) {
   theta = new_theta;
 }
 
+void ssm_mlg::compute_HH_patterns() {
+  
+  if (Htv == 1) return;
+  
+  unsigned int n_patterns = y_pattern.n_patterns();
+  HH_observed.resize(n_patterns);
+  HH_masked.resize(n_patterns);
+  
+  if (cache_obs_density) {
+    obs_Linv.resize(n_patterns);
+    obs_index.resize(n_patterns);
+    obs_constant.set_size(n_patterns);
+  }
+  // HH is uninitialized before the first approximation of non-Gaussian models
+  bool finite_H = H.is_finite();
+  
+  for (unsigned int j = 0; j < n_patterns; j++) {
+    const arma::uvec& obs_y = y_pattern.obs[j];
+    const arma::uvec& na_y = y_pattern.na[j];
+    if (obs_y.n_elem == 0) continue;
+    
+    HH_observed[j] = HH.slice(0).submat(obs_y, obs_y);
+    HH_masked[j] = HH.slice(0);
+    if (na_y.n_elem > 0) {
+      HH_masked[j].rows(na_y).zeros();
+      HH_masked[j].cols(na_y).zeros();
+      HH_masked[j].submat(na_y, na_y) = arma::eye(na_y.n_elem, na_y.n_elem);
+    }
+    if (cache_obs_density) {
+      if (finite_H) {
+        obs_constant(j) = 
+          precompute_dmvnorm_obs(H.slice(0), obs_y, obs_Linv[j], obs_index[j]);
+      } else {
+        obs_Linv[j].zeros(0, obs_y.n_elem);
+        obs_index[j] = obs_y;
+        obs_constant(j) = -std::numeric_limits<double>::infinity();
+      }
+    }
+  }
+}
+
+const arma::mat& ssm_mlg::masked_Z(const unsigned int t, 
+  arma::mat& buffer) const {
+  
+  const arma::uvec& na_y = y_pattern.missing(t);
+  if (na_y.n_elem == 0) return Z.slice(t * Ztv);
+  buffer = Z.slice(t * Ztv);
+  buffer.rows(na_y).zeros();
+  return buffer;
+}
+
+const arma::mat& ssm_mlg::masked_HH(const unsigned int t, 
+  arma::mat& buffer) const {
+  
+  if (Htv == 0) return HH_masked[y_pattern.id(t)];
+  
+  const arma::uvec& na_y = y_pattern.missing(t);
+  if (na_y.n_elem == 0) return HH.slice(t);
+  buffer = HH.slice(t);
+  buffer.rows(na_y).zeros();
+  buffer.cols(na_y).zeros();
+  buffer.submat(na_y, na_y) = arma::eye(na_y.n_elem, na_y.n_elem);
+  return buffer;
+}
+
+const arma::mat& ssm_mlg::observed_HH(const unsigned int t, 
+  arma::mat& buffer) const {
+  
+  if (Htv == 0) return HH_observed[y_pattern.id(t)];
+  
+  const arma::uvec& obs_y = y_pattern.observed(t);
+  if (obs_y.n_elem == p) return HH.slice(t);
+  buffer = HH.slice(t).submat(obs_y, obs_y);
+  return buffer;
+}
+
+double ssm_mlg::cached_obs_density(const unsigned int t, const arma::vec& x, 
+  const arma::vec& mean) const {
+  
+  unsigned int j = y_pattern.id(t);
+  return fast_dmvnorm(x, mean, obs_Linv[j], obs_index[j], obs_constant(j));
+}
+
 double ssm_mlg::log_prior_pdf(const arma::vec& x) const {
   
   return Rcpp::as<double>(prior_fn(Rcpp::NumericVector(x.begin(), x.end())));
@@ -103,14 +190,17 @@ double ssm_mlg::log_likelihood() const {
     
     const double LOG2PI = std::log(2.0 * M_PI);
     
+    // buffer for HH in case of missing observations
+    arma::mat HHt_tmp;
     for (unsigned int t = 0; t < n; t++) {
-      arma::uvec obs_y = arma::find_finite(y.col(t));
+      const arma::uvec& obs_y = y_pattern.observed(t);
       
       if (obs_y.n_elem > 0) {
         
         arma::mat Zt = Z.slice(t * Ztv).rows(obs_y);
+        const arma::mat& HHt = observed_HH(t, HHt_tmp);
         
-        arma::mat F = Zt * Pt * Zt.t() + HH.slice(t * Htv).submat(obs_y, obs_y);
+        arma::mat F = Zt * Pt * Zt.t() + HHt;
         // first check to avoid armadillo warnings
         bool chol_ok = F.is_finite();
         if (!chol_ok) return -std::numeric_limits<double>::infinity();
@@ -125,7 +215,7 @@ double ssm_mlg::log_likelihood() const {
         at = C.col(t * Ctv) + T.slice(t * Ttv) * (at + K * v);
         
         arma::mat IKZ = arma::eye(m, m) - K * Zt;
-        Pt = arma::symmatu(T.slice(t * Ttv) * (IKZ * Pt * IKZ.t() + K * HH.slice(t * Htv).submat(obs_y, obs_y) * K.t()) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
+        Pt = arma::symmatu(T.slice(t * Ttv) * (IKZ * Pt * IKZ.t() + K * HHt * K.t()) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
         
         arma::vec Fv = inv_cholF.t() * v;
         logLik -= 0.5 * arma::as_scalar(obs_y.n_elem * LOG2PI +
@@ -151,18 +241,15 @@ void ssm_mlg::smoother(arma::mat& at, arma::cube& Pt) const {
   arma::mat vt(p, n, arma::fill::zeros);
   arma::cube ZFinv(m, p, n, arma::fill::zeros);
   arma::cube Kt(m, p, n, arma::fill::zeros);
+  // buffers for Z and HH in case of missing observations
+  arma::mat Zt_tmp;
+  arma::mat HHt_tmp;
   
   for (unsigned int t = 0; t < n; t++) {
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
+    const arma::uvec& na_y = y_pattern.missing(t);
     if (na_y.n_elem < p) {
-      arma::mat Zt = Z.slice(t * Ztv);
-      arma::mat HHt = HH.slice(t * Htv);
-      if (na_y.n_elem > 0) {
-        Zt.rows(na_y).zeros();
-        HHt.rows(na_y).zeros();
-        HHt.cols(na_y).zeros();
-        HHt.submat(na_y, na_y) = arma::eye(na_y.n_elem, na_y.n_elem);
-      }
+      const arma::mat& Zt = masked_Z(t, Zt_tmp);
+      const arma::mat& HHt = masked_HH(t, HHt_tmp);
       arma::mat Ft = Zt * Pt.slice(t) * Zt.t() + HHt;
       // first check to avoid armadillo warnings
       bool chol_ok = Ft.is_finite() && arma::all(Ft.diag() > 0);
@@ -200,11 +287,8 @@ void ssm_mlg::smoother(arma::mat& at, arma::cube& Pt) const {
   arma::mat Nt(m, m, arma::fill::zeros);
   
   for (int t = (n - 1); t >= 0; t--) {
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
-    
-    if (na_y.n_elem < p) {
-      arma::mat Zt = Z.slice(t * Ztv);
-      Zt.rows(na_y).zeros();
+    if (y_pattern.any_observed(t)) {
+      const arma::mat& Zt = masked_Z(t, Zt_tmp);
       arma::mat L = T.slice(t * Ttv) * (arma::eye(m, m) -
         Kt.slice(t) * Zt);
       rt = ZFinv.slice(t) * vt.col(t) + L.t() * rt;
@@ -225,6 +309,12 @@ void ssm_mlg::smoother(arma::mat& at, arma::cube& Pt) const {
 arma::mat ssm_mlg::fast_smoother() const {
   
   arma::mat at(m, n + 1);
+  fast_smoother(at);
+  return at;
+}
+
+void ssm_mlg::fast_smoother(arma::mat& at) const {
+  
   arma::mat Pt(m, m);
   
   at.col(0) = a1;
@@ -233,32 +323,29 @@ arma::mat ssm_mlg::fast_smoother() const {
   arma::mat vt(p, n, arma::fill::zeros);
   arma::cube ZFinv(m, p, n, arma::fill::zeros);
   arma::cube Kt(m, p, n, arma::fill::zeros);
+  // buffers for Z and HH in case of missing observations
+  arma::mat Zt_tmp;
+  arma::mat HHt_tmp;
   
   for (unsigned int t = 0; t < n; t++) {
     
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
+    const arma::uvec& na_y = y_pattern.missing(t);
     
     if (na_y.n_elem < p) {
       
-      arma::mat Zt = Z.slice(t * Ztv);
-      arma::mat HHt = HH.slice(t * Htv);
-      if (na_y.n_elem > 0) {
-        Zt.rows(na_y).zeros();
-        HHt.rows(na_y).zeros();
-        HHt.cols(na_y).zeros();
-        HHt.submat(na_y, na_y) = arma::eye(na_y.n_elem, na_y.n_elem);
-      }
+      const arma::mat& Zt = masked_Z(t, Zt_tmp);
+      const arma::mat& HHt = masked_HH(t, HHt_tmp);
       arma::mat Ft = Zt * Pt * Zt.t() + HHt;
       bool chol_ok = Ft.is_finite() && arma::all(Ft.diag() > 0);
       if (!chol_ok) {
         at.fill(-std::numeric_limits<double>::infinity());
-        return at;
+        return;
       }
       arma::mat cholF(p, p);
       chol_ok = arma::chol(cholF, Ft);
       if (!chol_ok) {
         at.fill(-std::numeric_limits<double>::infinity());
-        return at;
+        return;
       }
       
       arma::vec tmpv = y.col(t) - D.col(t * Dtv) - Zt * at.col(t);
@@ -282,11 +369,8 @@ arma::mat ssm_mlg::fast_smoother() const {
   arma::mat rt(m, n);
   rt.col(n - 1).zeros();
   for (int t = (n - 1); t > 0; t--) {
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
-    
-    if (na_y.n_elem < p) {
-      arma::mat Zt = Z.slice(t * Ztv);
-      Zt.rows(na_y).zeros();
+    if (y_pattern.any_observed(t)) {
+      const arma::mat& Zt = masked_Z(t, Zt_tmp);
       arma::mat L = T.slice(t * Ttv) *
         (arma::eye(m, m) - Kt.slice(t) * Zt);
       rt.col(t - 1) = ZFinv.slice(t) * vt.col(t) + L.t() * rt.col(t);
@@ -294,11 +378,8 @@ arma::mat ssm_mlg::fast_smoother() const {
       rt.col(t - 1) = T.slice(t * Ttv).t() * rt.col(t);
     }
   }
-  arma::uvec na_y = arma::find_nonfinite(y.col(0));
-  
-  if (na_y.n_elem < p) {
-    arma::mat Zt = Z.slice(0);
-    Zt.rows(na_y).zeros();
+  if (y_pattern.any_observed(0)) {
+    const arma::mat& Zt = masked_Z(0, Zt_tmp);
     arma::mat L = T.slice(0) * (arma::eye(m, m) - Kt.slice(0) * Zt);
     at.col(0) = a1 + P1 * (ZFinv.slice(0) * vt.col(0) + L.t() * rt.col(0));
   } else {
@@ -307,7 +388,73 @@ arma::mat ssm_mlg::fast_smoother() const {
   for (unsigned int t = 0; t < (n - 1); t++) {
     at.col(t + 1) = C.col(t * Ctv)+ T.slice(t * Ttv) * at.col(t) + RR.slice(t * Rtv) * rt.col(t);
   }
-  return at;
+}
+
+// The posterior precision of the states is block tridiagonal with
+// Q_tt = P1^{-1} (t = 1) or RR_t-1^{-1} (t > 1), plus T_t' RR_t^{-1} T_t 
+// (t < n) and Z_t' HH_t^{-1} Z_t of the observed series, and 
+// Q_t+1,t = -RR_t^{-1} T_t, so the smoothed means solve Q x = b
+bool ssm_mlg::banded_smoother(arma::mat& at, block_tridiag& Q) const {
+  
+  Q.set_size(m, n);
+  arma::mat P1inv;
+  double logdet;
+  if (!inv_sympd_logdet(P1, P1inv, logdet)) {
+    return false;
+  }
+  Q.diag.slice(0) = P1inv;
+  Q.rhs.col(0) = P1inv * a1;
+  double constant = -0.5 * (logdet + arma::dot(a1, Q.rhs.col(0)));
+  
+  arma::mat RRinv;
+  arma::mat HHinv;
+  arma::mat HHt_tmp;
+  double HH_logdet = 0.0;
+  // for time-invariant H, HHinv is recomputed only when the pattern changes
+  int HH_id = -1;
+  unsigned int n_obs = 0;
+  for (unsigned int t = 0; t < n; t++) {
+    if (t < (n - 1)) {
+      if (t == 0 || Rtv) {
+        if (!inv_sympd_logdet(RR.slice(t * Rtv), RRinv, logdet)) {
+          return false;
+        }
+      }
+      arma::vec Ct = C.col(t * Ctv);
+      arma::mat RRinvT = RRinv * T.slice(t * Ttv);
+      Q.diag.slice(t) += T.slice(t * Ttv).t() * RRinvT;
+      Q.rhs.col(t) -= RRinvT.t() * Ct;
+      Q.offdiag.slice(t) = -RRinvT;
+      Q.diag.slice(t + 1) = RRinv;
+      Q.rhs.col(t + 1) = RRinv * Ct;
+      constant -= 0.5 * (logdet + arma::dot(Ct, Q.rhs.col(t + 1)));
+    }
+    const arma::uvec& obs = y_pattern.observed(t);
+    if (obs.n_elem > 0) {
+      if (Htv || static_cast<int>(y_pattern.id(t)) != HH_id) {
+        if (!inv_sympd_logdet(observed_HH(t, HHt_tmp), HHinv, HH_logdet)) {
+          return false;
+        }
+        HH_id = y_pattern.id(t);
+      }
+      arma::mat Zt = Z.slice(t * Ztv).rows(obs);
+      arma::vec vt = y.col(t) - D.col(t * Dtv);
+      vt = arma::vec(vt(obs));
+      arma::vec HHinv_v = HHinv * vt;
+      Q.diag.slice(t) += Zt.t() * HHinv * Zt;
+      Q.rhs.col(t) += Zt.t() * HHinv_v;
+      constant -= 0.5 * (HH_logdet + arma::dot(vt, HHinv_v));
+      n_obs += obs.n_elem;
+    }
+  }
+  Q.constant = constant - 0.5 * n_obs * std::log(2.0 * M_PI);
+  if (!Q.factorize()) {
+    return false;
+  }
+  Q.solve();
+  at.head_cols(n) = Q.mean;
+  at.col(n) = C.col((n - 1) * Ctv) + T.slice((n - 1) * Ttv) * Q.mean.col(n - 1);
+  return true;
 }
 
 // smoother which returns also cov(alpha_t, alpha_t-1)
@@ -321,18 +468,15 @@ void ssm_mlg::smoother_ccov(arma::mat& at, arma::cube& Pt, arma::cube& ccov) con
   arma::mat vt(p, n, arma::fill::zeros);
   arma::cube ZFinv(m, p, n, arma::fill::zeros);
   arma::cube Kt(m, p, n, arma::fill::zeros);
+  // buffers for Z and HH in case of missing observations
+  arma::mat Zt_tmp;
+  arma::mat HHt_tmp;
   
   for (unsigned int t = 0; t < n; t++) {
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
+    const arma::uvec& na_y = y_pattern.missing(t);
     if (na_y.n_elem < p) {
-      arma::mat Zt = Z.slice(t * Ztv);
-      arma::mat HHt = HH.slice(t * Htv);
-      if (na_y.n_elem > 0) {
-        Zt.rows(na_y).zeros();
-        HHt.rows(na_y).zeros();
-        HHt.cols(na_y).zeros();
-        HHt.submat(na_y, na_y) = arma::eye(na_y.n_elem, na_y.n_elem);
-      }
+      const arma::mat& Zt = masked_Z(t, Zt_tmp);
+      const arma::mat& HHt = masked_HH(t, HHt_tmp);
       arma::mat Ft = Zt * Pt.slice(t) * Zt.t() + HHt;
       // first check to avoid armadillo warnings
       bool chol_ok = Ft.is_finite() && arma::all(Ft.diag() > 0);
@@ -377,10 +521,8 @@ void ssm_mlg::smoother_ccov(arma::mat& at, arma::cube& Pt, arma::cube& ccov) con
   arma::mat Nt(m, m, arma::fill::zeros);
   
   for (int t = (n - 1); t >= 0; t--) {    
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
-    if (na_y.n_elem < p) {
-      arma::mat Zt = Z.slice(t * Ztv);
-      Zt.rows(na_y).zeros();
+    if (y_pattern.any_observed(t)) {
+      const arma::mat& Zt = masked_Z(t, Zt_tmp);
       arma::mat L = T.slice(t * Ttv) * (arma::eye(m, m) -
         Kt.slice(t) * Zt);
       //P[t+1] stored to ccov_t
@@ -409,18 +551,15 @@ double ssm_mlg::filter(arma::mat& at, arma::mat& att,
   
   const double LOG2PI = std::log(2.0 * M_PI);
   double logLik = 0.0;
+  // buffers for Z and HH in case of missing observations
+  arma::mat Zt_tmp;
+  arma::mat HHt_tmp;
   for (unsigned int t = 0; t < n; t++) {
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
+    const arma::uvec& na_y = y_pattern.missing(t);
     
     if (na_y.n_elem < p) {
-      arma::mat Zt = Z.slice(t * Ztv);
-      arma::mat HHt = HH.slice(t * Htv);
-      if (na_y.n_elem > 0) {
-        Zt.rows(na_y).zeros();
-        HHt.rows(na_y).zeros();
-        HHt.cols(na_y).zeros();
-        HHt.submat(na_y, na_y) = arma::eye(na_y.n_elem, na_y.n_elem);
-      }
+      const arma::mat& Zt = masked_Z(t, Zt_tmp);
+      const arma::mat& HHt = masked_HH(t, HHt_tmp);
       
       arma::mat Ft = Zt * Pt.slice(t) * Zt.t() + HHt;
       
@@ -477,9 +616,10 @@ double ssm_mlg::filter(arma::mat& at, arma::mat& att,
 
 void ssm_mlg::psi_filter(const unsigned int nsim, arma::cube& alpha) {
   
-  arma::mat alphahat(m, n + 1);
-  arma::cube Vt(m, m, n + 1);
-  arma::cube Ct(m, m, n + 1);
+  workspace.set_psi_size(m, n);
+  arma::mat& alphahat = workspace.alphahat;
+  arma::cube& Vt = workspace.Vt;
+  arma::cube& Ct = workspace.Ct;
   smoother_ccov(alphahat, Vt, Ct);
   conditional_cov(Vt, Ct);
   
@@ -508,34 +648,28 @@ void ssm_mlg::psi_filter(const unsigned int nsim, arma::cube& alpha) {
 arma::cube ssm_mlg::simulate_states(const unsigned int nsim) {
   
   arma::mat L_P1 = psd_chol(P1);
-  std::normal_distribution<> normal(0.0, 1.0);
+  
+  // buffers for the normal variates of one replication, drawn at once
+  arma::vec um(m);
+  arma::mat up(p, n);
+  arma::mat uk(k, n);
   
   arma::cube asim(m, n + 1, nsim);
   arma::mat y_tmp = y;
   for(unsigned int i = 0; i < nsim; i++) {
     
-    arma::vec um(m);
-    for(unsigned int j = 0; j < m; j++) {
-      um(j) = normal(engine);
-    }
+    normal_fill(um, engine);
+    normal_fill(up, engine);
+    normal_fill(uk, engine);
     asim.slice(i).col(0) = L_P1 * um;
     
     for (unsigned int t = 0; t < n; t++) {
-      arma::uvec na_y = arma::find_nonfinite(y.col(t));
-      if (na_y.n_elem < p) {
-        arma::vec up(p);
-        for(unsigned int j = 0; j < p; j++) {
-          up(j) = normal(engine);
-        }
-        y.col(t) -= Z.slice(t * Ztv) * asim.slice(0).col(t) +
-          H(t * Htv) * up;
-      }
-      arma::vec uk(k);
-      for(unsigned int j = 0; j < k; j++) {
-        uk(j) = normal(engine);
+      if (y_pattern.any_observed(t)) {
+        y.col(t) -= Z.slice(t * Ztv) * asim.slice(i).col(t) +
+          H.slice(t * Htv) * up.col(t);
       }
-      asim.slice(i).col(t + 1) = T.slice(t * Ttv) * asim.slice(0).col(t) +
-        R.slice(t * Rtv) * uk;
+      asim.slice(i).col(t + 1) = T.slice(t * Ttv) * asim.slice(i).col(t) +
+        R.slice(t * Rtv) * uk.col(t);
     }
     
     asim.slice(i) += fast_smoother();
@@ -590,7 +724,7 @@ arma::mat ssm_mlg::sample_model(const unsigned int predict_type) {
         for(unsigned int j = 0; j < p; j++) {
           up(j) = normal(engine);
         }
-        y.col(t) += H(t * Htv) * up;
+        y.col(t) += H.slice(t * Htv) * up;
       }
     }
     return y;
@@ -616,7 +750,7 @@ arma::cube ssm_mlg::predict_past(const arma::mat& theta_posterior,
         for(unsigned int j = 0; j < p; j++) {
           up(j) = normal(engine);
         }
-        samples.slice(i).col(t) += H(t * Htv) * up;
+        samples.slice(i).col(t) += H.slice(t * Htv) * up;
       }
     }
   }
@@ -4,6 +4,9 @@
 #define SSM_MLG_H
 
 #include "bssm.h"
+#include "filter_workspace.h"
+#include "missing_pattern.h"
+#include "block_tridiag.h"
 #include <sitmo.h>
 
 class ssm_mlg {
@@ -33,6 +36,8 @@ public:
     const double zero_tol = 1e-12);
   
   arma::mat y;
+  // missingness patterns of y
+  const missing_pattern y_pattern;
   arma::cube Z;
   arma::cube H;
   arma::cube T;
@@ -59,10 +64,22 @@ public:
   
   // random number engine
   sitmo::prng_engine engine;
+  // buffers for the particle filters
+  filter_workspace workspace;
   // zero-tolerance
   const double zero_tol;
   arma::cube HH;
   arma::cube RR;
+  // for time-invariant H, HH of the observed series, HH with the rows and 
+  // columns of the missing series replaced by those of identity matrix, and 
+  // the factors of the observational density, for each missingness pattern
+  std::vector<arma::mat> HH_observed;
+  std::vector<arma::mat> HH_masked;
+  std::vector<arma::mat> obs_Linv;
+  std::vector<arma::uvec> obs_index;
+  arma::vec obs_constant;
+  // compute also the factors of the observational density in compute_HH
+  bool cache_obs_density;
   
   // R functions
   const Rcpp::Function update_fn;
@@ -78,7 +95,21 @@ public:
     for (unsigned int t = 0; t < H.n_slices; t++) {
       HH.slice(t) = H.slice(t) * H.slice(t).t();
     }
+    compute_HH_patterns();
   }
+  // update the per-pattern caches after HH has changed
+  void compute_HH_patterns();
+  
+  // Z_t with the rows of the missing series set to zero
+  const arma::mat& masked_Z(const unsigned int t, arma::mat& buffer) const;
+  // HH_t with the missing series replaced by independent unit variances
+  const arma::mat& masked_HH(const unsigned int t, arma::mat& buffer) const;
+  // HH_t of the observed series
+  const arma::mat& observed_HH(const unsigned int t, arma::mat& buffer) const;
+  // log-density of the observed elements of x at time t given the mean, 
+  // using the cached factors, requires time-invariant H
+  double cached_obs_density(const unsigned int t, const arma::vec& x, 
+    const arma::vec& mean) const;
   
   void update_model(const arma::vec& new_theta);
   double log_prior_pdf(const arma::vec& x) const;
@@ -94,6 +125,13 @@ public:
   void smoother(arma::mat& at, arma::cube& Pt) const; 
   // perform fast state smoothing
   arma::mat fast_smoother() const;
+  // fast state smoothing to a preallocated m x (n + 1) matrix
+  void fast_smoother(arma::mat& at) const;
+  // smoothing by solving the block tridiagonal system of the posterior 
+  // precision of the states, also stores the factorization to Q for 
+  // log-likelihood and simulation, returns false if P1, RR or HH (of the 
+  // observed series) is not positive definite
+  bool banded_smoother(arma::mat& at, block_tridiag& Q) const;
   // smoothing which also returns covariances cov(alpha_t, alpha_t-1)
   void smoother_ccov(arma::mat& at, arma::cube& Pt, arma::cube& ccov) const;
   
@@ -2,10 +2,12 @@
 #include "conditional_dist.h"
 #include "distr_consts.h"
 #include "sample.h"
+#include "rnorm.h"
 #include "rep_mat.h"
+#include "ep_update.h"
 
 ssm_mng::ssm_mng(const Rcpp::List model, const unsigned int seed, const double zero_tol) 
-  :  y((Rcpp::as<arma::mat>(model["y"])).t()), Z(Rcpp::as<arma::cube>(model["Z"])),
+  :  y((Rcpp::as<arma::mat>(model["y"])).t()), y_pattern(y), Z(Rcpp::as<arma::cube>(model["Z"])),
     T(Rcpp::as<arma::cube>(model["T"])),
     R(Rcpp::as<arma::cube>(model["R"])), a1(Rcpp::as<arma::vec>(model["a1"])),
     P1(Rcpp::as<arma::mat>(model["P1"])), D(Rcpp::as<arma::mat>(model["D"])),
@@ -18,6 +20,8 @@ ssm_mng::ssm_mng(const Rcpp::List model, const unsigned int seed, const double z
     distribution(Rcpp::as<arma::uvec>(model["distribution"])),
     max_iter(model["max_iter"]), conv_tol(model["conv_tol"]), 
     local_approx(model["local_approx"]),
+    ep_iter(model.containsElementNamed("ep_iter") ? 
+      Rcpp::as<unsigned int>(model["ep_iter"]) : 0),
     initial_mode((Rcpp::as<arma::mat>(model["initial_mode"])).t()),
     mode_estimate(initial_mode),
     approx_state(-1),
@@ -76,6 +80,7 @@ void ssm_mng::approximate() {
   
   // check if there is need to update the approximation
   if (approx_state < 1) {
+    workspace.set_smooth_size(m, n);
     //update model
     approx_model.Z = Z;
     approx_model.T = T;
@@ -88,7 +93,8 @@ void ssm_mng::approximate() {
     
     // don't update y and H if using global approximation and we have updated them already
     if(!local_approx & (approx_state == 0)) {
-      arma::mat alpha = approx_model.fast_smoother();
+      approx_model.fast_smoother(workspace.smooth);
+      const arma::mat& alpha = workspace.smooth;
       for (unsigned int t = 0; t < n; t++) {
         mode_estimate.col(t) = D.col(Dtv * t) + approx_model.Z.slice(Ztv * t) * alpha.col(t);
       }
@@ -102,7 +108,8 @@ void ssm_mng::approximate() {
         laplace_iter(mode_estimate);
         // compute new guess of mode
         arma::mat mode_estimate_new(p, n);
-        arma::mat alpha = approx_model.fast_smoother();
+        approx_model.fast_smoother(workspace.smooth);
+        const arma::mat& alpha = workspace.smooth;
         for (unsigned int t = 0; t < n; t++) {
           mode_estimate_new.col(t) = 
             D.col(Dtv * t) + Z.slice(Ztv * t) * alpha.col(t);
@@ -111,6 +118,9 @@ void ssm_mng::approximate() {
         diff = arma::accu(arma::square(mode_estimate_new - mode_estimate)) / (n * p);
         mode_estimate = mode_estimate_new;
       }
+      if (ep_iter > 0) {
+        ep_approx();
+      }
     }
     approx_state = 1; //approx matches theta, approx_loglik does not match
   }
@@ -118,6 +128,10 @@ void ssm_mng::approximate() {
 }
 // construct approximating model from fixed mode estimate, no iterations
 // used in IS-correction
+// With ep_iter > 0, the stored mode estimate is the smoothed signal of the 
+// EP-refined model, not the Laplace mode, so the pseudo-observations are 
+// re-linearised at it and the EP sweeps are run again from there. The result 
+// is close to, but not exactly, the approximation of approximate().
 void ssm_mng::approximate_for_is(const arma::mat& mode_estimate_) {
   
   approx_model.Z = Z;
@@ -131,6 +145,9 @@ void ssm_mng::approximate_for_is(const arma::mat& mode_estimate_) {
   //Construct y and H for the Gaussian model
   mode_estimate = mode_estimate_;
   laplace_iter(mode_estimate);
+  if (ep_iter > 0) {
+    ep_approx();
+  }
   update_scales();
   approx_loglik = 0.0;
   approx_state = 2;
@@ -231,8 +248,8 @@ void ssm_mng::update_scales() {
             u(i, t) * std::exp(mode_estimate(i, t));
           break;
         case 2  :
-          scales(t) += y(i, t) * mode_estimate(t) - 
-            u(i, t) * std::log1p(std::exp(mode_estimate(i, t)));
+          scales(t) += y(i, t) * mode_estimate(i, t) - 
+            u(i, t) * log1p_exp(mode_estimate(i, t));
           break;
         case 3  :
           scales(t) += y(i, t) * mode_estimate(i, t) -(y(i, t) + phi(i)) *
@@ -302,7 +319,83 @@ void ssm_mng::laplace_iter(const arma::mat& signal) {
     }
   }
   approx_model.H = sqrt(approx_model.HH);  // diagonal
+  // HH was modified directly
+  approx_model.compute_HH_patterns();
+}
+// see ssm_ung::ep_approx, here the sites are the elements of the diagonal 
+// of HH, and Gaussian series are exact and not updated
+void ssm_mng::ep_approx() {
+  
+  workspace.set_smooth_size(m, n);
+  arma::vec nodes;
+  arma::vec weights;
+  gauss_hermite(20, nodes, weights);
+  
+  arma::mat tau(p, n);
+  arma::mat nu(p, n);
+  for (unsigned int t = 0; t < n; t++) {
+    tau.col(t) = 1.0 / approx_model.HH.slice(t).diag();
+  }
+  nu = approx_model.y % tau;
+  arma::mat signal_mean(p, n, arma::fill::zeros);
+  arma::mat at(m, n + 1);
+  arma::cube Pt(m, m, n + 1);
+  
+  unsigned int iter = 0;
+  double diff = conv_tol + 1;
+  while(iter < ep_iter && diff > conv_tol) {
+    iter++;
+    approx_model.smoother(at, Pt);
+    if (!at.is_finite() || !Pt.is_finite()) {
+      break;
+    }
+    arma::mat signal_mean_new(p, n);
+    for (unsigned int t = 0; t < n; t++) {
+      const arma::mat& Zt = Z.slice(Ztv * t);
+      signal_mean_new.col(t) = D.col(Dtv * t) + Zt * at.col(t);
+      arma::vec var = arma::sum((Zt * Pt.slice(t)) % Zt, 1);
+      const arma::uvec& obs = y_pattern.observed(t);
+      for (unsigned int j = 0; j < obs.n_elem; j++) {
+        unsigned int i = obs(j);
+        if (distribution(i) != 5) {
+          ep_site_update(signal_mean_new(i, t), var(i), 
+            [&](const double signal) { return log_signal_density(i, t, signal); },
+            nodes, weights, 0.5, tau(i, t), nu(i, t));
+          approx_model.HH(i, i, t) = 1.0 / tau(i, t);
+          approx_model.H(i, i, t) = std::sqrt(approx_model.HH(i, i, t));
+          approx_model.y(i, t) = nu(i, t) / tau(i, t);
+        }
+      }
+    }
+    diff = arma::accu(arma::square(signal_mean_new - signal_mean)) / (n * p);
+    signal_mean = signal_mean_new;
+    approx_model.compute_HH_patterns();
+  }
+  
+  approx_model.fast_smoother(workspace.smooth);
+  const arma::mat& alpha = workspace.smooth;
+  for (unsigned int t = 0; t < n; t++) {
+    mode_estimate.col(t) = D.col(Dtv * t) + Z.slice(Ztv * t) * alpha.col(t);
+  }
+}
+
+double ssm_mng::log_signal_density(const unsigned int i, const unsigned int t, 
+  const double signal) const {
+  
+  switch(distribution(i)) {
+  case 1: 
+    return y(i, t) * signal - u(i, t) * std::exp(signal);
+  case 2: 
+    return y(i, t) * signal - u(i, t) * log1p_exp(signal);
+  case 3: 
+    return y(i, t) * signal - 
+      (y(i, t) + phi(i)) * std::log(phi(i) + u(i, t) * std::exp(signal));
+  case 4:
+    return -phi(i) * (signal + y(i, t) * std::exp(-signal) / u(i, t));
+  }
+  return 0.0;
 }
+
 // these are really not constant in all cases (note phi)
 double ssm_mng::compute_const_term() const {
   
@@ -361,7 +454,7 @@ arma::vec ssm_mng::log_weights(const unsigned int t,  const arma::cube& alpha) c
           weights(i) += y(j,t) * simsignal(j) - u(j,t) * std::exp(simsignal(j));
           break;
         case 2  :
-          weights(i) += y(j,t) * simsignal(j) - u(j,t) * std::log1p(std::exp(simsignal(j)));
+          weights(i) += y(j,t) * simsignal(j) - u(j,t) * log1p_exp(simsignal(j));
           break;
         case 3  :
           weights(i) += y(j,t) * simsignal(j) - (y(j,t) + phi(j)) *
@@ -412,7 +505,7 @@ arma::vec ssm_mng::log_obs_density(const unsigned int t,
           weights(i) += y(j,t) * simsignal(j) - u(j,t) * std::exp(simsignal(j));
           break;
         case 2  :
-          weights(i) += y(j,t) * simsignal(j) - u(j,t) * std::log1p(std::exp(simsignal(j)));
+          weights(i) += y(j,t) * simsignal(j) - u(j,t) * log1p_exp(simsignal(j));
           break;
         case 3  :
           weights(i) += y(j,t) * simsignal(j) - (y(j,t) + phi(j)) *
@@ -451,6 +544,8 @@ arma::vec ssm_mng::log_obs_density(const unsigned int t,
 double ssm_mng::psi_filter(const unsigned int nsim, arma::cube& alpha, 
   arma::mat& weights, arma::umat& indices) {
   
+  workspace.set_size(m, k, nsim);
+  
   if(approx_state < 2) {
     if (approx_state < 1) {
       mode_estimate = initial_mode;
@@ -467,27 +562,22 @@ double ssm_mng::psi_filter(const unsigned int nsim, arma::cube& alpha,
     approx_loglik = gaussian_loglik + const_term + arma::accu(scales);
   }
   
-  arma::mat alphahat(m, n + 1);
-  arma::cube Vt(m, m, n + 1);
-  arma::cube Ct(m, m, n + 1);
+  workspace.set_psi_size(m, n);
+  arma::mat& alphahat = workspace.alphahat;
+  arma::cube& Vt = workspace.Vt;
+  arma::cube& Ct = workspace.Ct;
   approx_model.smoother_ccov(alphahat, Vt, Ct);
   conditional_cov(Vt, Ct);
   
-  std::normal_distribution<> normal(0.0, 1.0);
-  
+  normal_fill(workspace.um, engine);
   for (unsigned int i = 0; i < nsim; i++) {
-    arma::vec um(m);
-    for(unsigned int j = 0; j < m; j++) {
-      um(j) = normal(engine);
-    }
-    alpha.slice(i).col(0) = alphahat.col(0) + Vt.slice(0) * um;
+    alpha.slice(i).col(0) = alphahat.col(0) + Vt.slice(0) * workspace.um.col(i);
   }
   
   std::uniform_real_distribution<> unif(0.0, 1.0);
-  arma::vec normalized_weights(nsim);
+  arma::vec& normalized_weights = workspace.normalized_weights;
   double loglik = 0.0;
-  arma::uvec na_y = arma::find_nonfinite(y.col(0));
-  if (na_y.n_elem < p) {
+  if (y_pattern.any_observed(0)) {
     weights.col(0) = arma::exp(log_weights(0, alpha) - scales(0));
     double sum_weights = arma::accu(weights.col(0));
     if(sum_weights > 0.0){
@@ -503,27 +593,24 @@ double ssm_mng::psi_filter(const unsigned int nsim, arma::cube& alpha,
   }
   
   for (unsigned int t = 0; t < n; t++) {
-    arma::vec r(nsim);
+    arma::vec& r = workspace.r;
     for (unsigned int i = 0; i < nsim; i++) {
       r(i) = unif(engine);
     }
-    indices.col(t) = stratified_sample(normalized_weights, r, nsim);
+    stratified_sample(normalized_weights, r, indices.colptr(t), nsim);
     
-    arma::mat alphatmp(m, nsim);
+    arma::mat& alphatmp = workspace.alphatmp;
     
     for (unsigned int i = 0; i < nsim; i++) {
       alphatmp.col(i) = alpha.slice(indices(i, t)).col(t);
     }
+    normal_fill(workspace.um, engine);
     for (unsigned int i = 0; i < nsim; i++) {
-      arma::vec um(m);
-      for(unsigned int j = 0; j < m; j++) {
-        um(j) = normal(engine);
-      }
       alpha.slice(i).col(t + 1) = alphahat.col(t + 1) +
-        Ct.slice(t + 1) * (alphatmp.col(i) - alphahat.col(t)) + Vt.slice(t + 1) * um;
+        Ct.slice(t + 1) * (alphatmp.col(i) - alphahat.col(t)) + Vt.slice(t + 1) * workspace.um.col(i);
     }
     
-    if ((t < (n - 1)) && arma::uvec(arma::find_nonfinite(y.col(t + 1))).n_elem < p) {
+    if ((t < (n - 1)) && y_pattern.any_observed(t + 1)) {
       weights.col(t + 1) =
         arma::exp(log_weights(t + 1, alpha) - scales(t + 1));
       double sum_weights = arma::accu(weights.col(t + 1));
@@ -545,26 +632,26 @@ double ssm_mng::psi_filter(const unsigned int nsim, arma::cube& alpha,
 double ssm_mng::bsf_filter(const unsigned int nsim, arma::cube& alpha,
   arma::mat& weights, arma::umat& indices) {
   
+  workspace.set_size(m, k, nsim);
+  
   arma::uvec nonzero = arma::find(P1.diag() > 0);
   arma::mat L_P1(m, m, arma::fill::zeros);
   if (nonzero.n_elem > 0) {
     L_P1.submat(nonzero, nonzero) =
       arma::chol(P1.submat(nonzero, nonzero), "lower");
   }
-  std::normal_distribution<> normal(0.0, 1.0);
+  // normal variates of all particles are drawn at once
+  arma::mat& um = workspace.um;
+  normal_fill(um, engine);
+  um = L_P1 * um;
   for (unsigned int i = 0; i < nsim; i++) {
-    arma::vec um(m);
-    for(unsigned int j = 0; j < m; j++) {
-      um(j) = normal(engine);
-    }
-    alpha.slice(i).col(0) = a1 + L_P1 * um;
+    alpha.slice(i).col(0) = a1 + um.col(i);
   }
   std::uniform_real_distribution<> unif(0.0, 1.0);
-  arma::vec normalized_weights(nsim);
+  arma::vec& normalized_weights = workspace.normalized_weights;
   double loglik = 0.0;
   
-  arma::uvec na_y = arma::find_nonfinite(y.col(0));
-  if (na_y.n_elem < p) {
+  if (y_pattern.any_observed(0)) {
     weights.col(0) = log_obs_density(0, alpha);
     double max_weight = weights.col(0).max();
     weights.col(0) = arma::exp(weights.col(0) - max_weight);
@@ -579,27 +666,26 @@ double ssm_mng::bsf_filter(const unsigned int nsim, arma::cube& alpha,
     weights.col(0).ones();
     normalized_weights.fill(1.0 / nsim);
   }
+  // buffer for the normal variates of the state equation
+  arma::mat& uk = workspace.uk;
   for (unsigned int t = 0; t < n; t++) {
     
-    arma::vec r(nsim);
+    arma::vec& r = workspace.r;
     for (unsigned int i = 0; i < nsim; i++) {
       r(i) = unif(engine);
     }
-    indices.col(t) = stratified_sample(normalized_weights, r, nsim);
-    arma::mat alphatmp(m, nsim);
+    stratified_sample(normalized_weights, r, indices.colptr(t), nsim);
+    arma::mat& alphatmp = workspace.alphatmp;
     
     for (unsigned int i = 0; i < nsim; i++) {
       alphatmp.col(i) = alpha.slice(indices(i, t)).col(t);
     }
+    normal_fill(uk, engine);
+    alphatmp = T.slice(t * Ttv) * alphatmp + R.slice(t * Rtv) * uk;
     for (unsigned int i = 0; i < nsim; i++) {
-      arma::vec uk(k);
-      for(unsigned int j = 0; j < k; j++) {
-        uk(j) = normal(engine);
-      }
-      alpha.slice(i).col(t + 1) = C.col(t * Ctv) + 
-        T.slice(t * Ttv) * alphatmp.col(i) + R.slice(t * Rtv) * uk;
+      alpha.slice(i).col(t + 1) = C.col(t * Ctv) + alphatmp.col(i);
     }
-    if ((t < (n - 1)) && arma::uvec(arma::find_nonfinite(y.col(t + 1))).n_elem < p) {
+    if ((t < (n - 1)) && y_pattern.any_observed(t + 1)) {
       weights.col(t + 1) = log_obs_density(t + 1, alpha);
       double max_weight = weights.col(t + 1).max();
       weights.col(t + 1) = arma::exp(weights.col(t + 1) - max_weight);
@@ -6,6 +6,7 @@
 
 #include <sitmo.h>
 #include "bssm.h"
+#include "filter_workspace.h"
 #include "model_ssm_mlg.h"
 
 class ssm_mng {
@@ -17,6 +18,8 @@ public:
     const double zero_tol = 1e-12);
   
   arma::mat y;
+  // missingness patterns of y
+  const missing_pattern y_pattern;
   arma::cube Z;
   arma::cube T;
   arma::cube R;
@@ -47,6 +50,9 @@ public:
   unsigned int max_iter;
   double conv_tol;
   const bool local_approx;
+  // number of expectation propagation sweeps refining the Laplace 
+  // approximation, 0 for the plain Laplace approximation
+  unsigned int ep_iter;
   const arma::mat initial_mode; // creating approx always starts from here
   arma::mat mode_estimate; // current estimate of mode
   
@@ -59,6 +65,8 @@ public:
   arma::vec scales;
   
   sitmo::prng_engine engine;
+  // buffers for the particle filters
+  filter_workspace workspace;
   const double zero_tol;
   arma::cube RR;
   
@@ -92,6 +100,12 @@ public:
   
   // given the mode_estimate, compute y and H of the approximating Gaussian model
   void laplace_iter(const arma::mat& signal);
+  // refine y and H of the approximating model by matching the moments of 
+  // the signals, and update the mode_estimate to the smoothed signals
+  void ep_approx();
+  // unnormalized log-density of y_it given the signal
+  double log_signal_density(const unsigned int i, const unsigned int t, 
+    const double signal) const;
 
     // bootstrap filter
   double bsf_filter(const unsigned int nsim, arma::cube& alpha,
@@ -0,0 +1,169 @@
+#include "model_ssm_msde.h"
+#include "sample.h"
+
+ssm_msde::ssm_msde(
+  const arma::mat& y,
+  const arma::vec& theta,
+  const arma::vec& x0,
+  vec_sde_fnPtr drift_, mat_sde_fnPtr diffusion_,
+  mobs_fnPtr log_obs_density_, prior_fnPtr log_prior_pdf_,
+  const unsigned int L_f, const unsigned int L_c,
+  const unsigned int scheme,
+  const unsigned int seed)
+  :
+    y(y), theta(theta), x0(x0), n(y.n_rows), m(x0.n_elem),
+    drift(drift_), diffusion(diffusion_),
+    log_obs_density(log_obs_density_), log_prior_pdf(log_prior_pdf_),
+    scheme(scheme), coarse_engine(seed), engine(seed + 1), L_f(L_f), L_c(L_c),
+    levels({L_c, L_f}) {
+}
+
+arma::vec ssm_msde::log_likelihood(
+    const unsigned int method,
+    const unsigned int nsim,
+    arma::cube& alpha,
+    arma::mat& weights,
+    arma::umat& indices) {
+
+  arma::vec ll(2);
+  ll(0) = bsf_filter(nsim, L_f, alpha, weights, indices);
+  ll(1) = ll(0);
+  return ll;
+}
+
+// Euler-Maruyama scheme (1), the derivative-free (Runge-Kutta type) Milstein
+// scheme (2) which assumes diagonal noise, i.e. that the diffusion matrix is
+// diagonal and its jth diagonal element depends only on x_j, or the
+// derivative-free strong order 1.5 scheme (3) of Kloeden & Platen (1992, 
+// eq. 11.2.19) which assumes additive noise, i.e. that the diffusion matrix
+// does not depend on x.
+void ssm_msde::simulate(arma::mat& x, const unsigned int L, const double t) {
+
+  unsigned int n_steps = std::pow(2, L);
+  double dt = t / n_steps;
+  double sqrt_dt = std::sqrt(dt);
+  std::normal_distribution<> normal(0.0, sqrt_dt);
+
+  // buffers reused over the steps and particles
+  arma::vec dB(m);
+  arma::vec dZ(m);
+  arma::vec a(m);
+  arma::vec b(m);
+  arma::vec b_hat(m);
+  arma::vec x_sup(m);
+  arma::vec a_plus(m);
+  arma::vec a_minus(m);
+  // with additive noise the diffusion matrix is the same for all particles
+  arma::mat B;
+  if (scheme == 3) {
+    B = diffusion(x0, theta);
+  }
+  
+  for (unsigned int k = 0; k < n_steps; k++) {
+    for (unsigned int i = 0; i < x.n_cols; i++) {
+      for (unsigned int j = 0; j < m; j++) {
+        dB(j) = normal(coarse_engine);
+      }
+      // alias of the particle, so that the model functions do not copy it
+      arma::vec x_i(x.colptr(i), m, false, true);
+      a = drift(x_i, theta);
+      switch (scheme) {
+      case 1: {
+        x_i += a * dt + diffusion(x_i, theta) * dB;
+      } break;
+      case 2: {
+        b = arma::diagvec(diffusion(x_i, theta));
+        x_sup = x_i + a * dt + b * sqrt_dt;
+        b_hat = arma::diagvec(diffusion(x_sup, theta));
+        x_i += a * dt + b % dB + 0.5 * (b_hat - b) % (dB % dB - dt) / sqrt_dt;
+      } break;
+      case 3: {
+        // double integrals int int dB ds of the steps
+        for (unsigned int j = 0; j < m; j++) {
+          dZ(j) = 0.5 * dt * (dB(j) + normal(coarse_engine) / std::sqrt(3.0));
+        }
+        // increment of the step, accumulated in b
+        b = a * dt + B * dB;
+        for (unsigned int j = 0; j < m; j++) {
+          x_sup = x_i + a * (dt / m) + B.col(j) * sqrt_dt;
+          a_plus = drift(x_sup, theta);
+          x_sup -= 2.0 * sqrt_dt * B.col(j);
+          a_minus = drift(x_sup, theta);
+          b += (a_plus - a_minus) * (0.5 * dZ(j) / sqrt_dt) + 
+            (a_plus - 2.0 * a + a_minus) * (0.25 * dt);
+        }
+        x_i += b;
+      } break;
+      }
+    }
+  }
+}
+
+double ssm_msde::bsf_filter(const unsigned int nsim,
+  const unsigned int L,  arma::cube& alpha,
+  arma::mat& weights, arma::umat& indices) {
+  
+  workspace.set_size(m, 0, nsim);
+  
+  // alpha is  m x (n + 1) x nsim
+  // time points where all observations are missing are skipped
+  // current particles, simulated jointly
+  arma::mat x(m, nsim);
+  x.each_col() = x0;
+  simulate(x, L, 1);
+  alpha.col(0) = x;
+
+  std::uniform_real_distribution<> unif(0.0, 1.0);
+  arma::vec& normalized_weights = workspace.normalized_weights;
+  double loglik = 0.0;
+
+  if(arma::find_finite(y.row(0)).n_elem > 0) {
+    weights.col(0) = log_obs_density(y.row(0).t(), x, theta);
+    double max_weight = weights.col(0).max();
+    weights.col(0) = arma::exp(weights.col(0) - max_weight);
+    double sum_weights = arma::accu(weights.col(0));
+
+    if(sum_weights > 0.0){
+      normalized_weights = weights.col(0) / sum_weights;
+    } else {
+      return -std::numeric_limits<double>::infinity();
+    }
+    loglik = max_weight + std::log(sum_weights / nsim);
+  } else {
+    weights.col(0).ones();
+    normalized_weights.fill(1.0 / nsim);
+  }
+  for (unsigned int t = 0; t < n; t++) {
+
+    arma::vec& r = workspace.r;
+    for (unsigned int i = 0; i < nsim; i++) {
+      r(i) = unif(engine);
+    }
+
+    stratified_sample(normalized_weights, r, indices.colptr(t), nsim);
+
+    for (unsigned int i = 0; i < nsim; i++) {
+      x.col(i) = alpha.slice(indices(i, t)).col(t);
+    }
+    simulate(x, L, 1);
+    alpha.col(t + 1) = x;
+
+    if ((t < (n - 1)) && arma::find_finite(y.row(t + 1)).n_elem > 0) {
+      weights.col(t + 1) = log_obs_density(y.row(t + 1).t(), x, theta);
+
+      double max_weight = weights.col(t + 1).max();
+      weights.col(t + 1) = arma::exp(weights.col(t + 1) - max_weight);
+      double sum_weights = arma::accu(weights.col(t + 1));
+      if(sum_weights > 0.0){
+        normalized_weights = weights.col(t + 1) / sum_weights;
+      } else {
+        return -std::numeric_limits<double>::infinity();
+      }
+      loglik += max_weight + std::log(sum_weights / nsim);
+    } else {
+      weights.col(t + 1).ones();
+      normalized_weights.fill(1.0/nsim);
+    }
+  }
+  return loglik;
+}
@@ -0,0 +1,94 @@
+// multivariate state space model with continuous SDE dynamics
+#ifndef SSM_MSDE_H
+#define SSM_MSDE_H
+
+#include <sitmo.h>
+#include "bssm.h"
+#include "filter_workspace.h"
+
+// typedef for a pointer of drift function returning vec
+typedef arma::vec (*vec_sde_fnPtr)(const arma::vec& x, const arma::vec& theta);
+// typedef for a pointer of diffusion function returning mat
+typedef arma::mat (*mat_sde_fnPtr)(const arma::vec& x, const arma::vec& theta);
+// typedef for a pointer of log-prior function
+typedef double (*prior_fnPtr)(const arma::vec& theta);
+// typedef for a pointer of observational log-density function,
+// which returns the log-densities of all particles (columns of alpha)
+typedef arma::vec (*mobs_fnPtr)(const arma::vec& y,
+  const arma::mat& alpha, const arma::vec& theta);
+
+class ssm_msde {
+
+public:
+
+  ssm_msde(
+    const arma::mat& y,
+    const arma::vec& theta,
+    const arma::vec& x0,
+    vec_sde_fnPtr drift_, mat_sde_fnPtr diffusion_,
+    mobs_fnPtr log_obs_density_, prior_fnPtr log_prior_pdf_,
+    const unsigned int L_f,
+    const unsigned int L_c,
+    const unsigned int scheme = 1,
+    const unsigned int seed = 1);
+
+  // n x p matrix of observations
+  arma::mat y;
+  // Parameter vector used in _all_ functions
+  arma::vec theta;
+
+  const arma::vec x0;
+  const unsigned int n;
+  const unsigned int m; // number of states
+
+  // dx = drift(x) dt + diffusion(x) dB, where diffusion(x) is m x m matrix
+  vec_sde_fnPtr drift;
+  mat_sde_fnPtr diffusion;
+  //log-pdf for observational level
+  mobs_fnPtr log_obs_density;
+  //prior log-pdf
+  prior_fnPtr log_prior_pdf;
+
+  // 1 = Euler-Maruyama, 2 = derivative-free Milstein for diagonal noise,
+  // 3 = derivative-free strong order 1.5 scheme for additive noise
+  const unsigned int scheme;
+
+  // the states are always sampled from the output of the bootstrap filter
+  static const unsigned int sampling_method = 2;
+
+  // PRNG used for simulating Brownian motion
+  sitmo::prng_engine coarse_engine;
+  // PRNG use for everything else
+  sitmo::prng_engine engine;
+  // buffers for the particle filters
+  filter_workspace workspace;
+
+  void update_model(const arma::vec& new_theta) {
+    theta = new_theta;
+  };
+
+  // log-likelihood estimate using level L_f, method is ignored
+  arma::vec log_likelihood(
+      const unsigned int method,
+      const unsigned int nsim,
+      arma::cube& alpha,
+      arma::mat& weights,
+      arma::umat& indices);
+
+  // bootstrap filter
+  double bsf_filter(const unsigned int nsim, const unsigned int L,
+    arma::cube& alpha, arma::mat& weights, arma::umat& indices);
+
+  // advance all particles (columns of x) over [0,t] using 2^L steps
+  void simulate(arma::mat& x, const unsigned int L, const double t);
+
+  const unsigned int L_f;
+  const unsigned int L_c;
+  // increasing discretization levels of multilevel delayed acceptance,
+  // defaults to (L_c, L_f)
+  arma::uvec levels;
+
+};
+
+
+#endif
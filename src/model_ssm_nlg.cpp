@@ -1,9 +1,24 @@
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "model_ssm_nlg.h"
 #include "sample.h"
+#include "rnorm.h"
 #include "dmvnorm.h"
 #include "conditional_dist.h"
 #include "rep_mat.h"
 #include "psd_chol.h"
+#include "chol_update.h"
+
+// time_varying contains the time-variation of Z, H, T and R, the state 
+// dependence of H and R, and banded_approx, see nlg_flags in R. 
+// Checked before the first element is read by the constructor.
+static const arma::uvec& check_flags(const arma::uvec& time_varying) {
+  if (time_varying.n_elem != 7) {
+    Rcpp::stop("Flags of the non-linear model should have 7 elements.");
+  }
+  return time_varying;
+}
 
 ssm_nlg::ssm_nlg(const arma::mat& y, nvec_fnPtr Z_fn_, nmat_fnPtr H_fn_, 
   nvec_fnPtr T_fn_, nmat_fnPtr R_fn_, nmat_fnPtr Z_gn_, nmat_fnPtr T_gn_, 
@@ -15,17 +30,20 @@ ssm_nlg::ssm_nlg(const arma::mat& y, nvec_fnPtr Z_fn_, nmat_fnPtr H_fn_,
   const unsigned int seed, const unsigned int iekf_iter, 
   const unsigned int max_iter, const double conv_tol) 
   :
-    y(y), Z_fn(Z_fn_), H_fn(H_fn_), T_fn(T_fn_), 
-    R_fn(R_fn_), Z_gn(Z_gn_), T_gn(T_gn_),
+    y(y), y_pattern(y), Z_fn(Z_fn_), H_fn(H_fn_), T_fn(T_fn_), 
+    R_fn(R_fn_), Z_gn(Z_gn_), T_gn(T_gn_), Z_joint(nullptr), T_joint(nullptr),
+    T_batch(nullptr), Z_batch(nullptr),
     a1_fn(a1_fn_), P1_fn(P1_fn_), theta(theta), 
     log_prior_pdf(log_prior_pdf_), known_params(known_params), 
     known_tv_params(known_tv_params), m(m), k(k), n(y.n_cols),  p(y.n_rows),
-    Zgtv(time_varying(0)), Htv(time_varying(1)), Tgtv(time_varying(2)),
+    Zgtv(check_flags(time_varying)(0)), Htv(time_varying(1)), Tgtv(time_varying(2)),
     Rtv(time_varying(3)),
+    Hsd(time_varying(4)), Rsd(time_varying(5)), banded_approx(time_varying(6)),
     engine(seed), zero_tol(1e-8), 
     iekf_iter(iekf_iter), 
     max_iter(max_iter), 
     conv_tol(conv_tol),
+    approx_threads(1),
     mode_estimate(arma::mat(p, n, arma::fill::zeros)),
     approx_state(-1), approx_loglik(0.0),
     scales(arma::vec(n, arma::fill::zeros)),
@@ -41,6 +59,9 @@ ssm_nlg::ssm_nlg(const arma::mat& y, nvec_fnPtr Z_fn_, nmat_fnPtr H_fn_,
       theta,
       seed + 1,
       update_fn, prior_fn) {
+  // used in log_weights
+  approx_model.cache_obs_density = Htv == 0;
+  set_ukf_parameters();
 }
 
 void ssm_nlg::update_model(const arma::vec& new_theta) {
@@ -50,19 +71,164 @@ void ssm_nlg::update_model(const arma::vec& new_theta) {
   if (approx_state > 0) approx_state = 0;
 }
 
+void ssm_nlg::set_batch_fns(SEXP T_batch_, SEXP Z_batch_) {
+  
+  if (!Rf_isNull(T_batch_)) {
+    Rcpp::XPtr<nbatch_fnPtr> xpfun_T(T_batch_);
+    T_batch = *xpfun_T;
+  }
+  if (!Rf_isNull(Z_batch_)) {
+    Rcpp::XPtr<nbatch_fnPtr> xpfun_Z(Z_batch_);
+    Z_batch = *xpfun_Z;
+  }
+}
+
+void ssm_nlg::transition_mean(const unsigned int t, const arma::mat& alpha, 
+  arma::mat& mean) const {
+  
+  if (T_batch) {
+    T_batch(t, alpha, theta, known_params, known_tv_params, mean);
+  } else {
+    for (unsigned int i = 0; i < alpha.n_cols; i++) {
+      mean.col(i) = T_fn(t, alpha.col(i), theta, known_params, known_tv_params);
+    }
+  }
+}
+
+void ssm_nlg::observation_mean(const unsigned int t, const arma::mat& alpha, 
+  arma::mat& mean) const {
+  
+  if (Z_batch) {
+    Z_batch(t, alpha, theta, known_params, known_tv_params, mean);
+  } else {
+    for (unsigned int i = 0; i < alpha.n_cols; i++) {
+      mean.col(i) = Z_fn(t, alpha.col(i), theta, known_params, known_tv_params);
+    }
+  }
+}
+
+void ssm_nlg::set_joint_fns(SEXP Z_joint_, SEXP T_joint_) {
+  
+  if (!Rf_isNull(Z_joint_)) {
+    Rcpp::XPtr<njoint_fnPtr> xpfun_Z(Z_joint_);
+    Z_joint = *xpfun_Z;
+  }
+  if (!Rf_isNull(T_joint_)) {
+    Rcpp::XPtr<njoint_fnPtr> xpfun_T(T_joint_);
+    T_joint = *xpfun_T;
+  }
+}
+
+void ssm_nlg::Z_and_gn(const unsigned int t, const arma::vec& alpha, 
+  arma::vec& value, arma::mat& gradient) const {
+  
+  if (Z_joint) {
+    Z_joint(t, alpha, theta, known_params, known_tv_params, value, gradient);
+  } else {
+    value = Z_fn(t, alpha, theta, known_params, known_tv_params);
+    gradient = Z_gn(t, alpha, theta, known_params, known_tv_params);
+  }
+}
+
+void ssm_nlg::T_and_gn(const unsigned int t, const arma::vec& alpha, 
+  arma::vec& value, arma::mat& gradient) const {
+  
+  if (T_joint) {
+    T_joint(t, alpha, theta, known_params, known_tv_params, value, gradient);
+  } else {
+    value = T_fn(t, alpha, theta, known_params, known_tv_params);
+    gradient = T_gn(t, alpha, theta, known_params, known_tv_params);
+  }
+}
+
+unsigned int ssm_nlg::approx_num_threads() const {
+  
+#ifdef _OPENMP
+  if (omp_in_parallel()) return 1;
+#endif
+  return approx_threads;
+}
+
+// All time points are computed in one pass. The slices of the time-invariant 
+// matrices are written at t = 0 before the other time points, which can 
+// then be processed in parallel as they write to separate slices.
+void ssm_nlg::linearize(const arma::mat& alpha_Z, const arma::mat& alpha_T) {
+  
+  linearize_time_point(0, alpha_Z, alpha_T);
+  unsigned int n_threads = approx_num_threads();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(n_threads) if(n_threads > 1)
+#endif
+  for (unsigned int t = 1; t < n; t++) {
+    linearize_time_point(t, alpha_Z, alpha_T);
+  }
+  approx_model.compute_HH_patterns();
+}
+
+void ssm_nlg::linearize_time_point(const unsigned int t, 
+  const arma::mat& alpha_Z, const arma::mat& alpha_T) {
+  
+  arma::vec value;
+  if (t < approx_model.Z.n_slices) {
+    Z_and_gn(t, alpha_Z.col(t), value, approx_model.Z.slice(t));
+  } else {
+    value = Z_fn(t, alpha_Z.col(t), theta, known_params, known_tv_params);
+  }
+  approx_model.D.col(t) = value - approx_model.Z.slice(t * Zgtv) * alpha_Z.col(t);
+  if (t < approx_model.T.n_slices) {
+    T_and_gn(t, alpha_T.col(t), value, approx_model.T.slice(t));
+  } else {
+    value = T_fn(t, alpha_T.col(t), theta, known_params, known_tv_params);
+  }
+  approx_model.C.col(t) = value - approx_model.T.slice(t * Tgtv) * alpha_T.col(t);
+  if (t < approx_model.H.n_slices) {
+    approx_model.H.slice(t) = 
+      H_fn(t, alpha_Z.col(t), theta, known_params, known_tv_params);
+    approx_model.HH.slice(t) = approx_model.H.slice(t) * approx_model.H.slice(t).t();
+  }
+  if (t < approx_model.R.n_slices) {
+    approx_model.R.slice(t) = 
+      R_fn(t, alpha_T.col(t), theta, known_params, known_tv_params);
+    approx_model.RR.slice(t) = approx_model.R.slice(t) * approx_model.R.slice(t).t();
+  }
+}
+
+void ssm_nlg::smooth_approx_model() {
+  
+  if (!banded_approx || 
+      !approx_model.banded_smoother(workspace.smooth, precision)) {
+    approx_model.fast_smoother(workspace.smooth);
+  }
+}
+
+double ssm_nlg::approx_model_loglik() const {
+  
+  if (precision.valid) {
+    return precision.log_likelihood();
+  }
+  return approx_model.log_likelihood();
+}
 
 void ssm_nlg::approximate() {
   
   if(approx_state < 1) {
+    workspace.set_smooth_size(m, n);
     
     // initial approximation is based on EKF (at and att)
     approximate_by_ekf();
-    mode_estimate = approx_model.fast_smoother().head_cols(n);
+    smooth_approx_model();
+    mode_estimate = workspace.smooth.head_cols(n);
     if (!arma::is_finite(mode_estimate)) {
       return;
     }
+    // the factors of state-independent H and R are shared by all 
+    // evaluations of the objective
+    signal_factors factors;
     double ll;
-    if (max_iter > 0) ll = log_signal_pdf(mode_estimate);
+    if (max_iter > 0) {
+      precompute_signal_factors(mode_estimate, factors);
+      ll = log_signal_pdf(mode_estimate, factors);
+    }
     unsigned int i = 0;
     double rel_diff = 1.0e300; 
     double abs_diff = 1;
@@ -70,38 +236,12 @@ void ssm_nlg::approximate() {
     while(i < max_iter && rel_diff > conv_tol && abs_diff > 1e-4) {
       
       i++;
-      for (unsigned int t = 0; t < approx_model.Z.n_slices; t++) {
-        approx_model.Z.slice(t) = 
-          Z_gn(t, mode_estimate.col(t), theta, known_params, known_tv_params);
-      }
-      
-      for (unsigned int t = 0; t < approx_model.T.n_slices; t++) {
-        approx_model.T.slice(t) = 
-          T_gn(t, mode_estimate.col(t), theta, known_params, known_tv_params);
-      }
-      
-      for (unsigned int t = 0; t < n; t++) {
-        approx_model.D.col(t) = 
-          Z_fn(t, mode_estimate.col(t), theta, known_params, known_tv_params) -
-          approx_model.Z.slice(t * Zgtv) * mode_estimate.col(t);
-        approx_model.C.col(t) =  
-          T_fn(t, mode_estimate.col(t), theta, known_params, known_tv_params) -
-          approx_model.T.slice(t * Tgtv) * mode_estimate.col(t);
-      }
-      for (unsigned int t = 0; t < approx_model.H.n_slices; t++) {
-        approx_model.H.slice(t) = 
-          H_fn(t, mode_estimate.col(t), theta, known_params, known_tv_params);
-      }
-      for (unsigned int t = 0; t < approx_model.R.n_slices; t++) {
-        approx_model.R.slice(t) = 
-          R_fn(t, mode_estimate.col(t), theta, known_params, known_tv_params);
-      }
-      approx_model.compute_HH();
-      approx_model.compute_RR();
+      linearize(mode_estimate, mode_estimate);
       
       // compute new value of mode
-      arma::mat mode_estimate_new = approx_model.fast_smoother().head_cols(n);
-      double ll_new = log_signal_pdf(mode_estimate_new);
+      smooth_approx_model();
+      arma::mat mode_estimate_new = workspace.smooth.head_cols(n);
+      double ll_new = log_signal_pdf(mode_estimate_new, factors);
       abs_diff = ll_new - ll;
       rel_diff = abs_diff / std::abs(ll);
       if (!arma::is_finite(mode_estimate_new) || !arma::is_finite(ll_new)) {
@@ -119,7 +259,7 @@ void ssm_nlg::approximate() {
           step_size = step_size / 2.0;
           mode_estimate = (1.0 - step_size) * mode_estimate_old + step_size * mode_estimate_new;
           
-          ll_new = log_signal_pdf(mode_estimate);
+          ll_new = log_signal_pdf(mode_estimate, factors);
           abs_diff = ll_new - ll;
           rel_diff = abs_diff / std::abs(ll);
           ii++;
@@ -146,34 +286,8 @@ void ssm_nlg::approximate_for_is(const arma::mat& mode_estimate) {
   
   approx_model.a1 = a1_fn(theta, known_params);
   approx_model.P1 = P1_fn(theta, known_params);
-  for (unsigned int t = 0; t < approx_model.Z.n_slices; t++) {
-    approx_model.Z.slice(t) = 
-      Z_gn(t, mode_estimate.col(t), theta, known_params, known_tv_params);
-  }
-  
-  for (unsigned int t = 0; t < approx_model.T.n_slices; t++) {
-    approx_model.T.slice(t) = 
-      T_gn(t, mode_estimate.col(t), theta, known_params, known_tv_params);
-  }
-  
-  for (unsigned int t = 0; t < n; t++) {
-    approx_model.D.col(t) = 
-      Z_fn(t, mode_estimate.col(t), theta, known_params, known_tv_params) -
-      approx_model.Z.slice(t * Zgtv) * mode_estimate.col(t);
-    approx_model.C.col(t) =  
-      T_fn(t, mode_estimate.col(t), theta, known_params, known_tv_params) -
-      approx_model.T.slice(t * Tgtv) * mode_estimate.col(t);
-  }
-  for (unsigned int t = 0; t < approx_model.H.n_slices; t++) {
-    approx_model.H.slice(t) = 
-      H_fn(t, mode_estimate.col(t), theta, known_params, known_tv_params);
-  }
-  for (unsigned int t = 0; t < approx_model.R.n_slices; t++) {
-    approx_model.R.slice(t) = 
-      R_fn(t, mode_estimate.col(t), theta, known_params, known_tv_params);
-  }
-  approx_model.compute_HH();
-  approx_model.compute_RR();
+  linearize(mode_estimate, mode_estimate);
+  precision.valid = false;
   approx_state = 2;
 }
 
@@ -189,30 +303,10 @@ void ssm_nlg::approximate_by_ekf() {
   approx_model.a1 = a1_fn(theta, known_params);
   approx_model.P1 = P1_fn(theta, known_params);
   
-  for (unsigned int t = 0; t < approx_model.Z.n_slices; t++) {
-    approx_model.Z.slice(t) = Z_gn(t, at.col(t), theta, known_params, known_tv_params);
-  }
-  for (unsigned int t = 0; t < approx_model.H.n_slices; t++) {
-    approx_model.H.slice(t) = H_fn(t, at.col(t), theta, known_params, known_tv_params);
-  }
-  for (unsigned int t = 0; t < approx_model.T.n_slices; t++) {
-    approx_model.T.slice(t) = T_gn(t, att.col(t), theta, known_params, known_tv_params);
-  }
-  
-  for (unsigned int t = 0; t < approx_model.R.n_slices; t++) {
-    approx_model.R.slice(t) = R_fn(t, att.col(t), theta, known_params, known_tv_params);
-  }
-  for (unsigned int t = 0; t < n; t++) {
-    approx_model.D.col(t) = Z_fn(t, at.col(t), theta, known_params, known_tv_params) -
-      approx_model.Z.slice(t * Zgtv) * at.col(t);
-    approx_model.C.col(t) =  T_fn(t, att.col(t), theta, known_params, known_tv_params) -
-      approx_model.T.slice(t * Tgtv) * att.col(t);
-  }
-  
-  approx_model.compute_HH();
-  approx_model.compute_RR();
+  linearize(at, att);
 }
-// method = 1 psi-APF, 2 = BSF, 3 = SPDK (not applicable), 4 = IEKF (either approx or IEKF-PF)
+// method = 1 psi-APF, 2 = BSF, 3 = SPDK (not applicable), 4 = IEKF (either approx or IEKF-PF),
+// 5 = UKF (approx only)
 arma::vec ssm_nlg::log_likelihood(
     const unsigned int method, 
     const unsigned int nsim, 
@@ -229,6 +323,9 @@ arma::vec ssm_nlg::log_likelihood(
       if (method == 4) {
         loglik(0) = ekf_filter(nsim, alpha, weights, indices);
         loglik(1) = loglik(0);
+      } else if (method == 5) {
+        loglik(0) = ukf_filter(nsim, alpha, weights, indices);
+        loglik(1) = loglik(0);
       } else { // note does not check if method == 3...
         // check that approx_model matches theta
         if(approx_state < 2) {
@@ -236,7 +333,7 @@ arma::vec ssm_nlg::log_likelihood(
             approximate(); 
           }
           // compute the log-likelihood of the approximate model
-          double gaussian_loglik = approx_model.log_likelihood();
+          double gaussian_loglik = approx_model_loglik();
           // compute normalized mode-based correction terms 
           update_scales();
           // log-likelihood approximation
@@ -251,6 +348,9 @@ arma::vec ssm_nlg::log_likelihood(
     if (method == 4) {
       loglik(0)  = ekf_loglik();
       loglik(1) = loglik(0);
+    } else if (method == 5) {
+      loglik(0)  = ukf_loglik();
+      loglik(1) = loglik(0);
     } else {
       // check that approx_model matches theta
       if(approx_state < 2) {
@@ -258,7 +358,7 @@ arma::vec ssm_nlg::log_likelihood(
           approximate(); 
         }
         // compute the log-likelihood of the approximate model
-        double gaussian_loglik = approx_model.log_likelihood();
+        double gaussian_loglik = approx_model_loglik();
         // compute normalized mode-based correction terms 
         update_scales();
         // log-likelihood approximation
@@ -283,11 +383,13 @@ double ssm_nlg::ekf(arma::mat& at, arma::mat& att, arma::cube& Pt, arma::cube& P
   
   for (unsigned int t = 0; t < n; t++) {
     
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
+    const arma::uvec& na_y = y_pattern.missing(t);
     
     if (na_y.n_elem < p) {
       
-      arma::mat Zg = Z_gn(t, at.col(t), theta, known_params, known_tv_params);
+      arma::vec Zt;
+      arma::mat Zg;
+      Z_and_gn(t, at.col(t), Zt, Zg);
       arma::mat HHt = H_fn(t, at.col(t), theta, known_params, known_tv_params);
       HHt = HHt * HHt.t();
       
@@ -307,8 +409,7 @@ double ssm_nlg::ekf(arma::mat& at, arma::mat& att, arma::cube& Pt, arma::cube& P
       chol_ok = arma::chol(cholF, Ft);
       if (!chol_ok) return -std::numeric_limits<double>::infinity();
       
-      arma::vec vt = y.col(t) - 
-        Z_fn(t, at.col(t), theta, known_params, known_tv_params);
+      arma::vec vt = y.col(t) - Zt;
       vt.rows(na_y).zeros();
       
       arma::mat inv_cholF = arma::inv(arma::trimatu(cholF));
@@ -318,7 +419,7 @@ double ssm_nlg::ekf(arma::mat& at, arma::mat& att, arma::cube& Pt, arma::cube& P
       unsigned int i = 0;
       while (diff > 1e-4 && i < iekf_iter) {
         i++;
-        Zg = Z_gn(t, atthat, theta, known_params, known_tv_params);
+        Z_and_gn(t, atthat, Zt, Zg);
         HHt = H_fn(t, atthat, theta, known_params, known_tv_params);
         HHt = HHt * HHt.t();
         
@@ -336,8 +437,7 @@ double ssm_nlg::ekf(arma::mat& at, arma::mat& att, arma::cube& Pt, arma::cube& P
         chol_ok = arma::chol(cholF, Ft);
         if(!chol_ok) return -std::numeric_limits<double>::infinity();
         
-        vt = y.col(t) - 
-          Z_fn(t, atthat, theta, known_params, known_tv_params) - 
+        vt = y.col(t) - Zt - 
           Zg * (at.col(t) - atthat);
         vt.rows(na_y).zeros();
         
@@ -362,8 +462,10 @@ double ssm_nlg::ekf(arma::mat& at, arma::mat& att, arma::cube& Pt, arma::cube& P
       Ptt.slice(t) = Pt.slice(t);
     } 
     
-    at.col(t + 1) = T_fn(t, att.col(t), theta, known_params, known_tv_params);
-    arma::mat Tg = T_gn(t, att.col(t), theta, known_params, known_tv_params);
+    arma::vec Tt;
+    arma::mat Tg;
+    T_and_gn(t, att.col(t), Tt, Tg);
+    at.col(t + 1) = Tt;
     arma::mat Rt = R_fn(t, att.col(t), theta, known_params, known_tv_params);
     Pt.slice(t + 1) = Tg * Ptt.slice(t) * Tg.t() + Rt * Rt.t();
   }
@@ -383,12 +485,14 @@ double ssm_nlg::ekf_loglik() const {
   
   for (unsigned int t = 0; t < n; t++) {
     
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
+    const arma::uvec& na_y = y_pattern.missing(t);
     
     arma::vec att = at;
     arma::mat Ptt = Pt;
     if (na_y.n_elem < p) {
-      arma::mat Zg = Z_gn(t, at, theta, known_params, known_tv_params);
+      arma::vec Zt;
+      arma::mat Zg;
+      Z_and_gn(t, at, Zt, Zg);
       arma::mat HHt = H_fn(t, at, theta, known_params, known_tv_params);
       HHt = HHt * HHt.t();
       
@@ -407,8 +511,7 @@ double ssm_nlg::ekf_loglik() const {
       chol_ok = arma::chol(cholF, Ft);
       if (!chol_ok) return -std::numeric_limits<double>::infinity();
       
-      arma::vec vt = y.col(t) - 
-        Z_fn(t, at, theta, known_params, known_tv_params);
+      arma::vec vt = y.col(t) - Zt;
       vt.rows(na_y).zeros();
       
       arma::mat inv_cholF = arma::inv(arma::trimatu(cholF));
@@ -419,7 +522,7 @@ double ssm_nlg::ekf_loglik() const {
       unsigned int i = 0;
       while (diff > 1e-4 && i < iekf_iter) {
         i++;
-        Zg = Z_gn(t, atthat, theta, known_params, known_tv_params);
+        Z_and_gn(t, atthat, Zt, Zg);
         HHt = H_fn(t, atthat, theta, known_params, known_tv_params);
         HHt = HHt * HHt.t();
         
@@ -438,9 +541,8 @@ double ssm_nlg::ekf_loglik() const {
         chol_ok = arma::chol(cholF, Ft);
         if (!chol_ok) return -std::numeric_limits<double>::infinity();
         
-        vt = y.col(t) - 
-          Z_fn(t, atthat, theta, known_params, known_tv_params) - 
-          Zg * (at.col(t) - atthat);
+        vt = y.col(t) - Zt - 
+          Zg * (at - atthat);
         vt.rows(na_y).zeros();
         
         inv_cholF = arma::inv(arma::trimatu(cholF));
@@ -462,9 +564,8 @@ double ssm_nlg::ekf_loglik() const {
         2.0 * arma::accu(arma::log(arma::diagvec(cholF))) + Fv.t() * Fv);
     }
     
-    at = T_fn(t, att, theta, known_params, known_tv_params);
-    
-    arma::mat Tg = T_gn(t, att, theta, known_params, known_tv_params);
+    arma::mat Tg;
+    T_and_gn(t, att, at, Tg);
     arma::mat Rt = R_fn(t, att, theta, known_params, known_tv_params);
     Pt = Tg * Ptt * Tg.t() + Rt * Rt.t();
     
@@ -488,12 +589,14 @@ double ssm_nlg::ekf_smoother(arma::mat& at, arma::cube& Pt) const {
   double logLik = 0.0;
   arma::uvec uvect(1, arma::fill::zeros);
   for (unsigned int t = 0; t < n; t++) {
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
+    const arma::uvec& na_y = y_pattern.missing(t);
     arma::mat Ptt = Pt.slice(t);
     
     if (na_y.n_elem < p) {
       
-      arma::mat Zg = Z_gn(t, at.col(t), theta, known_params, known_tv_params);
+      arma::vec Zt;
+      arma::mat Zg;
+      Z_and_gn(t, at.col(t), Zt, Zg);
       arma::mat HHt = H_fn(t, at.col(t), theta, known_params, known_tv_params);
       HHt = HHt * HHt.t();
       if (na_y.n_elem > 0) {
@@ -511,8 +614,7 @@ double ssm_nlg::ekf_smoother(arma::mat& at, arma::cube& Pt) const {
       chol_ok = arma::chol(cholF, Ft);
       if (!chol_ok) return -std::numeric_limits<double>::infinity();
       
-      vt.col(t) = y.col(t) - 
-        Z_fn(t, at.col(t), theta, known_params, known_tv_params);
+      vt.col(t) = y.col(t) - Zt;
       uvect(0) = t;
       vt.submat(na_y, uvect).zeros();
       
@@ -526,7 +628,7 @@ double ssm_nlg::ekf_smoother(arma::mat& at, arma::cube& Pt) const {
       while (diff > 1e-4 && i < iekf_iter) {
         i++;
         
-        Zg = Z_gn(t, atthat, theta, known_params, known_tv_params);
+        Z_and_gn(t, atthat, Zt, Zg);
         HHt = H_fn(t, atthat, theta, known_params, known_tv_params);
         HHt = HHt * HHt.t();
         
@@ -544,8 +646,7 @@ double ssm_nlg::ekf_smoother(arma::mat& at, arma::cube& Pt) const {
         chol_ok = arma::chol(cholF, Ft);
         if (!chol_ok) return -std::numeric_limits<double>::infinity();
         
-        vt.col(t) = y.col(t) - 
-          Z_fn(t, atthat, theta, known_params, known_tv_params) - 
+        vt.col(t) = y.col(t) - Zt - 
           Zg * (at.col(t) - atthat);
         vt.rows(na_y).zeros();
         
@@ -569,8 +670,10 @@ double ssm_nlg::ekf_smoother(arma::mat& at, arma::cube& Pt) const {
       att.col(t) = at.col(t);
     }
     
-    at.col(t + 1) = T_fn(t, att.col(t), theta, known_params, known_tv_params);
-    arma::mat Tg = T_gn(t, att.col(t), theta, known_params, known_tv_params);
+    arma::vec Tt;
+    arma::mat Tg;
+    T_and_gn(t, att.col(t), Tt, Tg);
+    at.col(t + 1) = Tt;
     arma::mat Rt = R_fn(t, att.col(t), theta, known_params, known_tv_params);
     Pt.slice(t + 1) = Tg * Ptt * Tg.t() + Rt * Rt.t();
   }
@@ -581,7 +684,7 @@ double ssm_nlg::ekf_smoother(arma::mat& at, arma::cube& Pt) const {
   
   for (int t = (n - 1); t >= 0; t--) {
     arma::mat Tg = T_gn(t, att.col(t), theta, known_params, known_tv_params);
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
+    const arma::uvec& na_y = y_pattern.missing(t);
     if (na_y.n_elem < p) {
       arma::mat Zg = Z_gn(t, at.col(t), theta, known_params, known_tv_params);
       Zg.rows(na_y).zeros();
@@ -617,12 +720,14 @@ double ssm_nlg::ekf_fast_smoother(arma::mat& at) const {
   
   for (unsigned int t = 0; t < n; t++) {
     
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
+    const arma::uvec& na_y = y_pattern.missing(t);
     arma::mat Ptt = Pt.slice(t);
     
     if (na_y.n_elem < p) {
       
-      arma::mat Zg = Z_gn(t, at.col(t), theta, known_params, known_tv_params);
+      arma::vec Zt;
+      arma::mat Zg;
+      Z_and_gn(t, at.col(t), Zt, Zg);
       arma::mat HHt = H_fn(t, at.col(t), theta, known_params, known_tv_params);
       HHt = HHt * HHt.t();
       
@@ -641,8 +746,7 @@ double ssm_nlg::ekf_fast_smoother(arma::mat& at) const {
       chol_ok = arma::chol(cholF, Ft);
       if (!chol_ok) return -std::numeric_limits<double>::infinity();
       
-      vt.col(t) = y.col(t) - 
-        Z_fn(t, at.col(t), theta, known_params, known_tv_params);
+      vt.col(t) = y.col(t) - Zt;
       vt.rows(na_y).zeros();
       
       arma::mat inv_cholF = arma::inv(arma::trimatu(cholF));
@@ -655,7 +759,7 @@ double ssm_nlg::ekf_fast_smoother(arma::mat& at) const {
       unsigned int i = 0;
       while (diff > 1e-4 && i < iekf_iter) {
         i++;
-        Zg = Z_gn(t, atthat, theta, known_params, known_tv_params);
+        Z_and_gn(t, atthat, Zt, Zg);
         HHt = H_fn(t, atthat, theta, known_params, known_tv_params);
         HHt = HHt * HHt.t();
         
@@ -674,8 +778,7 @@ double ssm_nlg::ekf_fast_smoother(arma::mat& at) const {
         chol_ok = arma::chol(cholF, Ft);
         if (!chol_ok) return -std::numeric_limits<double>::infinity();
         
-        vt.col(t) = y.col(t) - 
-          Z_fn(t, atthat, theta, known_params, known_tv_params) - 
+        vt.col(t) = y.col(t) - Zt - 
           Zg * (at.col(t) - atthat);
         vt.rows(na_y).zeros();
         
@@ -699,8 +802,10 @@ double ssm_nlg::ekf_fast_smoother(arma::mat& at) const {
       att.col(t) = at.col(t);
     }
     
-    at.col(t + 1) = T_fn(t, att.col(t), theta, known_params, known_tv_params);
-    arma::mat Tg = T_gn(t, att.col(t), theta, known_params, known_tv_params);
+    arma::vec Tt;
+    arma::mat Tg;
+    T_and_gn(t, att.col(t), Tt, Tg);
+    at.col(t + 1) = Tt;
     arma::mat Rt = R_fn(t, att.col(t), theta, known_params, known_tv_params);
     Pt.slice(t + 1) = Tg * Ptt * Tg.t() + Rt * Rt.t();
     
@@ -710,7 +815,7 @@ double ssm_nlg::ekf_fast_smoother(arma::mat& at) const {
   arma::vec rt(m, arma::fill::zeros);
   for (int t = (n - 1); t >= 0; t--) {
     arma::mat Tg = T_gn(t, att.col(t), theta, known_params, known_tv_params);
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
+    const arma::uvec& na_y = y_pattern.missing(t);
     if (na_y.n_elem < p) {
       arma::mat Zg = Z_gn(t, at.col(t), theta, known_params, known_tv_params);
       Zg.rows(na_y).zeros();
@@ -728,54 +833,53 @@ double ssm_nlg::ekf_fast_smoother(arma::mat& at) const {
 // Unscented Kalman filter, Särkkä (2013) p.107 (UKF) and
 // Note that the initial distribution is given for alpha_1
 // so we first do update instead of prediction
-double ssm_nlg::ukf(arma::mat& at, arma::mat& att, arma::cube& Pt, 
-  arma::cube& Ptt, const double alpha, const double beta, const double kappa) const {
-  
-  // // Parameters of UKF, currently fixed for simplicity
-  // These are from Särkkä?
-  // double alpha = 1.0;
-  // double beta = 0.0;
-  // double kappa = 4.0;
-  // van der Merwe et al:
-  // alpha something small...
-  // beta = 4? 
-  // kappa = 0
-  //DK? alpha=1, beta=0, kappa 3-m?
-  const double LOG2PI = std::log(2.0 * M_PI);
-  double logLik = 0.0;
+void ssm_nlg::set_ukf_parameters(const double alpha, const double beta, 
+  const double kappa) {
   
   double lambda = alpha * alpha * (m + kappa) - m;
-  
   unsigned int n_sigma = 2 * m + 1;
-  arma::vec wm(n_sigma);
-  wm(0) = lambda / (lambda + m);
-  wm.subvec(1, n_sigma - 1).fill(1.0 / (2.0 * (lambda + m)));
-  arma::vec wc = wm;
-  wc(0) +=  1.0 - alpha * alpha + beta;
+  ukf_wm.set_size(n_sigma);
+  ukf_wm(0) = lambda / (lambda + m);
+  ukf_wm.subvec(1, n_sigma - 1).fill(1.0 / (2.0 * (lambda + m)));
+  ukf_wc = ukf_wm;
+  ukf_wc(0) +=  1.0 - alpha * alpha + beta;
+  ukf_scale = std::sqrt(m + lambda);
+}
+
+// Square-root unscented Kalman filter (van der Merwe and Wan, 2001), 
+// which propagates the Cholesky factors of the covariance matrices using 
+// QR decompositions and rank-one updates
+double ssm_nlg::ukf(arma::mat& at, arma::mat& att, arma::cube& Pt, 
+  arma::cube& Ptt) const {
   
+  const double LOG2PI = std::log(2.0 * M_PI);
+  double logLik = 0.0;
   
-  double sqrt_m_lambda = std::sqrt(m + lambda);
+  unsigned int n_sigma = 2 * m + 1;
+  // the sigma points other than the first have common positive weight, 
+  // the first one is handled with a rank-one update (or downdate)
+  double sqrt_wc = std::sqrt(ukf_wc(1));
+  double sign_wc0 = ukf_wc(0) < 0.0 ? -1.0 : 1.0;
+  double sqrt_wc0 = std::sqrt(std::abs(ukf_wc(0)));
   
   at.col(0) = a1_fn(theta, known_params);
   Pt.slice(0) = P1_fn(theta, known_params);
+  arma::mat cholP = psd_chol(Pt.slice(0));
   
+  arma::mat sigma(m, n_sigma);
   for (unsigned int t = 0; t < n; t++) {
     // update step
     
-    // compute cholesky of Pt
-    arma::mat cholP(m, m);
-    cholP = psd_chol(Pt.slice(t));
-    
     // form the sigma points
-    arma::mat sigma(m, n_sigma);
     sigma.col(0) = at.col(t);
     for (unsigned int i = 1; i <= m; i++) {
-      sigma.col(i) = at.col(t) + sqrt_m_lambda * cholP.col(i - 1);
-      sigma.col(i + m) = at.col(t) - sqrt_m_lambda * cholP.col(i - 1);
+      sigma.col(i) = at.col(t) + ukf_scale * cholP.col(i - 1);
+      sigma.col(i + m) = at.col(t) - ukf_scale * cholP.col(i - 1);
     }
     
-    arma::uvec obs_y = arma::find_finite(y.col(t));
+    const arma::uvec& obs_y = y_pattern.observed(t);
     
+    arma::mat cholPtt = cholP;
     if (obs_y.n_elem > 0) {
       
       // propagate sigma points
@@ -783,55 +887,83 @@ double ssm_nlg::ukf(arma::mat& at, arma::mat& att, arma::cube& Pt,
       for (unsigned int i = 0; i < n_sigma; i++) {
         sigma_y.col(i) = Z_fn(t, sigma.col(i), theta, known_params, known_tv_params).rows(obs_y);
       }
-      arma::vec pred_mean = sigma_y * wm;
-      arma::mat pred_var = H_fn(t, at.col(t), theta, known_params, known_tv_params).submat(obs_y, obs_y);
+      arma::vec pred_mean = sigma_y * ukf_wm;
+      sigma_y.each_col() -= pred_mean;
+      
+      // Cholesky factor of the prediction variance
+      arma::mat Ht = H_fn(t, at.col(t), theta, known_params, known_tv_params);
+      arma::mat cholF = qr_chol(arma::join_rows(
+        sqrt_wc * sigma_y.tail_cols(n_sigma - 1), Ht.rows(obs_y)));
+      if (!chol_update(cholF, sqrt_wc0 * sigma_y.col(0), sign_wc0) || 
+        !arma::all(cholF.diag() > 0)) {
+        return -std::numeric_limits<double>::infinity();
+      }
+      
       arma::mat pred_cov(m, obs_y.n_elem, arma::fill::zeros);
       for (unsigned int i = 0; i < n_sigma; i++) {
-        arma::vec tmp = sigma_y.col(i) - pred_mean;
-        pred_var += wc(i) * tmp * tmp.t();
-        pred_cov += wc(i) * (sigma.col(i) - at.col(t)) * tmp.t();
+        pred_cov += ukf_wc(i) * (sigma.col(i) - at.col(t)) * sigma_y.col(i).t();
       }
       // filtered estimates
       arma::vec v = arma::mat(y.rows(obs_y)).col(t) - pred_mean;
-      arma::mat K = arma::solve(pred_var, pred_cov.t()).t();
+      // K = pred_cov * inv(cholF * cholF')
+      arma::mat K = arma::solve(arma::trimatu(cholF.t()), 
+        arma::solve(arma::trimatl(cholF), pred_cov.t())).t();
       att.col(t) = at.col(t) + K * v;
-      Ptt.slice(t) = Pt.slice(t) - K * pred_var * K.t();
       
-      arma::mat cholF = arma::chol(pred_var);
-      arma::mat inv_cholF = arma::inv(arma::trimatu(cholF));
-      arma::vec Fv = inv_cholF.t() * v; 
+      // Ptt = Pt - K * F * K', one downdate per column of K * cholF
+      arma::mat U = K * cholF;
+      for (unsigned int i = 0; i < U.n_cols; i++) {
+        if (!chol_update(cholPtt, U.col(i), -1.0)) {
+          // lost positive definiteness due to rounding errors
+          cholPtt = psd_chol(cholP * cholP.t() - U * U.t());
+          break;
+        }
+      }
+      
+      arma::vec Fv = arma::solve(arma::trimatl(cholF), v); 
       logLik -= 0.5 * arma::as_scalar(obs_y.n_elem * LOG2PI + 
         2.0 * arma::accu(arma::log(arma::diagvec(cholF))) + Fv.t() * Fv);
     } else {
       att.col(t) = at.col(t);
-      Ptt.slice(t) = Pt.slice(t);
     }
+    Ptt.slice(t) = cholPtt * cholPtt.t();
     
     // prediction
-    // compute cholesky of Ptt
-    arma::mat cholPtt = psd_chol(Ptt.slice(t));
-    
     // form the sigma points and propagate
     sigma.col(0) = T_fn(t, att.col(t), theta, known_params, known_tv_params);
     for (unsigned int i = 1; i <= m; i++) {
-      sigma.col(i) = T_fn(t, att.col(t) + sqrt_m_lambda * cholPtt.col(i - 1), 
+      sigma.col(i) = T_fn(t, att.col(t) + ukf_scale * cholPtt.col(i - 1), 
         theta, known_params, known_tv_params);
-      sigma.col(i + m) = T_fn(t, att.col(t) - sqrt_m_lambda * cholPtt.col(i - 1), 
+      sigma.col(i + m) = T_fn(t, att.col(t) - ukf_scale * cholPtt.col(i - 1), 
         theta, known_params, known_tv_params);
     }
     
-    at.col(t + 1) = sigma * wm;
+    at.col(t + 1) = sigma * ukf_wm;
+    sigma.each_col() -= at.col(t + 1);
     
     arma::mat Rt = R_fn(t, att.col(t), theta, known_params, known_tv_params);
-    Pt.slice(t + 1) = Rt * Rt.t();
-    for (unsigned int i = 0; i < n_sigma; i++) {
-      arma::vec tmp = sigma.col(i) - at.col(t + 1);
-      Pt.slice(t + 1) += wc(i) * tmp * tmp.t();
+    arma::mat cholQR = qr_chol(arma::join_rows(sqrt_wc * sigma.tail_cols(n_sigma - 1), Rt));
+    cholP = cholQR;
+    if (chol_update(cholP, sqrt_wc0 * sigma.col(0), sign_wc0)) {
+      Pt.slice(t + 1) = cholP * cholP.t();
+    } else {
+      // lost positive definiteness due to rounding errors
+      Pt.slice(t + 1) = cholQR * cholQR.t() + ukf_wc(0) * sigma.col(0) * sigma.col(0).t();
+      cholP = psd_chol(Pt.slice(t + 1));
     }
   }
   return logLik;
 }
 
+double ssm_nlg::ukf_loglik() const {
+  
+  arma::mat at(m, n + 1);
+  arma::mat att(m, n);
+  arma::cube Pt(m, m, n + 1);
+  arma::cube Ptt(m, m, n);
+  return ukf(at, att, Pt, Ptt);
+}
+
 
 // compute _normalized_ mode-based scaling terms
 // log[g(y_t | ^alpha_t) f(^alpha_t | ^alpha_t-1) / 
@@ -840,7 +972,7 @@ void ssm_nlg::update_scales()  {
   
   scales.zeros();
   for(unsigned int t = 0; t < n; t++) { 
-    arma::uvec na_y = arma::find_nonfinite(y.col(t));
+    const arma::uvec& na_y = y_pattern.missing(t);
     if (na_y.n_elem < p) {
       scales(t) = dmvnorm(y.col(t), Z_fn(t, mode_estimate.col(t), theta, known_params, known_tv_params),
         H_fn(t, mode_estimate.col(t), theta, known_params, known_tv_params), true, true) -
@@ -865,52 +997,85 @@ void ssm_nlg::update_scales()  {
 arma::vec ssm_nlg::log_weights(const unsigned int t, const arma::cube& alpha, 
   const arma::mat& alpha_prev) const {
   
-  arma::vec weights(alpha.n_slices, arma::fill::zeros);
+  unsigned int nsim = alpha.n_slices;
+  arma::vec weights(nsim, arma::fill::zeros);
   
-  arma::uvec na_y = arma::find_nonfinite(y.col(t));
-  if (na_y.n_elem < p) {
+  if (y_pattern.any_observed(t)) {
     
-    // original H depends on time or state <=> approx H depends on time or state, or missing values
-    if(Htv == 1 || na_y.n_elem > 0) {
-      for (unsigned int i = 0; i < alpha.n_slices; i++) {
+    arma::mat alpha_t(m, nsim);
+    for (unsigned int i = 0; i < nsim; i++) {
+      alpha_t.col(i) = alpha.slice(i).col(t);
+    }
+    arma::mat Z_mean(p, nsim);
+    observation_mean(t, alpha_t, Z_mean);
+    
+    // original H depends on time or state <=> approx H depends on time or state
+    if(Htv == 1 && Hsd == 1) {
+      for (unsigned int i = 0; i < nsim; i++) {
         weights(i) = 
-          dmvnorm(y.col(t), Z_fn(t, alpha.slice(i).col(t), theta, known_params, known_tv_params), 
-            H_fn(t, alpha.slice(i).col(t), theta, known_params, known_tv_params), true, true) -
-              dmvnorm(y.col(t), approx_model.D.col(t) + approx_model.Z.slice(t * approx_model.Ztv) * alpha.slice(i).col(t),  
+          dmvnorm(y.col(t), Z_mean.col(i), 
+            H_fn(t, alpha_t.col(i), theta, known_params, known_tv_params), true, true) -
+              dmvnorm(y.col(t), approx_model.D.col(t) + approx_model.Z.slice(t * approx_model.Ztv) * alpha_t.col(i),  
                 approx_model.H.slice(t * approx_model.Htv), true, true);
       }
+    } else if (Htv == 1) {
+      // H depends only on time, so both factors are common to all particles
+      arma::mat H = H_fn(t, alpha_t.col(0), theta, known_params, known_tv_params);
+      arma::mat Linv, approx_Linv;
+      arma::uvec index, approx_index;
+      double constant = precompute_dmvnorm_obs(H, y_pattern.observed(t), Linv, index);
+      double approx_constant = precompute_dmvnorm_obs(approx_model.H.slice(t * approx_model.Htv), 
+        y_pattern.observed(t), approx_Linv, approx_index);
+      for (unsigned int i = 0; i < nsim; i++) {
+        weights(i) = fast_dmvnorm(y.col(t), Z_mean.col(i), Linv, index, constant) -
+          fast_dmvnorm(y.col(t), approx_model.D.col(t) + 
+            approx_model.Z.slice(t * approx_model.Ztv) * alpha_t.col(i), 
+            approx_Linv, approx_index, approx_constant);
+      }
     } else {
-      arma::mat H = H_fn(t, alpha.slice(0).col(t), theta, known_params, known_tv_params);
-      arma::uvec nonzero = arma::find(H.diag() > (std::numeric_limits<double>::epsilon() * H.n_cols * H.diag().max()));
-      arma::mat Linv(nonzero.n_elem, nonzero.n_elem);
-      double constant = precompute_dmvnorm(H, Linv, nonzero);
+      // factors of the approximating model are cached per missingness pattern
+      arma::mat H = H_fn(t, alpha_t.col(0), theta, known_params, known_tv_params);
+      arma::mat Linv;
+      arma::uvec index;
+      double constant = precompute_dmvnorm_obs(H, y_pattern.observed(t), Linv, index);
       
-      arma::mat H_a = approx_model.H.slice(0);
-      arma::uvec nonzero_a = arma::find(H_a.diag() > (std::numeric_limits<double>::epsilon() * H_a.n_cols * H_a.diag().max()));
-      arma::mat Linv_a(nonzero_a.n_elem, nonzero_a.n_elem);
-      double constant_a = precompute_dmvnorm(H_a, Linv_a, nonzero_a);
-      
-      for (unsigned int i = 0; i < alpha.n_slices; i++) {
-        weights(i) = fast_dmvnorm(y.col(t), Z_fn(t, alpha.slice(i).col(t), 
-          theta, known_params, known_tv_params), Linv, nonzero, constant) -
-            fast_dmvnorm(y.col(t), approx_model.D.col(t) + 
-            approx_model.Z.slice(t * approx_model.Ztv) * alpha.slice(i).col(t),  
-            Linv_a, nonzero_a, constant_a);
+      for (unsigned int i = 0; i < nsim; i++) {
+        weights(i) = fast_dmvnorm(y.col(t), Z_mean.col(i), Linv, index, constant) -
+            approx_model.cached_obs_density(t, y.col(t), approx_model.D.col(t) + 
+            approx_model.Z.slice(t * approx_model.Ztv) * alpha_t.col(i));
       }
     }
   }
   if(t > 0) {
-    for (unsigned int i = 0; i < alpha.n_slices; i++) {
+    arma::mat T_mean(m, nsim);
+    transition_mean(t - 1, alpha_prev, T_mean);
+    // the state covariance of the approximating model is common to all 
+    // particles, as is the original one if R does not depend on the state
+    arma::uvec states = arma::regspace<arma::uvec>(0, m - 1);
+    arma::mat approx_Linv;
+    double approx_constant = precompute_dmvnorm_cov(
+      approx_model.RR.slice((t - 1) * approx_model.Rtv), approx_Linv);
+    arma::mat Linv;
+    double constant = 0.0;
+    if (Rsd == 0) {
+      arma::mat Rt = R_fn(t - 1, alpha_prev.col(0), theta, known_params, known_tv_params);
+      constant = precompute_dmvnorm_cov(Rt * Rt.t(), Linv);
+    }
+    for (unsigned int i = 0; i < nsim; i++) {
       
-      arma::vec mean = T_fn(t - 1, alpha_prev.col(i), theta, known_params, known_tv_params);
-      arma::mat cov = R_fn(t - 1, alpha_prev.col(i), theta, known_params, known_tv_params);
-      cov = cov * cov.t();
       arma::vec approx_mean = approx_model.C.col(t - 1) + 
         approx_model.T.slice((t - 1) * approx_model.Ttv) * alpha_prev.col(i);
-      
-      weights(i) -=  dmvnorm(alpha.slice(i).col(t), approx_mean, 
-        approx_model.RR.slice((t - 1) * approx_model.Rtv), false, true) -
-          dmvnorm(alpha.slice(i).col(t), mean, cov, false, true);
+      double log_density;
+      if (Rsd == 1) {
+        arma::mat cov = R_fn(t - 1, alpha_prev.col(i), theta, known_params, known_tv_params);
+        cov = cov * cov.t();
+        log_density = dmvnorm(alpha.slice(i).col(t), T_mean.col(i), cov, false, true);
+      } else {
+        log_density = fast_dmvnorm(alpha.slice(i).col(t), T_mean.col(i), 
+          Linv, states, constant);
+      }
+      weights(i) -= fast_dmvnorm(alpha.slice(i).col(t), approx_mean, 
+        approx_Linv, states, approx_constant) - log_density;
     }
   }
   
@@ -926,13 +1091,30 @@ arma::vec ssm_nlg::log_weights(const unsigned int t, const arma::cube& alpha,
 arma::vec ssm_nlg::log_obs_density(const unsigned int t, 
   const arma::cube& alpha) const {
   
-  arma::vec weights(alpha.n_slices, arma::fill::zeros);
+  unsigned int nsim = alpha.n_slices;
+  arma::vec weights(nsim, arma::fill::zeros);
   
-  arma::uvec na_y = arma::find_nonfinite(y.col(t));
-  if (na_y.n_elem < p) {
-    for (unsigned int i = 0; i < alpha.n_slices; i++) {
-      weights(i) = dmvnorm(y.col(t), Z_fn(t, alpha.slice(i).col(t), theta, known_params, known_tv_params), 
-        H_fn(t, alpha.slice(i).col(t), theta, known_params, known_tv_params), true, true);
+  if (y_pattern.any_observed(t)) {
+    arma::mat alpha_t(m, nsim);
+    for (unsigned int i = 0; i < nsim; i++) {
+      alpha_t.col(i) = alpha.slice(i).col(t);
+    }
+    arma::mat Z_mean(p, nsim);
+    observation_mean(t, alpha_t, Z_mean);
+    if (Hsd == 1) {
+      for (unsigned int i = 0; i < nsim; i++) {
+        weights(i) = dmvnorm(y.col(t), Z_mean.col(i), 
+          H_fn(t, alpha_t.col(i), theta, known_params, known_tv_params), true, true);
+      }
+    } else {
+      arma::mat Linv;
+      arma::uvec index;
+      double constant = precompute_dmvnorm_obs(
+        H_fn(t, alpha_t.col(0), theta, known_params, known_tv_params), 
+        y_pattern.observed(t), Linv, index);
+      for (unsigned int i = 0; i < nsim; i++) {
+        weights(i) = fast_dmvnorm(y.col(t), Z_mean.col(i), Linv, index, constant);
+      }
     }
   }
   return weights;
@@ -943,7 +1125,7 @@ double ssm_nlg::log_obs_density(const unsigned int t,
   
   double weight = 0.0;
   
-  arma::uvec na_y = arma::find_nonfinite(y.col(t));
+  const arma::uvec& na_y = y_pattern.missing(t);
   if (na_y.n_elem < p) {
     weight = dmvnorm(y.col(t), Z_fn(t, alpha, theta, known_params, known_tv_params), 
       H_fn(t, alpha, theta, known_params, known_tv_params), true, true);
@@ -954,38 +1136,36 @@ double ssm_nlg::log_obs_density(const unsigned int t,
 double ssm_nlg::psi_filter(const unsigned int nsim, arma::cube& alpha, 
   arma::mat& weights, arma::umat& indices) {
   
+  workspace.set_size(m, k, nsim);
+  
   if(approx_state < 2) {
     if (approx_state < 1) {
       approximate(); 
     }
-    double gaussian_loglik = approx_model.log_likelihood();
+    double gaussian_loglik = approx_model_loglik();
     update_scales(); 
     // log-likelihood approximation
     approx_loglik = gaussian_loglik + arma::accu(scales);
   }
   
-  arma::mat alphahat(m, n + 1);
-  arma::cube Vt(m, m, n + 1);
-  arma::cube Ct(m, m, n + 1);
+  workspace.set_psi_size(m, n);
+  arma::mat& alphahat = workspace.alphahat;
+  arma::cube& Vt = workspace.Vt;
+  arma::cube& Ct = workspace.Ct;
   approx_model.smoother_ccov(alphahat, Vt, Ct);
   if (!Vt.is_finite() || !Ct.is_finite()) {
     return -std::numeric_limits<double>::infinity();
   }
   conditional_cov(Vt, Ct);
-  std::normal_distribution<> normal(0.0, 1.0);
-  
+  normal_fill(workspace.um, engine);
   for (unsigned int i = 0; i < nsim; i++) {
-    arma::vec um(m);
-    for(unsigned int j = 0; j < m; j++) {
-      um(j) = normal(engine);
-    }
-    alpha.slice(i).col(0) = alphahat.col(0) + Vt.slice(0) * um;
+    alpha.slice(i).col(0) = alphahat.col(0) + Vt.slice(0) * workspace.um.col(i);
   }
   
   std::uniform_real_distribution<> unif(0.0, 1.0);
-  arma::vec normalized_weights(nsim);
+  arma::vec& normalized_weights = workspace.normalized_weights;
   double loglik = 0.0;
-  arma::uvec na_y = arma::find_nonfinite(y.col(0));
+  const arma::uvec& na_y = y_pattern.missing(0);
   if (na_y.n_elem < p) { 
     weights.col(0) = 
       arma::exp(log_weights(0, alpha, arma::mat(m, nsim, arma::fill::zeros)) - scales(0));
@@ -1006,27 +1186,24 @@ double ssm_nlg::psi_filter(const unsigned int nsim, arma::cube& alpha,
   }
   
   for (unsigned int t = 0; t < n; t++) {
-    arma::vec r(nsim);
+    arma::vec& r = workspace.r;
     for (unsigned int i = 0; i < nsim; i++) {
       r(i) = unif(engine);
     }
-    indices.col(t) = stratified_sample(normalized_weights, r, nsim);
+    stratified_sample(normalized_weights, r, indices.colptr(t), nsim);
     
-    arma::mat alphatmp(m, nsim);
+    arma::mat& alphatmp = workspace.alphatmp;
     
     for (unsigned int i = 0; i < nsim; i++) {
       alphatmp.col(i) = alpha.slice(indices(i, t)).col(t);
     }
+    normal_fill(workspace.um, engine);
     for (unsigned int i = 0; i < nsim; i++) {
-      arma::vec um(m);
-      for(unsigned int j = 0; j < m; j++) {
-        um(j) = normal(engine);
-      }
       alpha.slice(i).col(t + 1) = alphahat.col(t + 1) +
-        Ct.slice(t + 1) * (alphatmp.col(i) - alphahat.col(t)) + Vt.slice(t + 1) * um;
+        Ct.slice(t + 1) * (alphatmp.col(i) - alphahat.col(t)) + Vt.slice(t + 1) * workspace.um.col(i);
     }
     
-    if (t < (n - 1) && arma::uvec(arma::find_nonfinite(y.col(t + 1))).n_elem < p) {
+    if (t < (n - 1) && y_pattern.any_observed(t + 1)) {
       weights.col(t + 1) = exp(log_weights(t + 1, alpha, alphatmp)  - scales(t+1));
       // double max_weight = weights.col(t + 1).max();
       // weights.col(t+1) = arma::exp(weights.col(t+1) - max_weight);
@@ -1050,24 +1227,24 @@ double ssm_nlg::psi_filter(const unsigned int nsim, arma::cube& alpha,
 double ssm_nlg::bsf_filter(const unsigned int nsim, arma::cube& alpha,
   arma::mat& weights, arma::umat& indices) {
   
+  workspace.set_size(m, k, nsim);
+  
   arma::vec a1 = a1_fn(theta, known_params);
   arma::mat P1 = P1_fn(theta, known_params);
   arma::uvec nonzero = arma::find(P1.diag() > 0);
   arma::mat L_P1 = psd_chol(P1);
-  std::normal_distribution<> normal(0.0, 1.0);
+  // normal variates of all particles are drawn at once
+  arma::mat& um = workspace.um;
+  normal_fill(um, engine);
+  um = L_P1 * um;
   for (unsigned int i = 0; i < nsim; i++) {
-    arma::vec um(m);
-    for(unsigned int j = 0; j < m; j++) {
-      um(j) = normal(engine);
-    }
-    alpha.slice(i).col(0) = a1 + L_P1 * um;
-    
+    alpha.slice(i).col(0) = a1 + um.col(i);
   }
   std::uniform_real_distribution<> unif(0.0, 1.0);
-  arma::vec normalized_weights(nsim);
+  arma::vec& normalized_weights = workspace.normalized_weights;
   double loglik = 0.0;
   
-  arma::uvec na_y = arma::find_nonfinite(y.col(0));
+  const arma::uvec& na_y = y_pattern.missing(0);
   if (na_y.n_elem < p) { 
     weights.col(0) = log_obs_density(0, alpha);
     double max_weight = weights.col(0).max();
@@ -1084,32 +1261,40 @@ double ssm_nlg::bsf_filter(const unsigned int nsim, arma::cube& alpha,
     weights.col(0).ones();
     normalized_weights.fill(1.0 / nsim);
   }
+  // buffer for the normal variates of the state equation
+  arma::mat& uk = workspace.uk;
   for (unsigned int t = 0; t < n; t++) {
     
-    arma::vec r(nsim);
+    arma::vec& r = workspace.r;
     for (unsigned int i = 0; i < nsim; i++) {
       r(i) = unif(engine);
     }
     
-    indices.col(t) = stratified_sample(normalized_weights, r, nsim);
+    stratified_sample(normalized_weights, r, indices.colptr(t), nsim);
     
-    arma::mat alphatmp(m, nsim);
+    arma::mat& alphatmp = workspace.alphatmp;
     
     for (unsigned int i = 0; i < nsim; i++) {
       alphatmp.col(i) = alpha.slice(indices(i, t)).col(t);
     }
     
-    for (unsigned int i = 0; i < nsim; i++) {
-      arma::vec uk(k);
-      for(unsigned int j = 0; j < k; j++) {
-        uk(j) = normal(engine);
+    arma::mat& state_mean = workspace.state_mean;
+    transition_mean(t, alphatmp, state_mean);
+    normal_fill(uk, engine);
+    if (Rsd == 1) {
+      for (unsigned int i = 0; i < nsim; i++) {
+        alpha.slice(i).col(t + 1) = state_mean.col(i) + 
+          R_fn(t, alphatmp.col(i), theta, known_params, known_tv_params) * uk.col(i);
+      }
+    } else {
+      state_mean += 
+        R_fn(t, alphatmp.col(0), theta, known_params, known_tv_params) * uk;
+      for (unsigned int i = 0; i < nsim; i++) {
+        alpha.slice(i).col(t + 1) = state_mean.col(i);
       }
-      alpha.slice(i).col(t + 1) = 
-        T_fn(t, alphatmp.col(i), theta, known_params, known_tv_params) + 
-        R_fn(t, alphatmp.col(i), theta, known_params, known_tv_params) * uk;
     }
     
-    if (t < (n - 1) && arma::uvec(arma::find_nonfinite(y.col(t + 1))).n_elem < p) {
+    if (t < (n - 1) && y_pattern.any_observed(t + 1)) {
       weights.col(t + 1) = log_obs_density(t + 1, alpha);
       
       double max_weight = weights.col(t + 1).max();
@@ -1135,36 +1320,80 @@ double ssm_nlg::bsf_filter(const unsigned int nsim, arma::cube& alpha,
 double ssm_nlg::ekf_filter(const unsigned int nsim, arma::cube& alpha,
   arma::mat& weights, arma::umat& indices) {
   
+  return kf_proposal_filter(nsim, alpha, weights, indices, false);
+}
+
+// Unscented particle filter (van der Merwe et al., 2000)
+double ssm_nlg::ukf_filter(const unsigned int nsim, arma::cube& alpha,
+  arma::mat& weights, arma::umat& indices) {
+  
+  return kf_proposal_filter(nsim, alpha, weights, indices, true);
+}
+
+// Log of the normalizing constant of N(mean, L L'), so that the log-density 
+// at mean + L u is the constant - 0.5 u'u. NaN if L is numerically singular.
+static double proposal_constant(const arma::mat& L) {
+  
+  arma::vec d = L.diag();
+  if (!arma::all(d > std::numeric_limits<double>::epsilon() * d.n_elem * d.max())) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  return -0.5 * d.n_elem * std::log(2.0 * M_PI) - arma::accu(arma::log(d));
+}
+
+// log-density of the proposal at x = mean + L u, which avoids the 
+// triangular inverse of dmvnorm unless L is singular
+static double proposal_density(const arma::vec& x, const arma::vec& mean, 
+  const arma::mat& L, const double constant, const arma::vec& u) {
+  
+  if (std::isnan(constant)) {
+    return dmvnorm(x, mean, L, true, true);
+  }
+  return constant - 0.5 * arma::dot(u, u);
+}
+
+// The Cholesky factor of each proposal is computed once and reused in 
+// sampling and in the proposal density, and the transition density uses 
+// factors precomputed in the same pass where R is evaluated
+double ssm_nlg::kf_proposal_filter(const unsigned int nsim, arma::cube& alpha,
+  arma::mat& weights, arma::umat& indices, const bool unscented) {
+  
+  workspace.set_size(m, k, nsim);
+  workspace.set_ekf_size(m, nsim);
+  
   arma::vec a1 = a1_fn(theta, known_params);
   arma::mat P1 = P1_fn(theta, known_params);
   
   arma::vec att1(m);
-  arma::mat Ptt1(m, m);
-  ekf_update_step(0, y.col(0), a1, P1, att1, Ptt1);
-  
-  arma::uvec nonzero = arma::find(Ptt1.diag() > 0);
-  arma::mat L = psd_chol(Ptt1);
-  std::normal_distribution<> normal(0.0, 1.0);
+  arma::mat L(m, m);
+  if (unscented) {
+    arma::mat H1 = H_fn(0, a1, theta, known_params, known_tv_params);
+    ukf_update_step(0, y.col(0), a1, psd_chol(P1), H1, att1, L);
+  } else {
+    arma::mat Ptt1(m, m);
+    ekf_update_step(0, y.col(0), a1, P1, att1, Ptt1);
+    L = psd_chol(Ptt1);
+  }
+  normal_fill(workspace.um, engine);
   for (unsigned int i = 0; i < nsim; i++) {
-    
-    arma::vec um(m);
-    for(unsigned int j = 0; j < m; j++) {
-      um(j) = normal(engine);
-    }
-    
-    alpha.slice(i).col(0) = att1 + L * um;
+    alpha.slice(i).col(0) = att1 + L * workspace.um.col(i);
     
   }
   
   std::uniform_real_distribution<> unif(0.0, 1.0);
-  arma::vec normalized_weights(nsim);
+  arma::vec& normalized_weights = workspace.normalized_weights;
+  arma::vec& log_q = workspace.proposal_const;
+  arma::uvec states = arma::regspace<arma::uvec>(0, m - 1);
   double loglik = 0.0;
-  arma::uvec na_y = arma::find_nonfinite(y.col(0));
+  const arma::uvec& na_y = y_pattern.missing(0);
   if (na_y.n_elem < p) { 
     weights.col(0) = log_obs_density(0, alpha);
+    arma::mat Linv1;
+    double constant1 = precompute_dmvnorm_cov(P1, Linv1);
+    double q1 = proposal_constant(L);
     for (unsigned int i = 0; i < nsim; i++) {
-      weights(i, 0) +=  dmvnorm(alpha.slice(i).col(0), a1, P1, false, true) -
-        dmvnorm(alpha.slice(i).col(0), att1, L, true, true);
+      weights(i, 0) += fast_dmvnorm(alpha.slice(i).col(0), a1, Linv1, states, constant1) -
+        proposal_density(alpha.slice(i).col(0), att1, L, q1, workspace.um.col(i));
     }
     
     
@@ -1184,47 +1413,98 @@ double ssm_nlg::ekf_filter(const unsigned int nsim, arma::cube& alpha,
   }
   for (unsigned int t = 0; t < n; t++) {
     
-    arma::vec r(nsim);
+    arma::vec& r = workspace.r;
     for (unsigned int i = 0; i < nsim; i++) {
       r(i) = unif(engine);
     }
     
-    indices.col(t) = stratified_sample(normalized_weights, r, nsim);
+    stratified_sample(normalized_weights, r, indices.colptr(t), nsim);
     
-    arma::mat att(m, nsim);
-    arma::cube Ptt(m, m, nsim);
-    arma::mat alphatmp(m, nsim);
+    arma::mat& att = workspace.att;
+    arma::cube& Ptt = workspace.Ptt;
+    arma::mat& alphatmp = workspace.alphatmp;
     for (unsigned int i = 0; i < nsim; i++) {
       alphatmp.col(i) = alpha.slice(indices(i, t)).col(t);
-      arma::mat Rt = R_fn(t,  alphatmp.col(i), theta, known_params, known_tv_params);
-      arma::mat Pt = Rt * Rt.t();
-      arma::vec at = T_fn(t, alphatmp.col(i), theta, known_params, known_tv_params);
+    }
+    arma::mat& state_mean = workspace.state_mean;
+    transition_mean(t, alphatmp, state_mean);
+    // the sigma points of UKF and the last prediction step need the 
+    // Cholesky factor of R R', which is obtained directly from R
+    bool factor = unscented || t == (n - 1);
+    // state-independent R and H are evaluated only once for all particles
+    arma::mat Pt;
+    arma::mat cholPt;
+    if (Rsd == 0) {
+      arma::mat Rt = R_fn(t,  alphatmp.col(0), theta, known_params, known_tv_params);
+      Pt = Rt * Rt.t();
+      if (factor) cholPt = qr_chol(Rt);
+    }
+    arma::mat HHt;
+    arma::mat Ht;
+    if (Hsd == 0 && t < (n - 1)) {
+      if (unscented) {
+        Ht = H_fn(t + 1, state_mean.col(0), theta, known_params, known_tv_params);
+      } else {
+        HHt = observed_HHt(t + 1, state_mean.col(0));
+      }
+    }
+    bool weighted = t < (n - 1) && y_pattern.any_observed(t + 1);
+    for (unsigned int i = 0; i < nsim; i++) {
+      if (Rsd == 1) {
+        arma::mat Rt = R_fn(t,  alphatmp.col(i), theta, known_params, known_tv_params);
+        Pt = Rt * Rt.t();
+        if (factor) cholPt = qr_chol(Rt);
+        if (weighted) {
+          workspace.transition_const(i) = 
+            precompute_dmvnorm_cov(Pt, workspace.transition_Linv[i]);
+        }
+      }
+      arma::vec at = state_mean.col(i);
       arma::vec tmp(m);
       if (t < (n - 1)) {
-        ekf_update_step(t + 1, y.col(t + 1), at, Pt, tmp, Ptt.slice(i));
+        if (unscented) {
+          if (Hsd == 1) {
+            Ht = H_fn(t + 1, at, theta, known_params, known_tv_params);
+          }
+          ukf_update_step(t + 1, y.col(t + 1), at, cholPt, Ht, tmp, Ptt.slice(i));
+        } else {
+          if (Hsd == 1) {
+            ekf_update_step(t + 1, y.col(t + 1), at, Pt, tmp, Ptt.slice(i));
+          } else {
+            ekf_update_step(t + 1, y.col(t + 1), at, Pt, HHt, tmp, Ptt.slice(i));
+          }
+          Ptt.slice(i) = psd_chol(Ptt.slice(i));
+        }
         att.col(i) = tmp;
-        Ptt.slice(i) = psd_chol(Ptt.slice(i));
+        log_q(i) = proposal_constant(Ptt.slice(i));
       } else {
         att.col(i) = at;
-        Ptt.slice(i) = Pt;  
+        Ptt.slice(i) = cholPt;  
       }
     }
     
+    normal_fill(workspace.um, engine);
     for (unsigned int i = 0; i < nsim; i++) {
-      arma::vec um(m);
-      for(unsigned int j = 0; j < m; j++) {
-        um(j) = normal(engine);
-      }
-      alpha.slice(i).col(t + 1) = att.col(i) + Ptt.slice(i) * um;
+      alpha.slice(i).col(t + 1) = att.col(i) + Ptt.slice(i) * workspace.um.col(i);
     } 
-    if (t < (n - 1) && arma::uvec(arma::find_nonfinite(y.col(t + 1))).n_elem < p) {
+    if (weighted) {
       weights.col(t + 1) = log_obs_density(t + 1, alpha);
+      arma::mat Linv;
+      double constant = 0.0;
+      if (Rsd == 0) {
+        constant = precompute_dmvnorm_cov(Pt, Linv);
+      }
       for (unsigned int i = 0; i < nsim; i++) {
-        arma::mat Rt = R_fn(t,  alphatmp.col(i), theta, known_params, known_tv_params);
-        arma::mat RR = Rt * Rt.t();
-        arma::vec mean = T_fn(t, alphatmp.col(i), theta, known_params, known_tv_params);
-        weights(i, t + 1) +=  dmvnorm(alpha.slice(i).col(t + 1), mean, RR, false, true) -
-          dmvnorm(alpha.slice(i).col(t + 1), att.col(i), Ptt.slice(i), true, true);
+        double log_density;
+        if (Rsd == 1) {
+          log_density = fast_dmvnorm(alpha.slice(i).col(t + 1), state_mean.col(i), 
+            workspace.transition_Linv[i], states, workspace.transition_const(i));
+        } else {
+          log_density = fast_dmvnorm(alpha.slice(i).col(t + 1), state_mean.col(i), 
+            Linv, states, constant);
+        }
+        weights(i, t + 1) += log_density - proposal_density(alpha.slice(i).col(t + 1), 
+          att.col(i), Ptt.slice(i), log_q(i), workspace.um.col(i));
       }
       double max_weight = weights.col(t + 1).max();
       weights.col(t + 1) = arma::exp(weights.col(t + 1) - max_weight);
@@ -1244,28 +1524,63 @@ double ssm_nlg::ekf_filter(const unsigned int nsim, arma::cube& alpha,
   
 }
 
-void ssm_nlg::ekf_update_step(const unsigned int t, const arma::vec y, 
+arma::mat ssm_nlg::observed_HHt(const unsigned int t, const arma::vec& at) const {
+  
+  const arma::uvec& na_y = y_pattern.missing(t);
+  arma::mat HHt = H_fn(t, at, theta, known_params, known_tv_params);
+  HHt = HHt * HHt.t();
+  HHt.submat(na_y, na_y) = arma::eye(na_y.n_elem, na_y.n_elem);
+  return HHt;
+}
+
+void ssm_nlg::ekf_update_step(const unsigned int t, const arma::vec& y, 
   const arma::vec& at, const arma::mat& Pt, arma::vec& att, arma::mat& Ptt) const {
   
-  arma::uvec na_y = arma::find_nonfinite(y);
+  if (y_pattern.any_observed(t)) {
+    ekf_update_step(t, y, at, Pt, observed_HHt(t, at), att, Ptt);
+  } else {
+    att = at;
+    Ptt = Pt;
+  } 
+}
+
+void ssm_nlg::ekf_update_step(const unsigned int t, const arma::vec& y, 
+  const arma::vec& at, const arma::mat& Pt, const arma::mat& HHt, 
+  arma::vec& att, arma::mat& Ptt) const {
+  
+  const arma::uvec& na_y = y_pattern.missing(t);
   
   if (na_y.n_elem < p) {
-    arma::mat Zg = Z_gn(t, at, theta, known_params, known_tv_params);
+    arma::vec Zt;
+    arma::mat Zg;
+    Z_and_gn(t, at, Zt, Zg);
     Zg.rows(na_y).zeros();
-    arma::mat HHt = H_fn(t, at, theta, known_params, known_tv_params);
-    HHt = HHt * HHt.t();
-    HHt.submat(na_y, na_y) = arma::eye(na_y.n_elem, na_y.n_elem);
     
-    arma::mat Ft = Zg * Pt * Zg.t() + HHt;
-    
-    arma::mat cholF = arma::chol(Ft);
-    
-    arma::vec vt = y - Z_fn(t, at, theta, known_params, known_tv_params);
+    arma::vec vt = y - Zt;
     vt.rows(na_y).zeros();
     
-    arma::mat inv_cholF = arma::inv(arma::trimatu(cholF));
-    arma::mat Kt = Pt * Zg.t() * inv_cholF * inv_cholF.t();
+    // Kt = Pt * Zg' * inv(Ft) using the Cholesky factor of Ft
+    arma::mat PZ = Pt * Zg.t();
+    arma::mat cholF = arma::chol(Zg * PZ + HHt, "lower");
+    arma::mat Kt = arma::solve(arma::trimatu(cholF.t()), 
+      arma::solve(arma::trimatl(cholF), PZ.t())).t();
     att = at + Kt * vt;
+    
+    // iterated EKF, relinearize Z at the current estimate
+    double diff = 1.0;
+    for (unsigned int i = 0; i < iekf_iter && diff > 1e-4; i++) {
+      Z_and_gn(t, att, Zt, Zg);
+      Zg.rows(na_y).zeros();
+      vt = y - Zt - Zg * (at - att);
+      vt.rows(na_y).zeros();
+      PZ = Pt * Zg.t();
+      cholF = arma::chol(Zg * PZ + HHt, "lower");
+      Kt = arma::solve(arma::trimatu(cholF.t()), 
+        arma::solve(arma::trimatl(cholF), PZ.t())).t();
+      arma::vec att_new = at + Kt * vt;
+      diff = arma::mean(arma::square(att - att_new));
+      att = att_new;
+    }
     //Ptt = Pt - Kt * Ft * Kt.t();
     // Switched to numerically better form
     arma::mat tmp = arma::eye(m, m) - Kt * Zg;
@@ -1276,26 +1591,152 @@ void ssm_nlg::ekf_update_step(const unsigned int t, const arma::vec y,
   } 
 }
 
-double ssm_nlg::log_signal_pdf(const arma::mat& alpha) const {
+// UKF update step used in the unscented particle filter. If the prediction 
+// variance of y is not numerically positive definite, the predictive 
+// distribution is returned as is, which is still a valid proposal.
+void ssm_nlg::ukf_update_step(const unsigned int t, const arma::vec& y, 
+  const arma::vec& at, const arma::mat& cholPt, const arma::mat& Ht, 
+  arma::vec& att, arma::mat& cholPtt) const {
   
-  double ll = dmvnorm(alpha.col(0), a1_fn(theta, known_params), 
-    P1_fn(theta, known_params), false, true);
-  arma::uvec na_y = arma::find_nonfinite(y.col(0));
-  if (na_y.n_elem < p) { 
-    ll += dmvnorm(y.col(0), Z_fn(0, alpha.col(0), theta, known_params, known_tv_params), 
-      H_fn(0, alpha.col(0), theta, known_params, known_tv_params), true, true);
+  att = at;
+  cholPtt = cholPt;
+  
+  const arma::uvec& obs_y = y_pattern.observed(t);
+  if (obs_y.n_elem == 0) return;
+  
+  unsigned int n_sigma = 2 * m + 1;
+  double sqrt_wc = std::sqrt(ukf_wc(1));
+  double sign_wc0 = ukf_wc(0) < 0.0 ? -1.0 : 1.0;
+  double sqrt_wc0 = std::sqrt(std::abs(ukf_wc(0)));
+  
+  arma::mat sigma(m, n_sigma);
+  sigma.col(0) = at;
+  for (unsigned int i = 1; i <= m; i++) {
+    sigma.col(i) = at + ukf_scale * cholPt.col(i - 1);
+    sigma.col(i + m) = at - ukf_scale * cholPt.col(i - 1);
+  }
+  arma::mat sigma_y(p, n_sigma);
+  observation_mean(t, sigma, sigma_y);
+  sigma_y = sigma_y.rows(obs_y);
+  arma::vec pred_mean = sigma_y * ukf_wm;
+  sigma_y.each_col() -= pred_mean;
+  
+  arma::mat cholF = qr_chol(arma::join_rows(
+    sqrt_wc * sigma_y.tail_cols(n_sigma - 1), Ht.rows(obs_y)));
+  if (!chol_update(cholF, sqrt_wc0 * sigma_y.col(0), sign_wc0) || 
+    !arma::all(cholF.diag() > 0)) {
+    return;
+  }
+  sigma.each_col() -= at;
+  arma::mat pred_cov = sigma * arma::diagmat(ukf_wc) * sigma_y.t();
+  arma::mat K = arma::solve(arma::trimatu(cholF.t()), 
+    arma::solve(arma::trimatl(cholF), pred_cov.t())).t();
+  att = at + K * (y.elem(obs_y) - pred_mean);
+  
+  arma::mat U = K * cholF;
+  for (unsigned int i = 0; i < U.n_cols; i++) {
+    if (!chol_update(cholPtt, U.col(i), -1.0)) {
+      // lost positive definiteness due to rounding errors
+      cholPtt = psd_chol(cholPt * cholPt.t() - U * U.t());
+      break;
+    }
+  }
+}
+
+void ssm_nlg::precompute_signal_factors(const arma::mat& alpha, 
+  signal_factors& factors) const {
+  
+  factors.a1 = a1_fn(theta, known_params);
+  factors.P1_constant = precompute_dmvnorm_cov(P1_fn(theta, known_params), 
+    factors.P1_Linv);
+  
+  if (Hsd == 0) {
+    // one decomposition per missingness pattern if H is constant, 
+    // otherwise one per time point
+    unsigned int n_H = Htv == 0 ? y_pattern.n_patterns() : n;
+    factors.H_Linv.resize(n_H);
+    factors.H_index.resize(n_H);
+    factors.H_constant.zeros(n_H);
+    for (unsigned int i = 0; i < n_H; i++) {
+      const arma::uvec& obs = Htv == 0 ? y_pattern.obs[i] : y_pattern.observed(i);
+      if (obs.n_elem > 0) {
+        arma::mat H = H_fn(i * Htv, alpha.col(i * Htv), theta, known_params, 
+          known_tv_params);
+        factors.H_constant(i) = precompute_dmvnorm_obs(H, obs, 
+          factors.H_Linv[i], factors.H_index[i]);
+      }
+    }
+  } else {
+    factors.H_Linv.clear();
+    factors.H_index.clear();
   }
   
-  for (unsigned int t = 0; t < (n - 1); t++) {
+  if (Rsd == 0 && n > 1) {
+    unsigned int n_R = Rtv == 0 ? 1 : n - 1;
+    factors.R_Linv.resize(n_R);
+    factors.R_constant.zeros(n_R);
+    for (unsigned int t = 0; t < n_R; t++) {
+      arma::mat Rt = R_fn(t, alpha.col(t), theta, known_params, known_tv_params);
+      factors.R_constant(t) = precompute_dmvnorm_cov(Rt * Rt.t(), 
+        factors.R_Linv[t]);
+    }
+  } else {
+    factors.R_Linv.clear();
+  }
+}
+
+double ssm_nlg::log_signal_pdf(const arma::mat& alpha) const {
+  
+  signal_factors factors;
+  precompute_signal_factors(alpha, factors);
+  return log_signal_pdf(alpha, factors);
+}
+
+double ssm_nlg::log_signal_pdf(const arma::mat& alpha, 
+  const signal_factors& factors) const {
+  
+  arma::uvec states = arma::regspace<arma::uvec>(0, m - 1);
+  double ll = fast_dmvnorm(alpha.col(0), factors.a1, factors.P1_Linv, states, 
+    factors.P1_constant);
+  
+  const double LOG2PI = std::log(2.0 * M_PI);
+  
+  unsigned int n_threads = approx_num_threads();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) reduction(+:ll) num_threads(n_threads) if(n_threads > 1)
+#endif
+  for (unsigned int t = 0; t < n; t++) {
     
-    arma::vec mean = T_fn(t, alpha.col(t), theta, known_params, known_tv_params);
-    arma::mat cov = R_fn(t, alpha.col(t), theta, known_params, known_tv_params);
-    cov = cov * cov.t();
-    ll += dmvnorm(alpha.col(t+1), mean, cov, false, true);
-    arma::uvec na_y = arma::find_nonfinite(y.col(t + 1));
-    if (na_y.n_elem < p) {
-      ll += dmvnorm(y.col(t + 1), Z_fn(t + 1, alpha.col(t + 1), theta, known_params, known_tv_params), 
-        H_fn(t + 1, alpha.col(t + 1), theta, known_params, known_tv_params), true, true);
+    if (t > 0) {
+      arma::vec mean = T_fn(t - 1, alpha.col(t - 1), theta, known_params, known_tv_params);
+      if (factors.R_Linv.size() > 0) {
+        unsigned int i = (t - 1) * Rtv;
+        ll += fast_dmvnorm(alpha.col(t), mean, factors.R_Linv[i], states, 
+          factors.R_constant(i));
+      } else {
+        arma::mat cov = R_fn(t - 1, alpha.col(t - 1), theta, known_params, known_tv_params);
+        cov = cov * cov.t();
+        // Cholesky is enough unless the covariance is singular
+        arma::mat L;
+        if (arma::chol(L, cov, "lower")) {
+          arma::vec tmp = arma::solve(arma::trimatl(L), alpha.col(t) - mean);
+          ll -= 0.5 * (m * LOG2PI + 2.0 * arma::accu(arma::log(L.diag())) + 
+            arma::dot(tmp, tmp));
+        } else {
+          ll += dmvnorm(alpha.col(t), mean, cov, false, true);
+        }
+      }
+    }
+    if (y_pattern.any_observed(t)) {
+      arma::vec mean = Z_fn(t, alpha.col(t), theta, known_params, known_tv_params);
+      if (factors.H_Linv.size() > 0) {
+        unsigned int i = Htv == 0 ? y_pattern.id(t) : t;
+        ll += fast_dmvnorm(y.col(t), mean, factors.H_Linv[i], factors.H_index[i], 
+          factors.H_constant(i));
+      } else {
+        ll += dmvnorm(y.col(t), mean, 
+          H_fn(t, alpha.col(t), theta, known_params, known_tv_params), true, true);
+      }
     }
   }
   return ll;
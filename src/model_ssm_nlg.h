@@ -4,6 +4,7 @@
 
 #include <sitmo.h>
 #include "bssm.h"
+#include "filter_workspace.h"
 #include "model_ssm_mlg.h"
 
 // typedef for a pointer of nonlinear function of model equation returning vec (T, Z)
@@ -13,6 +14,19 @@ typedef arma::vec (*nvec_fnPtr)(const unsigned int t, const arma::vec& alpha, co
 typedef arma::mat (*nmat_fnPtr)(const unsigned int t, const arma::vec& alpha, const arma::vec& theta, 
   const arma::vec& known_params, const arma::mat& known_tv_params);
 
+// typedef for a pointer of batched version of T or Z, which evaluates the 
+// function for all particles (columns of alpha) and writes the results to 
+// the columns of preallocated matrix out
+typedef void (*nbatch_fnPtr)(const unsigned int t, const arma::mat& alpha, 
+  const arma::vec& theta, const arma::vec& known_params, 
+  const arma::mat& known_tv_params, arma::mat& out);
+
+// typedef for a pointer of function which evaluates T or Z and its Jacobian 
+// at alpha in one pass, writing the results to value and gradient
+typedef void (*njoint_fnPtr)(const unsigned int t, const arma::vec& alpha, 
+  const arma::vec& theta, const arma::vec& known_params, 
+  const arma::mat& known_tv_params, arma::vec& value, arma::mat& gradient);
+
 // typedef for a pointer returning a1
 typedef arma::vec (*a1_fnPtr)(const arma::vec& theta, const arma::vec& known_params);
 // typedef for a pointer returning P1
@@ -20,6 +34,24 @@ typedef arma::mat (*P1_fnPtr)(const arma::vec& theta, const arma::vec& known_par
 // typedef for a pointer of log-prior function
 typedef double (*prior_fnPtr)(const arma::vec&);
 
+// factors of the Gaussian densities in log_signal_pdf which do not depend 
+// on the states, computed once per theta and reused over the iterations 
+// (and backtracking steps) of the mode finder
+struct signal_factors {
+  arma::vec a1;
+  arma::mat P1_Linv;
+  double P1_constant;
+  // state-independent H per missingness pattern (Htv = 0) 
+  // or per time point (Htv = 1), empty if H depends on the state
+  std::vector<arma::mat> H_Linv;
+  std::vector<arma::uvec> H_index;
+  arma::vec H_constant;
+  // state-independent R for t = 0 (Rtv = 0) or t = 0, ..., n - 2 (Rtv = 1),
+  // empty if R depends on the state
+  std::vector<arma::mat> R_Linv;
+  arma::vec R_constant;
+};
+
 class ssm_nlg {
   
 public:
@@ -49,6 +81,8 @@ public:
     const double conv_tol = 1e-8);
   
   arma::mat y;
+  // missingness patterns of y
+  const missing_pattern y_pattern;
   // nonlinear functions of 
   // y_t = Z(alpha_t, theta,t) + H(theta,t)*eps_t, 
   // alpha_t+1 = T(alpha_t, theta,t) + R(theta, t)*eta_t
@@ -60,6 +94,13 @@ public:
   //and the derivatives
   nmat_fnPtr Z_gn;
   nmat_fnPtr T_gn;
+  // optional joint evaluation of Z and Z_gn (T and T_gn), NULL if not given
+  njoint_fnPtr Z_joint;
+  njoint_fnPtr T_joint;
+  // optional batched versions of T and Z used in the particle filters,
+  // NULL if not given
+  nbatch_fnPtr T_batch;
+  nbatch_fnPtr Z_batch;
   //initial value
   a1_fnPtr a1_fn;
   P1_fnPtr P1_fn;
@@ -82,14 +123,26 @@ public:
   const unsigned int Htv;
   const unsigned int Tgtv;
   const unsigned int Rtv;
+  // do H and R depend on the state, if not, these are evaluated only once 
+  // per time point in the particle filters and reused for all particles
+  const unsigned int Hsd;
+  const unsigned int Rsd;
+  // find the mode of the approximation using the block tridiagonal 
+  // precision of the states instead of the Kalman smoother
+  const bool banded_approx;
   
   unsigned int seed;
   sitmo::prng_engine engine;
+  // buffers for the particle filters
+  filter_workspace workspace;
   const double zero_tol;
   
   unsigned int iekf_iter;
   unsigned int max_iter;
   double conv_tol;
+  // number of threads used over the time points in the Gaussian 
+  // approximation, values larger than one require thread-safe model functions
+  unsigned int approx_threads;
   
   arma::mat mode_estimate; // current estimate of the mode
   // -1 = no approx, 0 = theta doesn't match, 1 = proper approx 
@@ -98,9 +151,42 @@ public:
   double approx_loglik; 
   // store the current scaling factors for psi-APF
   arma::vec scales;
+  // sigma point weights and scaling of UKF
+  arma::vec ukf_wm;
+  arma::vec ukf_wc;
+  double ukf_scale;
   ssm_mlg approx_model;
+  // factorized precision of the states of approx_model if banded_approx
+  block_tridiag precision;
   
   void update_model(const arma::vec& new_theta);
+  // set the batched functions from external pointers (R NULL if not used)
+  void set_batch_fns(SEXP T_batch_, SEXP Z_batch_);
+  // T and Z evaluated at the columns of alpha, using the batched functions 
+  // if available
+  void transition_mean(const unsigned int t, const arma::mat& alpha, 
+    arma::mat& mean) const;
+  void observation_mean(const unsigned int t, const arma::mat& alpha, 
+    arma::mat& mean) const;
+  // set the joint functions from external pointers (R NULL if not used)
+  void set_joint_fns(SEXP Z_joint_, SEXP T_joint_);
+  // Z (T) and its Jacobian evaluated at alpha, in one pass if Z_joint 
+  // (T_joint) is available
+  void Z_and_gn(const unsigned int t, const arma::vec& alpha, 
+    arma::vec& value, arma::mat& gradient) const;
+  void T_and_gn(const unsigned int t, const arma::vec& alpha, 
+    arma::vec& value, arma::mat& gradient) const;
+  // update the approximating model by linearizing Z and evaluating H at 
+  // the columns of alpha_Z, and T and R at the columns of alpha_T
+  void linearize(const arma::mat& alpha_Z, const arma::mat& alpha_T);
+  // all system matrices of the approximating model at time t
+  void linearize_time_point(const unsigned int t, const arma::mat& alpha_Z, 
+    const arma::mat& alpha_T);
+  // smoothed states of approx_model to workspace.smooth, using 
+  // banded_smoother if banded_approx and fast_smoother otherwise
+  void smooth_approx_model();
+  // log-likelihood of approx_model, using the factorized precision if valid
+  double approx_model_loglik() const;
   // update the approximating Gaussian model
   void approximate();
   void approximate_for_is(const arma::mat& mode_estimate);
@@ -121,8 +207,12 @@ public:
   double ekf_smoother(arma::mat& att, arma::cube& Ptt) const;
   double ekf_fast_smoother(arma::mat& at) const;
   
-  double ukf(arma::mat& at, arma::mat& att, arma::cube& Pt, arma::cube& Ptt, 
-    const double alpha = 1.0, const double beta = 0.0, const double kappa = 2.0) const;
+  // cache the sigma point weights of UKF
+  void set_ukf_parameters(const double alpha = 1.0, const double beta = 0.0, 
+    const double kappa = 2.0);
+  // square-root UKF, returns the log-likelihood
+  double ukf(arma::mat& at, arma::mat& att, arma::cube& Pt, arma::cube& Ptt) const;
+  double ukf_loglik() const;
   
   // bootstrap filter  
   double bsf_filter(const unsigned int nsim, arma::cube& alpha, 
@@ -135,6 +225,13 @@ public:
   // extended Kalman particle filter
   double ekf_filter(const unsigned int nsim, arma::cube& alpha,
     arma::mat& weights, arma::umat& indices);
+  // unscented particle filter
+  double ukf_filter(const unsigned int nsim, arma::cube& alpha,
+    arma::mat& weights, arma::umat& indices);
+  // particle filter with Gaussian proposals given by the update step of 
+  // EKF (unscented = false) or UKF (unscented = true) for each particle
+  double kf_proposal_filter(const unsigned int nsim, arma::cube& alpha,
+    arma::mat& weights, arma::umat& indices, const bool unscented);
   
   void update_scales();
   
@@ -146,10 +243,34 @@ public:
   // compute logarithms of _unnormalized_ densities g(y_t | alpha_t)
   double log_obs_density(const unsigned int t, const arma::vec& alpha) const;
   
-  void ekf_update_step(const unsigned int t, const arma::vec y, 
+  void ekf_update_step(const unsigned int t, const arma::vec& y, 
     const arma::vec& at, const arma::mat& Pt, arma::vec& att, arma::mat& Ptt) const;
+  // as above but with precomputed HHt where the missing observations 
+  // are replaced with identity
+  void ekf_update_step(const unsigned int t, const arma::vec& y, 
+    const arma::vec& at, const arma::mat& Pt, const arma::mat& HHt, 
+    arma::vec& att, arma::mat& Ptt) const;
+  // UKF update step using the lower triangular Cholesky factors cholPt and 
+  // cholPtt of the predicted and filtered covariances, Ht is H at time t
+  void ukf_update_step(const unsigned int t, const arma::vec& y, 
+    const arma::vec& at, const arma::mat& cholPt, const arma::mat& Ht, 
+    arma::vec& att, arma::mat& cholPtt) const;
+  // H H' of time t with the rows and columns of missing observations 
+  // replaced with identity
+  arma::mat observed_HHt(const unsigned int t, const arma::vec& at) const;
+  
+  // approx_threads, or one if called from within a parallel region 
+  // (e.g. from parallel chains), where the model functions are already 
+  // evaluated concurrently
+  unsigned int approx_num_threads() const;
   
+  // log-density p(alpha, y) used in the mode finder
   double log_signal_pdf(const arma::mat& alpha) const;
+  double log_signal_pdf(const arma::mat& alpha, const signal_factors& factors) const;
+  // precompute the factors for the current theta, alpha is only used as 
+  // an argument of H and R which do not depend on it
+  void precompute_signal_factors(const arma::mat& alpha, 
+    signal_factors& factors) const;
   
   arma::cube predict_sample(const arma::mat& theta_posterior, 
     const arma::mat& alpha, const unsigned int predict_type);
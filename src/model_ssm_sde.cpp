@@ -1,6 +1,7 @@
 #include "model_ssm_sde.h"
 #include "milstein_functions.h"
 #include "sample.h"
+#include "rng_streams.h"
 
 ssm_sde::ssm_sde(
   const arma::vec& y, 
@@ -14,8 +15,17 @@ ssm_sde::ssm_sde(
   :
     y(y), theta(theta), x0(x0), n(y.n_elem), positive(positive),
     drift(drift_), diffusion(diffusion_), ddiffusion(ddiffusion_), 
-    log_obs_density(log_obs_density_), log_prior_pdf(log_prior_pdf_),
-    coarse_engine(seed), engine(seed + 1), L_f(L_f), L_c(L_c){
+    coef_batch(nullptr), log_obs_density(log_obs_density_), log_prior_pdf(log_prior_pdf_),
+    coarse_engine(seed), engine(seed + 1), L_f(L_f), L_c(L_c), 
+    levels({L_c, L_f}), mlmc(false) {
+}
+
+void ssm_sde::set_batch_fn(SEXP coef_batch_) {
+  
+  if (!Rf_isNull(coef_batch_)) {
+    Rcpp::XPtr<coef_batch_fnPtr> xpfun_coef(coef_batch_);
+    coef_batch = *xpfun_coef;
+  }
 }
 
 arma::vec ssm_sde::log_likelihood(
@@ -26,7 +36,7 @@ arma::vec ssm_sde::log_likelihood(
     arma::umat& indices) {
   
   arma::vec ll(2);
-  ll(0) = bsf_filter(nsim, method, alpha, weights, indices);
+  ll(0) = bsf_filter(nsim, L_f, alpha, weights, indices);
   ll(1) = ll(0);
   return ll;
 }
@@ -34,14 +44,21 @@ arma::vec ssm_sde::log_likelihood(
 double ssm_sde::bsf_filter(const unsigned int nsim, 
   const unsigned int L,  arma::cube& alpha, 
   arma::mat& weights, arma::umat& indices) {
+  
+  workspace.set_size(m, 0, nsim);
+  
   // alpha is  n x 1 x nsim
+  // current particles, simulated jointly
+  arma::vec x(nsim);
+  x.fill(x0);
+  milstein_batch(x, L, 1, theta, drift, diffusion, ddiffusion,
+    positive, coarse_engine, coef_batch);
   for (unsigned int i = 0; i < nsim; i++) {
-    alpha(0, 0, i) = milstein(x0, L, 1, theta, drift, diffusion, ddiffusion,
-      positive, coarse_engine);
+    alpha(0, 0, i) = x(i);
   }
   
   std::uniform_real_distribution<> unif(0.0, 1.0);
-  arma::vec normalized_weights(nsim);
+  arma::vec& normalized_weights = workspace.normalized_weights;
   double loglik = 0.0;
   
   if(arma::is_finite(y(0))) {
@@ -62,16 +79,20 @@ double ssm_sde::bsf_filter(const unsigned int nsim,
   }
   for (unsigned int t = 0; t < n; t++) {
     
-    arma::vec r(nsim);
+    arma::vec& r = workspace.r;
     for (unsigned int i = 0; i < nsim; i++) {
       r(i) = unif(engine);
     }
     
-    indices.col(t) = stratified_sample(normalized_weights, r, nsim);
+    stratified_sample(normalized_weights, r, indices.colptr(t), nsim);
     
     for (unsigned int i = 0; i < nsim; i++) {
-      alpha(0, t + 1, i) = milstein(alpha(0, t, indices(i, t)), L, 1, theta, 
-        drift, diffusion, ddiffusion, positive, coarse_engine);
+      x(i) = alpha(0, t, indices(i, t));
+    }
+    milstein_batch(x, L, 1, theta, drift, diffusion, ddiffusion, 
+      positive, coarse_engine, coef_batch);
+    for (unsigned int i = 0; i < nsim; i++) {
+      alpha(0, t + 1, i) = x(i);
     }
     
     if ((t < (n - 1)) && arma::is_finite(y(t + 1))) {
@@ -93,3 +114,112 @@ double ssm_sde::bsf_filter(const unsigned int nsim,
   }
   return loglik;
 }
+
+// Particles of both filters are propagated using common Brownian paths
+// and resampled using common random numbers, so that the estimates of 
+// the adjacent levels are positively correlated.
+// alpha, weights and indices correspond to the finer level L.
+arma::vec ssm_sde::coupled_bsf_filter(const unsigned int nsim, 
+  const unsigned int L, arma::cube& alpha, 
+  arma::mat& weights, arma::umat& indices) {
+  
+  // Brownian paths are keyed by (key, particle, time), 
+  // a new key is drawn for each call
+  uint64_t key = draw_key(coarse_engine);
+  
+  // only the current particles of the coarse filter are needed
+  arma::vec alpha_c(nsim);
+  for (unsigned int i = 0; i < nsim; i++) {
+    double x_c = x0;
+    double x_f = x0;
+    milstein_joint(x_c, x_f, L - 1, L, 1, theta, drift, diffusion, ddiffusion,
+      positive, key, i, 0);
+    alpha_c(i) = x_c;
+    alpha(0, 0, i) = x_f;
+  }
+  
+  std::uniform_real_distribution<> unif(0.0, 1.0);
+  arma::vec normalized_c(nsim);
+  arma::vec normalized_f(nsim);
+  arma::vec loglik(2, arma::fill::zeros);
+  
+  // weighting of one filter, in case all weights are zero the filter is 
+  // continued with equal weights but its likelihood estimate is zero
+  auto update = [&](const unsigned int t, const arma::vec& x, 
+    arma::vec& normalized, const unsigned int level) {
+    arma::vec w(nsim, arma::fill::ones);
+    if (arma::is_finite(y(t))) {
+      w = log_obs_density(y(t), x, theta);
+      double max_weight = w.max();
+      w = arma::exp(w - max_weight);
+      double sum_weights = arma::accu(w);
+      if(sum_weights > 0.0){
+        normalized = w / sum_weights;
+        loglik(level) += max_weight + std::log(sum_weights / nsim);
+      } else {
+        w.ones();
+        normalized.fill(1.0 / nsim);
+        loglik(level) = -std::numeric_limits<double>::infinity();
+      }
+    } else {
+      normalized.fill(1.0 / nsim);
+    }
+    return w;
+  };
+  
+  update(0, alpha_c, normalized_c, 0);
+  weights.col(0) = update(0, alpha.tube(0, 0), normalized_f, 1);
+  
+  for (unsigned int t = 0; t < n; t++) {
+    
+    arma::vec r(nsim);
+    for (unsigned int i = 0; i < nsim; i++) {
+      r(i) = unif(engine);
+    }
+    arma::uvec indices_c = stratified_sample(normalized_c, r, nsim);
+    indices.col(t) = stratified_sample(normalized_f, r, nsim);
+    
+    arma::vec alpha_c_prev = alpha_c;
+    for (unsigned int i = 0; i < nsim; i++) {
+      double x_c = alpha_c_prev(indices_c(i));
+      double x_f = alpha(0, t, indices(i, t));
+      milstein_joint(x_c, x_f, L - 1, L, 1, theta, drift, diffusion, ddiffusion,
+        positive, key, i, t + 1);
+      alpha_c(i) = x_c;
+      alpha(0, t + 1, i) = x_f;
+    }
+    
+    if (t < (n - 1)) {
+      update(t + 1, alpha_c, normalized_c, 0);
+      weights.col(t + 1) = update(t + 1, alpha.tube(0, t + 1), normalized_f, 1);
+    } else {
+      weights.col(t + 1).ones();
+    }
+  }
+  return loglik;
+}
+
+// exp(loglik_f - approx_loglik) is estimated by the telescoping sum 
+// 1 + sum_l [exp(loglik_l - approx_loglik) - exp(loglik_{l-1} - approx_loglik)],
+// l = L_c + 1, ..., L_f, where approx_loglik is the estimate of level L_c 
+// used in the approximate MCMC and the differences are estimated 
+// with coupled filters. As the variance of the differences decreases with l, 
+// the number of particles is decreased by a factor 2^(-3/2) per level.
+// The estimate can be negative. It is returned as is, as truncating it would
+// bias the IS-estimators, which are consistent also with signed weights.
+double ssm_sde::mlmc_weight(const unsigned int nsim, const double approx_loglik,
+  arma::cube& alpha, arma::mat& weights, arma::umat& indices) {
+  
+  double weight = 1.0;
+  for (unsigned int l = L_c + 1; l <= L_f; l++) {
+    unsigned int nsim_l = std::max(2.0, 
+      std::round(nsim * std::pow(2.0, -1.5 * (l - L_c - 1))));
+    alpha.set_size(1, n + 1, nsim_l);
+    weights.set_size(nsim_l, n + 1);
+    indices.set_size(nsim_l, n);
+    arma::vec loglik = coupled_bsf_filter(nsim_l, l, alpha, weights, indices);
+    weight += std::exp(loglik(1) - approx_loglik) - 
+      std::exp(loglik(0) - approx_loglik);
+  }
+  return weight;
+}
@@ -4,8 +4,9 @@
 
 #include <sitmo.h>
 #include "bssm.h"
+#include "filter_workspace.h"
+#include "milstein_functions.h"
 
-typedef double (*fnPtr)(const double x, const arma::vec& theta);
 typedef double (*prior_fnPtr)(const arma::vec& theta);
 typedef arma::vec (*obs_fnPtr)(const double y, 
   const arma::vec& alpha, const arma::vec& theta);
@@ -32,11 +33,16 @@ public:
   const double x0;
   const unsigned int n;
   static const unsigned int m = 1; // number of states
+  // the states are always sampled from the output of the bootstrap filter
+  static const unsigned int sampling_method = 2;
   bool positive;
   
   fnPtr drift;
   fnPtr diffusion;
   fnPtr ddiffusion;
+  // optional batched version of drift, diffusion and ddiffusion used in the 
+  // bootstrap filter
+  coef_batch_fnPtr coef_batch;
   //log-pdf for observational level
   obs_fnPtr log_obs_density;
   //prior log-pdf
@@ -46,11 +52,17 @@ public:
   sitmo::prng_engine coarse_engine;
   // PRNG use for everything else
   sitmo::prng_engine engine;
+  // buffers for the particle filters
+  filter_workspace workspace;
+  
+  // set the batched function from external pointer (R NULL if not used)
+  void set_batch_fn(SEXP coef_batch_);
   
   void update_model(const arma::vec& new_theta) {
     theta = new_theta;
   };
   
+  // log-likelihood estimate using level L_f, method is ignored
   arma::vec log_likelihood(
       const unsigned int method, 
       const unsigned int nsim, 
@@ -62,8 +74,23 @@ public:
   double bsf_filter(const unsigned int nsim, const unsigned int L,
     arma::cube& alpha, arma::mat& weights, arma::umat& indices);
   
+  // coupled bootstrap filters using levels L - 1 and L, 
+  // returns the log-likelihood estimates of both levels
+  arma::vec coupled_bsf_filter(const unsigned int nsim, const unsigned int L,
+    arma::cube& alpha, arma::mat& weights, arma::umat& indices);
+  
+  // multilevel estimate of exp(loglik_f - approx_loglik) using coupled filters, 
+  // the output of the filter of the finest level is returned in alpha etc.
+  double mlmc_weight(const unsigned int nsim, const double approx_loglik,
+    arma::cube& alpha, arma::mat& weights, arma::umat& indices);
+  
   const unsigned int L_f;
   const unsigned int L_c; 
+  // increasing discretization levels of multilevel delayed acceptance, 
+  // defaults to (L_c, L_f)
+  arma::uvec levels;
+  // use the multilevel estimator in the IS-correction
+  bool mlmc;
   
 };
 
@@ -1,6 +1,7 @@
 #include "model_ssm_ulg.h"
 #include "rep_mat.h"
 #include "sample.h"
+#include "rnorm.h"
 #include "distr_consts.h"
 #include "conditional_dist.h"
 #include "psd_chol.h"
@@ -107,6 +108,53 @@ double ssm_ulg::log_prior_pdf(const arma::vec& x) const {
   return Rcpp::as<double>(prior_fn(Rcpp::NumericVector(x.begin(), x.end())));
 }
 
+// use the known structure of the transition matrix of BSM models in the 
+// Kalman recursions, if T is time-invariant and matches the structure
+void ssm_ulg::set_bsm_transition(const bool slope, const bool seasonal, 
+  const bool noise) {
+  
+  bsm_transition structure(m, slope, seasonal, noise);
+  if (Ttv == 0 && arma::all(arma::vectorise(structure.dense() == T.slice(0)))) {
+    T_structure = structure;
+  } else {
+    T_structure = bsm_transition();
+  }
+}
+
+arma::vec ssm_ulg::transition(const unsigned int t, const arma::vec& x) const {
+  if (T_structure.active()) {
+    return T_structure.times(x);
+  }
+  return T.slice(t * Ttv) * x;
+}
+
+arma::vec ssm_ulg::transition_trans(const unsigned int t, 
+  const arma::vec& x) const {
+  if (T_structure.active()) {
+    return T_structure.trans_times(x);
+  }
+  return T.slice(t * Ttv).t() * x;
+}
+
+arma::mat ssm_ulg::transition_cov(const unsigned int t, 
+  const arma::mat& P) const {
+  if (T_structure.active()) {
+    return T_structure.sandwich(P);
+  }
+  return T.slice(t * Ttv) * P * T.slice(t * Ttv).t();
+}
+
+// (I - K Z_t') P (I - K Z_t')' + K H_t^2 K', 
+// computed with rank-one updates instead of m x m products
+arma::mat ssm_ulg::joseph_cov(const unsigned int t, const arma::mat& P, 
+  const arma::vec& K) const {
+  
+  arma::mat A = P - K * (Z.col(t * Ztv).t() * P);
+  A -= (A * Z.col(t * Ztv)) * K.t();
+  A += HH(t * Htv) * K * K.t();
+  return A;
+}
+
 double ssm_ulg::log_likelihood() const {
   
   double logLik = 0;
@@ -114,28 +162,29 @@ double ssm_ulg::log_likelihood() const {
     logLik = -std::numeric_limits<double>::infinity();
   } else {
     
-    arma::vec at = a1;
-    arma::mat Pt = P1;
-    
-    arma::vec y_tmp = y;
-    if(xreg.n_cols > 0) {
-      y_tmp -= xbeta;
+    // the structured products of BSM models are faster than 
+    // the fixed-size kernels unless the state dimension is very small
+    if (m <= 5 || !T_structure.active()) {
+      switch (m) {
+      case 1: return log_likelihood_fixed<1>();
+      case 2: return log_likelihood_fixed<2>();
+      case 3: return log_likelihood_fixed<3>();
+      case 4: return log_likelihood_fixed<4>();
+      case 5: return log_likelihood_fixed<5>();
+      case 12: return log_likelihood_fixed<12>();
+      case 13: return log_likelihood_fixed<13>();
+      }
     }
     
-    const double LOG2PI = std::log(2.0 * M_PI);
-    
-    for (unsigned int t = 0; t < n; t++) {
-      double F = arma::as_scalar(Z.col(t * Ztv).t() * Pt * Z.col(t * Ztv) + HH(t * Htv));
-      if (arma::is_finite(y_tmp(t)) && F > zero_tol) {
-        double v = arma::as_scalar(y_tmp(t) - D(t * Dtv) - Z.col(t * Ztv).t() * at);
-        arma::vec K = Pt * Z.col(t * Ztv) / F;
-        at = C.col(t * Ctv) + T.slice(t * Ttv) * (at + K * v);
-        Pt = arma::symmatu(T.slice(t * Ttv) * (Pt - K * K.t() * F) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
-        logLik -= 0.5 * (LOG2PI + std::log(F) + v * v/F);
-      } else {
-        at = C.col(t * Ctv) + T.slice(t * Ttv) * at;
-        Pt = arma::symmatu(T.slice(t * Ttv) * Pt * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
-      }
+    switch (Ztv + 2 * Ttv + 4 * Rtv) {
+    case 0: return log_likelihood_dynamic<false, false, false>();
+    case 1: return log_likelihood_dynamic<true, false, false>();
+    case 2: return log_likelihood_dynamic<false, true, false>();
+    case 3: return log_likelihood_dynamic<true, true, false>();
+    case 4: return log_likelihood_dynamic<false, false, true>();
+    case 5: return log_likelihood_dynamic<true, false, true>();
+    case 6: return log_likelihood_dynamic<false, true, true>();
+    default: return log_likelihood_dynamic<true, true, true>();
     }
   }
   return logLik;
@@ -150,7 +199,15 @@ arma::cube ssm_ulg::simulate_states(const unsigned int nsim, const bool use_anti
   
   arma::cube asim(m, n + 1, nsim);
   
-  std::normal_distribution<> normal(0.0, 1.0);
+  // buffers for the normal variates of one replication, drawn at once
+  arma::vec um(m);
+  arma::vec ue(n);
+  arma::mat uk(k, n);
+  auto draw = [&]() {
+    normal_fill(um, engine);
+    normal_fill(ue, engine);
+    normal_fill(uk, engine);
+  };
   
   if (nsim > 1) {
     arma::vec Ft(n);
@@ -169,22 +226,15 @@ arma::cube ssm_ulg::simulate_states(const unsigned int nsim, const bool use_anti
     for(unsigned int i = 0; i < nsim2; i++) {
       arma::mat aplus(m, n + 1);
       
-      arma::vec um(m);
-      for(unsigned int j = 0; j < m; j++) {
-        um(j) = normal(engine);
-      }
+      draw();
       aplus.col(0) = a1 + L_P1 * um;
       for (unsigned int t = 0; t < n; t++) {
         if (arma::is_finite(y(t))) {
           y(t) = xbeta(t) + D(t * Dtv) +
             arma::as_scalar(Z.col(t * Ztv).t() * aplus.col(t)) +
-            H(t * Htv) * normal(engine);
-        }
-        arma::vec uk(k);
-        for(unsigned int j = 0; j < k; j++) {
-          uk(j) = normal(engine);
+            H(t * Htv) * ue(t);
         }
-        aplus.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * aplus.col(t) + R.slice(t * Rtv) * uk;
+        aplus.col(t + 1) = C.col(t * Ctv) + transition(t, aplus.col(t)) + R.slice(t * Rtv) * uk.col(t);
       }
       
       asim.slice(i) = -fast_smoother(Ft, Kt, Lt) + aplus;
@@ -197,23 +247,16 @@ arma::cube ssm_ulg::simulate_states(const unsigned int nsim, const bool use_anti
       
       arma::mat aplus(m, n + 1);
       
-      arma::vec um(m);
-      for(unsigned int j = 0; j < m; j++) {
-        um(j) = normal(engine);
-      }
+      draw();
       aplus.col(0) = a1 + L_P1 * um;
       for (unsigned int t = 0; t < n; t++) {
         if (arma::is_finite(y(t))) {
           y(t) = xbeta(t) + D(t * Dtv) +
             arma::as_scalar(Z.col(t * Ztv).t() * aplus.col(t)) +
-            H(t * Htv) * normal(engine);
-        }
-        arma::vec uk(k);
-        for(unsigned int j = 0; j < k; j++) {
-          uk(j) = normal(engine);
+            H(t * Htv) * ue(t);
         }
-        aplus.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * aplus.col(t) +
-          R.slice(t * Rtv) * uk;
+        aplus.col(t + 1) = C.col(t * Ctv) + transition(t, aplus.col(t)) +
+          R.slice(t * Rtv) * uk.col(t);
       }
       asim.slice(nsim - 1) = alphahat - fast_smoother(Ft, Kt, Lt) + aplus;
     }
@@ -225,22 +268,15 @@ arma::cube ssm_ulg::simulate_states(const unsigned int nsim, const bool use_anti
     //  Marek Jarociński 2015: "A note on implementing the Durbin and Koopman simulation
     //  smoother")
     
-    arma::vec um(m);
-    for(unsigned int j = 0; j < m; j++) {
-      um(j) = normal(engine);
-    }
+    draw();
     asim.slice(0).col(0) = L_P1 * um;
     for (unsigned int t = 0; t < n; t++) {
       if (arma::is_finite(y(t))) {
         y(t) -= arma::as_scalar(Z.col(t * Ztv).t() * asim.slice(0).col(t)) +
-          H(t * Htv) * normal(engine);
+          H(t * Htv) * ue(t);
       }
-      arma::vec uk(k);
-      for(unsigned int j = 0; j < k; j++) {
-        uk(j) = normal(engine);
-      }
-      asim.slice(0).col(t + 1) = T.slice(t * Ttv) * asim.slice(0).col(t) +
-        R.slice(t * Rtv) * uk;
+      asim.slice(0).col(t + 1) = transition(t, asim.slice(0).col(t)) +
+        R.slice(t * Rtv) * uk.col(t);
     }
     asim.slice(0) += fast_smoother();
   }
@@ -256,56 +292,83 @@ arma::cube ssm_ulg::simulate_states(const unsigned int nsim, const bool use_anti
 arma::mat ssm_ulg::fast_smoother() const {
   
   arma::mat at(m, n + 1);
-  arma::mat Pt(m, m);
-  
-  arma::vec vt(n);
-  arma::vec Ft(n);
-  arma::mat Kt(m, n);
+  fast_smoother(at);
+  return at;
+}
+
+void ssm_ulg::fast_smoother(arma::mat& at) const {
   
-  at.col(0) = a1;
-  Pt = P1;
-  arma::vec y_tmp = y;
-  if(xreg.n_cols > 0) {
-    y_tmp -= xbeta;
+  workspace.set_fast_smoother_size(m, n);
+  arma::cube Lt;
+  if (fast_smoother_fixed_size(at, workspace.Ft, workspace.Kt, Lt, false)) {
+    return;
+  }
+  switch (Ztv + 2 * Ttv + 4 * Rtv) {
+  case 0: fast_smoother_dynamic<false, false, false>(at); break;
+  case 1: fast_smoother_dynamic<true, false, false>(at); break;
+  case 2: fast_smoother_dynamic<false, true, false>(at); break;
+  case 3: fast_smoother_dynamic<true, true, false>(at); break;
+  case 4: fast_smoother_dynamic<false, false, true>(at); break;
+  case 5: fast_smoother_dynamic<true, false, true>(at); break;
+  case 6: fast_smoother_dynamic<false, true, true>(at); break;
+  default: fast_smoother_dynamic<true, true, true>(at); break;
   }
+}
+
+// block tridiagonal posterior precision of the states, see ssm_mlg
+bool ssm_ulg::banded_smoother(arma::mat& at, block_tridiag& Q) const {
+  
+  Q.set_size(m, n);
+  arma::mat P1inv;
+  double logdet;
+  if (!inv_sympd_logdet(P1, P1inv, logdet)) {
+    return false;
+  }
+  Q.diag.slice(0) = P1inv;
+  Q.rhs.col(0) = P1inv * a1;
+  double constant = -0.5 * (logdet + arma::dot(a1, Q.rhs.col(0)));
   
+  arma::mat RRinv;
+  unsigned int n_obs = 0;
   for (unsigned int t = 0; t < n; t++) {
-    Ft(t) = arma::as_scalar(Z.col(t * Ztv).t() * Pt * Z.col(t * Ztv) + HH(t * Htv));
-    if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol) {
-      Kt.col(t) = Pt * Z.col(t * Ztv) / Ft(t);
-      vt(t) = arma::as_scalar(y_tmp(t) - D(t * Dtv) - Z.col(t * Ztv).t() * at.col(t));
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * (at.col(t) + Kt.col(t) * vt(t));
-      //Pt = arma::symmatu(T.slice(t * Ttv) * (Pt - Kt.col(t) * Kt.col(t).t() * Ft(t)) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
-      // Switched to numerically better form
-      arma::mat tmp = arma::eye(m, m) - Kt.col(t) * Z.col(t * Ztv).t();
-      Pt = arma::symmatu(T.slice(t * Ttv) * (tmp * Pt * tmp.t() + Kt.col(t) * HH(t * Htv) * Kt.col(t).t()) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
-    } else {
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * at.col(t);
-      Pt = arma::symmatu(T.slice(t * Ttv) * Pt * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
+    if (t < (n - 1)) {
+      if (t == 0 || Rtv) {
+        if (!inv_sympd_logdet(RR.slice(t * Rtv), RRinv, logdet)) {
+          return false;
+        }
+      }
+      arma::vec Ct = C.col(t * Ctv);
+      arma::mat RRinvT = RRinv * T.slice(t * Ttv);
+      Q.diag.slice(t) += T.slice(t * Ttv).t() * RRinvT;
+      Q.rhs.col(t) -= RRinvT.t() * Ct;
+      Q.offdiag.slice(t) = -RRinvT;
+      Q.diag.slice(t + 1) = RRinv;
+      Q.rhs.col(t + 1) = RRinv * Ct;
+      constant -= 0.5 * (logdet + arma::dot(Ct, Q.rhs.col(t + 1)));
     }
-  }
-  arma::mat rt(m, n);
-  rt.col(n - 1).zeros();
-  for (int t = (n - 1); t > 0; t--) {
-    if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol){
-      arma::mat L = T.slice(t * Ttv) * (arma::eye(m, m) - Kt.col(t) * Z.col(t * Ztv).t());
-      rt.col(t - 1) = Z.col(t * Ztv) / Ft(t) * vt(t) + L.t() * rt.col(t);
-    } else {
-      rt.col(t - 1) = T.slice(t * Ttv).t() * rt.col(t);
+    if (arma::is_finite(y(t))) {
+      double HHt = HH(t * Htv);
+      if (!(HHt > 0.0) || !std::isfinite(HHt)) {
+        return false;
+      }
+      double vt = y(t) - D(t * Dtv);
+      if (xreg.n_cols > 0) {
+        vt -= xbeta(t);
+      }
+      Q.diag.slice(t) += Z.col(t * Ztv) * Z.col(t * Ztv).t() / HHt;
+      Q.rhs.col(t) += Z.col(t * Ztv) * vt / HHt;
+      constant -= 0.5 * (std::log(HHt) + vt * vt / HHt);
+      n_obs++;
     }
   }
-  if (arma::is_finite(y(0)) && Ft(0) > zero_tol){
-    arma::mat L = T.slice(0) * (arma::eye(m, m) - Kt.col(0) * Z.col(0).t());
-    at.col(0) = a1 + P1 * (Z.col(0) / Ft(0) * vt(0) + L.t() * rt.col(0));
-  } else {
-    at.col(0) = a1 + P1 * T.slice(0).t() * rt.col(0);
+  Q.constant = constant - 0.5 * n_obs * std::log(2.0 * M_PI);
+  if (!Q.factorize()) {
+    return false;
   }
-  
-  for (unsigned int t = 0; t < (n - 1); t++) {
-    at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * at.col(t) + RR.slice(t * Rtv) * rt.col(t);
-  }
-  
-  return at;
+  Q.solve();
+  at.head_cols(n) = Q.mean;
+  at.col(n) = C.col((n - 1) * Ctv) + T.slice((n - 1) * Ttv) * Q.mean.col(n - 1);
+  return true;
 }
 
 /* Fast state smoothing which returns also Ft, Kt and Lt which can be used
@@ -334,9 +397,9 @@ arma::mat ssm_ulg::fast_smoother(const arma::vec& Ft, const arma::mat& Kt,
   for (unsigned int t = 0; t < n; t++) {
     if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol) {
       vt(t) = arma::as_scalar(y_tmp(t) - D(t * Dtv) - Z.col(t * Ztv).t() * at.col(t));
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * (at.col(t) + Kt.col(t) * vt(t));
+      at.col(t + 1) = C.col(t * Ctv) + transition(t, at.col(t) + Kt.col(t) * vt(t));
     } else {
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * at.col(t);
+      at.col(t + 1) = C.col(t * Ctv) + transition(t, at.col(t));
     }
   }
   
@@ -347,18 +410,18 @@ arma::mat ssm_ulg::fast_smoother(const arma::vec& Ft, const arma::mat& Kt,
     if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol){
       rt.col(t - 1) = Z.col(t * Ztv) / Ft(t) * vt(t) + Lt.slice(t).t() * rt.col(t);
     } else {
-      rt.col(t - 1) = T.slice(t * Ttv).t() * rt.col(t);
+      rt.col(t - 1) = transition_trans(t, rt.col(t));
     }
   }
   if (arma::is_finite(y(0)) && Ft(0) > zero_tol){
-    arma::mat L = T.slice(0) * (arma::eye(m, m) - Kt.col(0) * Z.col(0).t());
-    at.col(0) = a1 + P1 * (Z.col(0) / Ft(0) * vt(0) + L.t() * rt.col(0));
+    arma::vec Tr = transition_trans(0, rt.col(0));
+    at.col(0) = a1 + P1 * (Z.col(0) * (vt(0) / Ft(0) - arma::dot(Kt.col(0), Tr)) + Tr);
   } else {
-    at.col(0) = a1 + P1 * T.slice(0).t() * rt.col(0);
+    at.col(0) = a1 + P1 * transition_trans(0, rt.col(0));
   }
   
   for (unsigned int t = 0; t < (n - 1); t++) {
-    at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * at.col(t) + RR.slice(t * Rtv) * rt.col(t);
+    at.col(t + 1) = C.col(t * Ctv) + transition(t, at.col(t)) + RR.slice(t * Rtv) * rt.col(t);
   }
   
   return at;
@@ -368,6 +431,10 @@ arma::mat ssm_ulg::fast_precomputing_smoother(arma::vec& Ft, arma::mat& Kt,
   arma::cube& Lt) const {
   
   arma::mat at(m, n + 1);
+  workspace.set_fast_smoother_size(m, n);
+  if (fast_smoother_fixed_size(at, Ft, Kt, Lt, true)) {
+    return at;
+  }
   arma::mat Pt(m, m);
   arma::vec vt(n);
   
@@ -383,14 +450,13 @@ arma::mat ssm_ulg::fast_precomputing_smoother(arma::vec& Ft, arma::mat& Kt,
     if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol) {
       Kt.col(t) = Pt * Z.col(t * Ztv) / Ft(t);
       vt(t) = arma::as_scalar(y_tmp(t) - D(t * Dtv) - Z.col(t * Ztv).t() * at.col(t));
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * (at.col(t) + Kt.col(t) * vt(t));
+      at.col(t + 1) = C.col(t * Ctv) + transition(t, at.col(t) + Kt.col(t) * vt(t));
       //Pt = arma::symmatu(T.slice(t * Ttv) * (Pt - Kt.col(t) * Kt.col(t).t() * Ft(t)) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
       // Switched to numerically better form
-      arma::mat tmp = arma::eye(m, m) - Kt.col(t) * Z.col(t * Ztv).t();
-      Pt = arma::symmatu(T.slice(t * Ttv) * (tmp * Pt * tmp.t() + Kt.col(t) * HH(t * Htv) * Kt.col(t).t()) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
+      Pt = arma::symmatu(transition_cov(t, joseph_cov(t, Pt, Kt.col(t))) + RR.slice(t * Rtv));
     } else {
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * at.col(t);
-      Pt = arma::symmatu(T.slice(t * Ttv) * Pt * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
+      at.col(t + 1) = C.col(t * Ctv) + transition(t, at.col(t));
+      Pt = arma::symmatu(transition_cov(t, Pt) + RR.slice(t * Rtv));
     }
   }
   
@@ -399,25 +465,309 @@ arma::mat ssm_ulg::fast_precomputing_smoother(arma::vec& Ft, arma::mat& Kt,
   
   for (int t = (n - 1); t > 0; t--) {
     if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol){
-      Lt.slice(t) = T.slice(t * Ttv) * (arma::eye(m, m) - Kt.col(t) * Z.col(t * Ztv).t());
+      Lt.slice(t) = T.slice(t * Ttv) - transition(t, Kt.col(t)) * Z.col(t * Ztv).t();
       rt.col(t - 1) = Z.col(t * Ztv) / Ft(t) * vt(t) + Lt.slice(t).t() * rt.col(t);
     } else {
-      rt.col(t - 1) = T.slice(t * Ttv).t() * rt.col(t);
+      rt.col(t - 1) = transition_trans(t, rt.col(t));
     }
   }
   if (arma::is_finite(y_tmp(0)) && Ft(0) > zero_tol){
-    arma::mat L = T.slice(0) * (arma::eye(m, m) - Kt.col(0) * Z.col(0).t());
-    at.col(0) = a1 + P1 * (Z.col(0) / Ft(0) * vt(0) + L.t() * rt.col(0));
+    arma::vec Tr = transition_trans(0, rt.col(0));
+    at.col(0) = a1 + P1 * (Z.col(0) * (vt(0) / Ft(0) - arma::dot(Kt.col(0), Tr)) + Tr);
   } else {
-    at.col(0) = a1 + P1 * T.slice(0).t() * rt.col(0);
+    at.col(0) = a1 + P1 * transition_trans(0, rt.col(0));
   }
   for (unsigned int t = 0; t < (n - 1); t++) {
-    at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * at.col(t) + RR.slice(t * Rtv) * rt.col(t);
+    at.col(t + 1) = C.col(t * Ctv) + transition(t, at.col(t)) + RR.slice(t * Rtv) * rt.col(t);
   }
   
   return at;
 }
 
+/* Kalman filter and fast smoother for general state dimension, templated 
+ * on the time-variation of Z, T and R. For time-invariant system matrices 
+ * the index computations and the extraction of the columns and slices 
+ * are then resolved at compile time and hoisted out of the loops.
+ */
+template <bool ZTV, bool TTV, bool RTV>
+double ssm_ulg::log_likelihood_dynamic() const {
+  
+  const bool structured = T_structure.active();
+  arma::vec at = a1;
+  arma::mat Pt = P1;
+  
+  arma::vec y_tmp = y;
+  if(xreg.n_cols > 0) {
+    y_tmp -= xbeta;
+  }
+  
+  const double LOG2PI = std::log(2.0 * M_PI);
+  double logLik = 0;
+  
+  for (unsigned int t = 0; t < n; t++) {
+    const arma::vec Zt(const_cast<double*>(Z.colptr(ZTV ? t : 0)), m, false, true);
+    const arma::mat& Tt = T.slice(TTV ? t : 0);
+    const arma::mat& RRt = RR.slice(RTV ? t : 0);
+    
+    arma::vec PZ = Pt * Zt;
+    double F = arma::dot(Zt, PZ) + HH(t * Htv);
+    if (arma::is_finite(y_tmp(t)) && F > zero_tol) {
+      double v = y_tmp(t) - D(t * Dtv) - arma::dot(Zt, at);
+      // K = PZ / F
+      at += PZ * (v / F);
+      Pt -= PZ * PZ.t() / F;
+      logLik -= 0.5 * (LOG2PI + std::log(F) + v * v/F);
+    }
+    if (structured) {
+      at = C.col(t * Ctv) + T_structure.times(at);
+      Pt = arma::symmatu(T_structure.sandwich(Pt) + RRt);
+    } else {
+      at = C.col(t * Ctv) + Tt * at;
+      Pt = arma::symmatu(Tt * Pt * Tt.t() + RRt);
+    }
+  }
+  return logLik;
+}
+
+template <bool ZTV, bool TTV, bool RTV>
+void ssm_ulg::fast_smoother_dynamic(arma::mat& at) const {
+  
+  const bool structured = T_structure.active();
+  arma::mat& Pt = workspace.Pt;
+  Pt = P1;
+  arma::vec& vt = workspace.vt;
+  arma::vec& Ft = workspace.Ft;
+  arma::mat& Kt = workspace.Kt;
+  
+  arma::vec& y_tmp = workspace.y_tmp;
+  y_tmp = y;
+  if(xreg.n_cols > 0) {
+    y_tmp -= xbeta;
+  }
+  
+  at.col(0) = a1;
+  arma::vec att(m);
+  for (unsigned int t = 0; t < n; t++) {
+    const arma::vec Zt(const_cast<double*>(Z.colptr(ZTV ? t : 0)), m, false, true);
+    const arma::mat& Tt = T.slice(TTV ? t : 0);
+    const arma::mat& RRt = RR.slice(RTV ? t : 0);
+    
+    att = at.col(t);
+    Ft(t) = arma::as_scalar(Zt.t() * Pt * Zt) + HH(t * Htv);
+    if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol) {
+      Kt.col(t) = Pt * Zt / Ft(t);
+      vt(t) = y_tmp(t) - D(t * Dtv) - arma::dot(Zt, att);
+      att += Kt.col(t) * vt(t);
+      Pt = joseph_cov(t, Pt, Kt.col(t));
+    }
+    if (structured) {
+      at.col(t + 1) = C.col(t * Ctv) + T_structure.times(att);
+      Pt = arma::symmatu(T_structure.sandwich(Pt) + RRt);
+    } else {
+      at.col(t + 1) = C.col(t * Ctv) + Tt * att;
+      Pt = arma::symmatu(Tt * Pt * Tt.t() + RRt);
+    }
+  }
+  
+  arma::mat& rt = workspace.rt;
+  rt.col(n - 1).zeros();
+  arma::vec Tr(m);
+  for (int t = (n - 1); t >= 0; t--) {
+    const arma::vec Zt(const_cast<double*>(Z.colptr(ZTV ? t : 0)), m, false, true);
+    const arma::mat& Tt = T.slice(TTV ? t : 0);
+    
+    if (structured) {
+      Tr = T_structure.trans_times(rt.col(t));
+    } else {
+      Tr = Tt.t() * rt.col(t);
+    }
+    if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol) {
+      // L_t' r_t = T_t' r_t - Z_t K_t' T_t' r_t
+      Tr += Zt * (vt(t) / Ft(t) - arma::dot(Kt.col(t), Tr));
+    }
+    if (t > 0) {
+      rt.col(t - 1) = Tr;
+    }
+  }
+  // Tr is now r_0 for the initial state
+  at.col(0) = a1 + P1 * Tr;
+  
+  for (unsigned int t = 0; t < (n - 1); t++) {
+    const arma::mat& Tt = T.slice(TTV ? t : 0);
+    const arma::mat& RRt = RR.slice(RTV ? t : 0);
+    if (structured) {
+      at.col(t + 1) = C.col(t * Ctv) + T_structure.times(at.col(t)) + RRt * rt.col(t);
+    } else {
+      at.col(t + 1) = C.col(t * Ctv) + Tt * at.col(t) + RRt * rt.col(t);
+    }
+  }
+}
+
+/* Kalman filter and fast smoothers using fixed-size matrices. For small m 
+ * the state vectors and m x m matrices are then stored on the stack instead 
+ * of the heap, the loops over the states can be unrolled by the compiler, 
+ * and the system matrices are copied only if they are time-varying. 
+ * The covariance updates are written as rank-one updates and the 
+ * smoothing recursion uses L_t' r_t = T_t' r_t - Z_t K_t' T_t' r_t, 
+ * so that products of m x m matrices are only needed in T_t P_t T_t'.
+ */
+template <unsigned int M>
+double ssm_ulg::log_likelihood_fixed() const {
+  
+  arma::vec::fixed<M> at(a1);
+  arma::mat::fixed<M, M> Pt(P1);
+  arma::vec::fixed<M> Zt(Z.col(0));
+  arma::mat::fixed<M, M> Tt(T.slice(0));
+  arma::mat::fixed<M, M> RRt(RR.slice(0));
+  arma::vec::fixed<M> PZ;
+  arma::vec::fixed<M> att;
+  arma::mat::fixed<M, M> TP;
+  
+  arma::vec y_tmp = y;
+  if(xreg.n_cols > 0) {
+    y_tmp -= xbeta;
+  }
+  
+  const double LOG2PI = std::log(2.0 * M_PI);
+  double logLik = 0;
+  
+  for (unsigned int t = 0; t < n; t++) {
+    if (Ztv) Zt = Z.col(t);
+    if (Ttv) Tt = T.slice(t);
+    if (Rtv) RRt = RR.slice(t);
+    
+    PZ = Pt * Zt;
+    double F = arma::dot(Zt, PZ) + HH(t * Htv);
+    if (arma::is_finite(y_tmp(t)) && F > zero_tol) {
+      double v = y_tmp(t) - D(t * Dtv) - arma::dot(Zt, at);
+      att = at + PZ * (v / F);
+      // P_t - K_t K_t' F_t where K_t = P_t Z_t / F_t
+      for (unsigned int j = 0; j < M; j++) {
+        for (unsigned int i = 0; i < M; i++) {
+          Pt.at(i, j) -= PZ(i) * PZ(j) / F;
+        }
+      }
+      logLik -= 0.5 * (LOG2PI + std::log(F) + v * v / F);
+    } else {
+      att = at;
+    }
+    at = C.col(t * Ctv) + Tt * att;
+    TP = Tt * Pt;
+    Pt = TP * Tt.t();
+    Pt += RRt;
+    Pt = arma::symmatu(Pt);
+  }
+  return logLik;
+}
+
+template <unsigned int M>
+void ssm_ulg::fast_smoother_fixed(arma::mat& at, arma::vec& Ft, arma::mat& Kt,
+  arma::cube& Lt, const bool store_L) const {
+  
+  arma::mat::fixed<M, M> Pt(P1);
+  arma::vec::fixed<M> Zt(Z.col(0));
+  arma::mat::fixed<M, M> Tt(T.slice(0));
+  arma::mat::fixed<M, M> RRt(RR.slice(0));
+  arma::vec::fixed<M> PZ;
+  arma::vec::fixed<M> K;
+  arma::vec::fixed<M> att;
+  arma::vec::fixed<M> Tr;
+  arma::vec::fixed<M> TK;
+  arma::mat::fixed<M, M> TP;
+  auto update_system = [&](const unsigned int t) {
+    if (Ztv) Zt = Z.col(t);
+    if (Ttv) Tt = T.slice(t);
+    if (Rtv) RRt = RR.slice(t);
+  };
+  
+  arma::vec& vt = workspace.vt;
+  
+  arma::vec& y_tmp = workspace.y_tmp;
+  y_tmp = y;
+  if(xreg.n_cols > 0) {
+    y_tmp -= xbeta;
+  }
+  
+  at.col(0) = a1;
+  for (unsigned int t = 0; t < n; t++) {
+    update_system(t);
+    
+    PZ = Pt * Zt;
+    Ft(t) = arma::dot(Zt, PZ) + HH(t * Htv);
+    if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol) {
+      K = PZ / Ft(t);
+      Kt.col(t) = K;
+      vt(t) = y_tmp(t) - D(t * Dtv) - arma::dot(Zt, at.col(t));
+      att = at.col(t) + K * vt(t);
+      // (I - K_t Z_t') P_t (I - K_t Z_t')' + K_t H_t K_t'
+      for (unsigned int j = 0; j < M; j++) {
+        for (unsigned int i = 0; i < M; i++) {
+          Pt.at(i, j) += Ft(t) * K(i) * K(j) - K(i) * PZ(j) - PZ(i) * K(j);
+        }
+      }
+    } else {
+      att = at.col(t);
+    }
+    at.col(t + 1) = C.col(t * Ctv) + Tt * att;
+    TP = Tt * Pt;
+    Pt = TP * Tt.t();
+    Pt += RRt;
+    Pt = arma::symmatu(Pt);
+  }
+  
+  if (store_L) {
+    Lt.set_size(M, M, n);
+  }
+  arma::mat& rt = workspace.rt;
+  rt.col(n - 1).zeros();
+  for (int t = (n - 1); t >= 0; t--) {
+    update_system(t);
+    Tr = Tt.t() * rt.col(t);
+    if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol) {
+      K = Kt.col(t);
+      if (store_L && t > 0) {
+        // L_t = T_t - T_t K_t Z_t'
+        TK = Tt * K;
+        for (unsigned int j = 0; j < M; j++) {
+          for (unsigned int i = 0; i < M; i++) {
+            Lt.at(i, j, t) = Tt.at(i, j) - TK(i) * Zt(j);
+          }
+        }
+      }
+      Tr += Zt * (vt(t) / Ft(t) - arma::dot(K, Tr));
+    }
+    if (t > 0) {
+      rt.col(t - 1) = Tr;
+    }
+  }
+  // Tr is now r_0 for the initial state
+  at.col(0) = a1 + P1 * Tr;
+  
+  for (unsigned int t = 0; t < (n - 1); t++) {
+    update_system(t);
+    at.col(t + 1) = C.col(t * Ctv) + Tt * at.col(t) + RRt * rt.col(t);
+  }
+}
+
+bool ssm_ulg::fast_smoother_fixed_size(arma::mat& at, arma::vec& Ft, 
+  arma::mat& Kt, arma::cube& Lt, const bool store_L) const {
+  
+  if (m > 5 && T_structure.active()) {
+    return false;
+  }
+  switch (m) {
+  case 1: fast_smoother_fixed<1>(at, Ft, Kt, Lt, store_L); break;
+  case 2: fast_smoother_fixed<2>(at, Ft, Kt, Lt, store_L); break;
+  case 3: fast_smoother_fixed<3>(at, Ft, Kt, Lt, store_L); break;
+  case 4: fast_smoother_fixed<4>(at, Ft, Kt, Lt, store_L); break;
+  case 5: fast_smoother_fixed<5>(at, Ft, Kt, Lt, store_L); break;
+  case 12: fast_smoother_fixed<12>(at, Ft, Kt, Lt, store_L); break;
+  case 13: fast_smoother_fixed<13>(at, Ft, Kt, Lt, store_L); break;
+  default: return false;
+  }
+  return true;
+}
+
 // smoother which returns also cov(alpha_t, alpha_t-1)
 // used in psi particle filter
 void ssm_ulg::smoother_ccov(arma::mat& at, arma::cube& Pt, arma::cube& ccov) const {
@@ -439,15 +789,14 @@ void ssm_ulg::smoother_ccov(arma::mat& at, arma::cube& Pt, arma::cube& ccov) con
     if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol) {
       Kt.col(t) = Pt.slice(t) * Z.col(t * Ztv) / Ft(t);
       vt(t) = arma::as_scalar(y_tmp(t) - D(t * Dtv) - Z.col(t * Ztv).t() * at.col(t));
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * (at.col(t) + Kt.col(t) * vt(t));
+      at.col(t + 1) = C.col(t * Ctv) + transition(t, at.col(t) + Kt.col(t) * vt(t));
       //Pt.slice(t + 1) = arma::symmatu(T.slice(t * Ttv) * (Pt.slice(t) -
       //  Kt.col(t) * Kt.col(t).t() * Ft(t)) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
       // Switched to numerically better form
-      arma::mat tmp = arma::eye(m, m) - Kt.col(t) * Z.col(t * Ztv).t();
-      Pt.slice(t + 1) = arma::symmatu(T.slice(t * Ttv) * (tmp * Pt.slice(t) * tmp.t() + Kt.col(t) * HH(t * Htv) * Kt.col(t).t()) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
+      Pt.slice(t + 1) = arma::symmatu(transition_cov(t, joseph_cov(t, Pt.slice(t), Kt.col(t))) + RR.slice(t * Rtv));
     } else {
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * at.col(t);
-      Pt.slice(t + 1) = arma::symmatu(T.slice(t * Ttv) * Pt.slice(t) * T.slice(t * Ttv).t() +
+      at.col(t + 1) = C.col(t * Ctv) + transition(t, at.col(t));
+      Pt.slice(t + 1) = arma::symmatu(transition_cov(t, Pt.slice(t)) +
         RR.slice(t * Rtv));
     }
     ccov.slice(t) = Pt.slice(t+1); //store for smoothing;
@@ -459,14 +808,14 @@ void ssm_ulg::smoother_ccov(arma::mat& at, arma::cube& Pt, arma::cube& ccov) con
   
   for (int t = (n - 1); t >= 0; t--) {
     if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol){
-      arma::mat L = T.slice(t * Ttv) * (arma::eye(m, m) - Kt.col(t) * Z.col(t * Ztv).t());
+      arma::mat L = T.slice(t * Ttv) - transition(t, Kt.col(t)) * Z.col(t * Ztv).t();
       //P[t+1] stored to ccov_t
       ccov.slice(t) = Pt.slice(t) * L.t() * (arma::eye(m, m) - Nt * ccov.slice(t));
       rt = Z.col(t * Ztv) / Ft(t) * vt(t) + L.t() * rt;
       Nt = arma::symmatu(Z.col(t * Ztv) * Z.col(t * Ztv).t() / Ft(t) + L.t() * Nt * L);
     } else {
       ccov.slice(t) = Pt.slice(t) * T.slice(t * Ttv).t() * (arma::eye(m, m) - Nt * ccov.slice(t));
-      rt = T.slice(t * Ttv).t() * rt;
+      rt = transition_trans(t, rt);
       Nt = arma::symmatu(T.slice(t * Ttv).t() * Nt * T.slice(t * Ttv));
       //P[t+1] stored to ccov_t //CHECK THIS
     }
@@ -497,16 +846,15 @@ double ssm_ulg::filter(arma::mat& at, arma::mat& att, arma::cube& Pt,
       double v = arma::as_scalar(y_tmp(t) - D(t * Dtv) - Z.col(t * Ztv).t() * at.col(t));
       arma::vec K = Pt.slice(t) * Z.col(t * Ztv) / F;
       att.col(t) = at.col(t) + K * v;
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * (att.col(t));
-      arma::mat tmp = arma::eye(m, m) - K * Z.col(t * Ztv).t();
-      Ptt.slice(t) = tmp * Pt.slice(t) * tmp.t() + K * HH(t * Htv) * K.t();
-      Pt.slice(t + 1) = arma::symmatu(T.slice(t * Ttv) * Ptt.slice(t) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
+      at.col(t + 1) = C.col(t * Ctv) + transition(t, att.col(t));
+      Ptt.slice(t) = joseph_cov(t, Pt.slice(t), K);
+      Pt.slice(t + 1) = arma::symmatu(transition_cov(t, Ptt.slice(t)) + RR.slice(t * Rtv));
       logLik -= 0.5 * (LOG2PI + std::log(F) + v * v/F);
     } else {
       att.col(t) = at.col(t);
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * att.col(t);
+      at.col(t + 1) = C.col(t * Ctv) + transition(t, att.col(t));
       Ptt.slice(t) = Pt.slice(t);
-      Pt.slice(t + 1) = arma::symmatu(T.slice(t * Ttv) * Ptt.slice(t) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
+      Pt.slice(t + 1) = arma::symmatu(transition_cov(t, Ptt.slice(t)) + RR.slice(t * Rtv));
     }
   }
   return logLik;
@@ -531,12 +879,11 @@ void ssm_ulg::smoother(arma::mat& at, arma::cube& Pt) const {
     if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol) {
       Kt.col(t) = Pt.slice(t) * Z.col(t * Ztv) / Ft(t);
       vt(t) = arma::as_scalar(y_tmp(t) - D(t * Dtv) - Z.col(t * Ztv).t() * at.col(t));
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * (at.col(t) + Kt.col(t) * vt(t));
-      arma::mat tmp = arma::eye(m, m) - Kt.col(t) * Z.col(t * Ztv).t();
-      Pt.slice(t + 1) = arma::symmatu(T.slice(t * Ttv) * (tmp * Pt.slice(t) * tmp.t() + Kt.col(t) * HH(t * Htv) * Kt.col(t).t()) * T.slice(t * Ttv).t() + RR.slice(t * Rtv));
+      at.col(t + 1) = C.col(t * Ctv) + transition(t, at.col(t) + Kt.col(t) * vt(t));
+      Pt.slice(t + 1) = arma::symmatu(transition_cov(t, joseph_cov(t, Pt.slice(t), Kt.col(t))) + RR.slice(t * Rtv));
     } else {
-      at.col(t + 1) = C.col(t * Ctv) + T.slice(t * Ttv) * at.col(t);
-      Pt.slice(t + 1) = arma::symmatu(T.slice(t * Ttv) * Pt.slice(t) * T.slice(t * Ttv).t() +
+      at.col(t + 1) = C.col(t * Ctv) + transition(t, at.col(t));
+      Pt.slice(t + 1) = arma::symmatu(transition_cov(t, Pt.slice(t)) +
         RR.slice(t * Rtv));
     }
   }
@@ -546,11 +893,11 @@ void ssm_ulg::smoother(arma::mat& at, arma::cube& Pt) const {
   
   for (int t = (n - 1); t >= 0; t--) {
     if (arma::is_finite(y_tmp(t)) && Ft(t) > zero_tol){
-      arma::mat L = T.slice(t * Ttv) * (arma::eye(m, m) - Kt.col(t) * Z.col(t * Ztv).t());
+      arma::mat L = T.slice(t * Ttv) - transition(t, Kt.col(t)) * Z.col(t * Ztv).t();
       rt = Z.col(t * Ztv) / Ft(t) * vt(t) + L.t() * rt;
       Nt = arma::symmatu(Z.col(t * Ztv) * Z.col(t * Ztv).t() / Ft(t) + L.t() * Nt * L);
     } else {
-      rt = T.slice(t * Ttv).t() * rt;
+      rt = transition_trans(t, rt);
       Nt = arma::symmatu(T.slice(t * Ttv).t() * Nt * T.slice(t * Ttv));
     }
     at.col(t) += Pt.slice(t) * rt;
@@ -561,19 +908,17 @@ void ssm_ulg::smoother(arma::mat& at, arma::cube& Pt) const {
 double ssm_ulg::bsf_filter(const unsigned int nsim, arma::cube& alpha,
   arma::mat& weights, arma::umat& indices) {
   
+  workspace.set_size(m, k, nsim);
+  
   arma::mat L_P1 = psd_chol(P1);
   
-  std::normal_distribution<> normal(0.0, 1.0);
+  normal_fill(workspace.um, engine);
   for (unsigned int i = 0; i < nsim; i++) {
-    arma::vec um(m);
-    for(unsigned int j = 0; j < m; j++) {
-      um(j) = normal(engine);
-    }
-    alpha.slice(i).col(0) = a1 + L_P1 * um;
+    alpha.slice(i).col(0) = a1 + L_P1 * workspace.um.col(i);
   }
   
   std::uniform_real_distribution<> unif(0.0, 1.0);
-  arma::vec normalized_weights(nsim);
+  arma::vec& normalized_weights = workspace.normalized_weights;
   double loglik = 0.0;
   
   if(arma::is_finite(y(0))) {
@@ -598,26 +943,23 @@ double ssm_ulg::bsf_filter(const unsigned int nsim, arma::cube& alpha,
   }
   for (unsigned int t = 0; t < n; t++) {
     
-    arma::vec r(nsim);
+    arma::vec& r = workspace.r;
     for (unsigned int i = 0; i < nsim; i++) {
       r(i) = unif(engine);
     }
     
-    indices.col(t) = stratified_sample(normalized_weights, r, nsim);
+    stratified_sample(normalized_weights, r, indices.colptr(t), nsim);
     
-    arma::mat alphatmp(m, nsim);
+    arma::mat& alphatmp = workspace.alphatmp;
     
     for (unsigned int i = 0; i < nsim; i++) {
       alphatmp.col(i) = alpha.slice(indices(i, t)).col(t);
     }
     
+    normal_fill(workspace.uk, engine);
     for (unsigned int i = 0; i < nsim; i++) {
-      arma::vec uk(k);
-      for(unsigned int j = 0; j < k; j++) {
-        uk(j) = normal(engine);
-      }
       alpha.slice(i).col(t + 1) = C.col(t * Ctv) +
-        T.slice(t * Ttv) * alphatmp.col(i) + R.slice(t * Rtv) * uk;
+        transition(t, alphatmp.col(i)) + R.slice(t * Rtv) * workspace.uk.col(i);
     }
     
     if ((t < (n - 1)) && arma::is_finite(y(t + 1))) {
@@ -649,28 +991,24 @@ double ssm_ulg::bsf_filter(const unsigned int nsim, arma::cube& alpha,
 
 void ssm_ulg::psi_filter(const unsigned int nsim, arma::cube& alpha) {
   
-  arma::mat alphahat(m, n + 1);
-  arma::cube Vt(m, m, n + 1);
-  arma::cube Ct(m, m, n + 1);
+  workspace.set_size(m, k, nsim);
+  
+  workspace.set_psi_size(m, n);
+  arma::mat& alphahat = workspace.alphahat;
+  arma::cube& Vt = workspace.Vt;
+  arma::cube& Ct = workspace.Ct;
   smoother_ccov(alphahat, Vt, Ct);
   conditional_cov(Vt, Ct);
   
-  std::normal_distribution<> normal(0.0, 1.0);
+  normal_fill(workspace.um, engine);
   for (unsigned int i = 0; i < nsim; i++) {
-    arma::vec um(m);
-    for(unsigned int j = 0; j < m; j++) {
-      um(j) = normal(engine);
-    }
-    alpha.slice(i).col(0) = alphahat.col(0) + Vt.slice(0) * um;
+    alpha.slice(i).col(0) = alphahat.col(0) + Vt.slice(0) * workspace.um.col(i);
   }
   
   for (unsigned int t = 0; t < n; t++) {
+    normal_fill(workspace.um, engine);
     for (unsigned int i = 0; i < nsim; i++) {
-      arma::vec um(m);
-      for(unsigned int j = 0; j < m; j++) {
-        um(j) = normal(engine);
-      }
-      alpha.slice(i).col(t + 1) = alphahat.col(t + 1) + Ct.slice(t + 1) * (alpha.slice(i).col(t) - alphahat.col(t)) + Vt.slice(t + 1) * um;
+      alpha.slice(i).col(t + 1) = alphahat.col(t + 1) + Ct.slice(t + 1) * (alpha.slice(i).col(t) - alphahat.col(t)) + Vt.slice(t + 1) * workspace.um.col(i);
     }
   }
 }
@@ -708,7 +1046,7 @@ arma::mat ssm_ulg::sample_model(const unsigned int predict_type) {
       uk(j) = normal(engine);
     }
     alpha.col(t + 1) = C.col(t * Ctv) + 
-      T.slice(t * Ttv) * alpha.col(t) + R.slice(t * Rtv) * uk;
+      transition(t, alpha.col(t)) + R.slice(t * Rtv) * uk;
   }
   
   if (predict_type < 3) {
@@ -5,6 +5,9 @@
 
 
 #include "bssm.h"
+#include "filter_workspace.h"
+#include "bsm_transition.h"
+#include "block_tridiag.h"
 #include <sitmo.h>
 
 class ssm_ulg {
@@ -63,6 +66,10 @@ public:
   
   // random number engine
   sitmo::prng_engine engine;
+  // buffers for the particle filters, also used by the const fast smoother
+  mutable filter_workspace workspace;
+  // known structure of T, used instead of dense products if active
+  bsm_transition T_structure;
   // zero-tolerance
   const double zero_tol;
   
@@ -85,6 +92,16 @@ public:
   void compute_HH() { HH = square(H); }
   void compute_xbeta() { xbeta = xreg * beta; }
   
+  void set_bsm_transition(const bool slope, const bool seasonal, 
+    const bool noise);
+  // T_t x, T_t' x, and T_t P T_t'
+  arma::vec transition(const unsigned int t, const arma::vec& x) const;
+  arma::vec transition_trans(const unsigned int t, const arma::vec& x) const;
+  arma::mat transition_cov(const unsigned int t, const arma::mat& P) const;
+  // covariance update of the Kalman filter in Joseph form
+  arma::mat joseph_cov(const unsigned int t, const arma::mat& P, 
+    const arma::vec& K) const;
+  
   
   // compute the log-likelihood
   double log_likelihood() const;
@@ -96,6 +113,13 @@ public:
   void smoother(arma::mat& at, arma::cube& Pt) const;
   // perform fast state smoothing
   arma::mat fast_smoother() const;
+  // fast state smoothing to a preallocated m x (n + 1) matrix
+  void fast_smoother(arma::mat& at) const;
+  // smoothing by solving the block tridiagonal system of the posterior 
+  // precision of the states, also stores the factorization to Q for 
+  // log-likelihood and simulation, returns false if P1, RR or HH (of the 
+  // observed series) is not positive definite
+  bool banded_smoother(arma::mat& at, block_tridiag& Q) const;
   // fast smoothing using precomputed matrices
   arma::mat fast_smoother(const arma::vec& Ft, const arma::mat& Kt,
     const arma::cube& Lt) const;
@@ -104,6 +128,23 @@ public:
     arma::cube& Lt) const;
   // smoothing which also returns covariances cov(alpha_t, alpha_t-1)
   void smoother_ccov(arma::mat& at, arma::cube& Pt, arma::cube& ccov) const;
+  
+  // Kalman filter and fast smoother for general state dimension,
+  // templated on the time-variation of Z, T and R
+  template <bool ZTV, bool TTV, bool RTV>
+  double log_likelihood_dynamic() const;
+  template <bool ZTV, bool TTV, bool RTV>
+  void fast_smoother_dynamic(arma::mat& at) const;
+  // Kalman filter and fast smoother using fixed-size matrices, 
+  // used for small state dimensions
+  template <unsigned int M>
+  double log_likelihood_fixed() const;
+  template <unsigned int M>
+  void fast_smoother_fixed(arma::mat& at, arma::vec& Ft, arma::mat& Kt,
+    arma::cube& Lt, const bool store_L) const;
+  // run fast_smoother_fixed<m>, returns false if there is no kernel for m
+  bool fast_smoother_fixed_size(arma::mat& at, arma::vec& Ft, arma::mat& Kt,
+    arma::cube& Lt, const bool store_L) const;
 
   double bsf_filter(const unsigned int nsim, arma::cube& alpha,
     arma::mat& weights, arma::umat& indices);
@@ -3,7 +3,9 @@
 #include "conditional_dist.h"
 #include "distr_consts.h"
 #include "sample.h"
+#include "rnorm.h"
 #include "rep_mat.h"
+#include "ep_update.h"
 
 // General constructor of ssm_ung object from Rcpp::List
 ssm_ung::ssm_ung(const Rcpp::List model, const unsigned int seed, const double zero_tol) 
@@ -20,6 +22,10 @@ ssm_ung::ssm_ung(const Rcpp::List model, const unsigned int seed, const double z
     distribution(model["distribution"]),
     max_iter(model["max_iter"]), conv_tol(model["conv_tol"]), 
     local_approx(model["local_approx"]),
+    banded_approx(model.containsElementNamed("banded_approx") ? 
+      Rcpp::as<bool>(model["banded_approx"]) : false),
+    ep_iter(model.containsElementNamed("ep_iter") ? 
+      Rcpp::as<unsigned int>(model["ep_iter"]) : 0),
     initial_mode((Rcpp::as<arma::mat>(model["initial_mode"])).t()),
     mode_estimate(initial_mode),
     approx_state(-1),
@@ -91,6 +97,8 @@ void ssm_ung::approximate() {
   
   // check if there is need to update the approximation
   if (approx_state < 1) {
+    workspace.set_smooth_size(m, n);
+    precision.valid = false;
     //update model
     approx_model.Z = Z;
     approx_model.T = T;
@@ -106,9 +114,11 @@ void ssm_ung::approximate() {
     // don't update y and H if using global approximation and we have updated them already
     if(!local_approx & (approx_state == 0)) {
       if (distribution == 0) {
-        mode_estimate = approx_model.fast_smoother().head_cols(n);
+        smooth_approx_model();
+        mode_estimate = workspace.smooth.head_cols(n);
       } else {
-        arma::mat alpha = approx_model.fast_smoother();
+        smooth_approx_model();
+        const arma::mat& alpha = workspace.smooth;
         for (unsigned int t = 0; t < n; t++) {
           mode_estimate.col(t) = xbeta(t) + D(Dtv * t) + 
             Z.col(Ztv * t).t() * alpha.col(t);
@@ -125,9 +135,11 @@ void ssm_ung::approximate() {
         // compute new guess of mode
         arma::mat mode_estimate_new(1, n);
         if (distribution == 0) {
-          mode_estimate_new = approx_model.fast_smoother().head_cols(n);
+          smooth_approx_model();
+          mode_estimate_new = workspace.smooth.head_cols(n);
         } else {
-          arma::mat alpha = approx_model.fast_smoother();
+          smooth_approx_model();
+          const arma::mat& alpha = workspace.smooth;
           for (unsigned int t = 0; t < n; t++) {
             mode_estimate_new.col(t) = xbeta(t) + 
               D(Dtv * t) + Z.col(Ztv * t).t() * alpha.col(t);
@@ -137,12 +149,19 @@ void ssm_ung::approximate() {
         diff = arma::accu(arma::square(mode_estimate_new - mode_estimate)) / n;
         mode_estimate = mode_estimate_new;
       }
+      if (ep_iter > 0) {
+        ep_approx();
+      }
     }
     approx_state = 1;
   }
 }
 // construct approximating model from fixed mode estimate, no iterations
 // used in IS-correction
+// With ep_iter > 0, the stored mode estimate is the smoothed signal of the 
+// EP-refined model, not the Laplace mode, so the pseudo-observations are 
+// re-linearised at it and the EP sweeps are run again from there. The result 
+// is close to, but not exactly, the approximation of approximate().
 void ssm_ung::approximate_for_is(const arma::mat& mode_estimate_) {
   
   approx_model.Z = Z;
@@ -158,6 +177,10 @@ void ssm_ung::approximate_for_is(const arma::mat& mode_estimate_) {
   //Construct y and H for the Gaussian model
   mode_estimate = mode_estimate_;
   laplace_iter(arma::vectorise(mode_estimate));
+  precision.valid = false;
+  if (ep_iter > 0) {
+    ep_approx();
+  }
   update_scales();
   approx_loglik = 0.0;
   approx_state = 2;
@@ -186,7 +209,7 @@ arma::vec ssm_ung::log_likelihood(
           approximate(); 
         }
         // compute the log-likelihood of the approximate model
-        double gaussian_loglik = approx_model.log_likelihood();
+        double gaussian_loglik = approx_model_loglik();
         // compute unnormalized mode-based correction terms 
         // log[g(y_t | ^alpha_t) / ~g(y_t | ^alpha_t)]
         update_scales();
@@ -201,7 +224,7 @@ arma::vec ssm_ung::log_likelihood(
         loglik(0) = psi_filter(nsim, alpha, weights, indices);
       } else {
         //SPDK
-        alpha = approx_model.simulate_states(nsim, true);
+        alpha = simulate_approx_states(nsim);
         arma::vec w(nsim, arma::fill::zeros);
         for (unsigned int t = 0; t < n; t++) {
           w += log_weights(t, alpha);
@@ -222,7 +245,7 @@ arma::vec ssm_ung::log_likelihood(
         approximate(); 
       }
       // compute the log-likelihood of the approximate model
-      double gaussian_loglik = approx_model.log_likelihood();
+      double gaussian_loglik = approx_model_loglik();
       // compute unnormalized mode-based correction terms 
       // log[g(y_t | ^alpha_t) / ~g(y_t | ^alpha_t)]
       update_scales();
@@ -268,7 +291,7 @@ void ssm_ung::update_scales() {
     for(unsigned int t = 0; t < n; t++) {
       if (arma::is_finite(y(t))) {
         scales(t) = y(t) * mode_estimate(t) -
-          u(t) * std::log1p(std::exp(mode_estimate(t))) +
+          u(t) * log1p_exp(mode_estimate(t)) +
           0.5 * std::pow((approx_model.y(t) - mode_estimate(t)) / approx_model.H(t), 2.0);
       }
     }
@@ -286,6 +309,47 @@ void ssm_ung::update_scales() {
   }
 }
 
+void ssm_ung::smooth_approx_model() {
+  
+  if (!banded_approx || 
+      !approx_model.banded_smoother(workspace.smooth, precision)) {
+    approx_model.fast_smoother(workspace.smooth);
+  }
+}
+
+double ssm_ung::approx_model_loglik() const {
+  
+  if (precision.valid) {
+    return precision.log_likelihood();
+  }
+  return approx_model.log_likelihood();
+}
+
+arma::cube ssm_ung::simulate_approx_states(const unsigned int nsim) {
+  
+  if (!precision.valid) {
+    return approx_model.simulate_states(nsim, true);
+  }
+  arma::cube asim(m, n + 1, nsim);
+  arma::mat z(m, n);
+  arma::vec uk(k);
+  const arma::mat& Tn = approx_model.T.slice((n - 1) * Ttv);
+  const arma::mat& Rn = approx_model.R.slice((n - 1) * Rtv);
+  arma::vec Cn = approx_model.C.col((n - 1) * Ctv);
+  for (unsigned int i = 0; i < nsim; i += 2) {
+    normal_fill(z, approx_model.engine);
+    normal_fill(uk, approx_model.engine);
+    precision.sample(z, asim.slice(i));
+    asim.slice(i).col(n) = Cn + Tn * asim.slice(i).col(n - 1) + Rn * uk;
+    if (i + 1 < nsim) {
+      precision.sample(z, asim.slice(i + 1), -1.0);
+      asim.slice(i + 1).col(n) = Cn + Tn * asim.slice(i + 1).col(n - 1) - 
+        Rn * uk;
+    }
+  }
+  return asim;
+}
+
 // given the current guess of mode, compute new values of y and H of
 // approximate model
 /* distribution:
@@ -337,6 +401,80 @@ void ssm_ung::laplace_iter(const arma::vec& signal) {
 }
 
 
+// Starting from the Laplace approximation, each sweep computes the smoothed 
+// means and variances of the signal under the current approximating model 
+// and updates all sites in parallel with damping 0.5
+void ssm_ung::ep_approx() {
+  
+  workspace.set_smooth_size(m, n);
+  arma::vec nodes;
+  arma::vec weights;
+  gauss_hermite(20, nodes, weights);
+  
+  arma::vec tau = 1.0 / approx_model.HH;
+  arma::vec nu = approx_model.y % tau;
+  arma::vec signal_mean(n, arma::fill::zeros);
+  arma::mat at(m, n + 1);
+  arma::cube Pt(m, m, n + 1);
+  
+  unsigned int i = 0;
+  double diff = conv_tol + 1;
+  while(i < ep_iter && diff > conv_tol) {
+    i++;
+    approx_model.smoother(at, Pt);
+    if (!at.is_finite() || !Pt.is_finite()) {
+      break;
+    }
+    arma::vec signal_mean_new(n);
+    for (unsigned int t = 0; t < n; t++) {
+      const arma::vec& Zt = Z.col(Ztv * t);
+      signal_mean_new(t) = xbeta(t) + D(Dtv * t) + arma::dot(Zt, at.col(t));
+      if (arma::is_finite(y(t))) {
+        double var = arma::as_scalar(Zt.t() * Pt.slice(t) * Zt);
+        ep_site_update(signal_mean_new(t), var, 
+          [&](const double signal) { return log_signal_density(t, signal); },
+          nodes, weights, 0.5, tau(t), nu(t));
+      }
+    }
+    diff = arma::accu(arma::square(signal_mean_new - signal_mean)) / n;
+    signal_mean = signal_mean_new;
+    
+    arma::uvec obs = arma::find_finite(y);
+    approx_model.HH(obs) = 1.0 / tau(obs);
+    approx_model.y(obs) = nu(obs) / tau(obs);
+    approx_model.H = arma::sqrt(approx_model.HH);
+  }
+  
+  smooth_approx_model();
+  const arma::mat& alpha = workspace.smooth;
+  if (distribution == 0) {
+    mode_estimate = alpha.head_cols(n);
+  } else {
+    for (unsigned int t = 0; t < n; t++) {
+      mode_estimate.col(t) = xbeta(t) + D(Dtv * t) + 
+        Z.col(Ztv * t).t() * alpha.col(t);
+    }
+  }
+}
+
+double ssm_ung::log_signal_density(const unsigned int t, 
+  const double signal) const {
+  
+  switch(distribution) {
+  case 0: 
+    return -0.5 * (signal + std::pow(y(t) / phi, 2.0) * std::exp(-signal));
+  case 1: 
+    return y(t) * signal - u(t) * std::exp(signal);
+  case 2: 
+    return y(t) * signal - u(t) * log1p_exp(signal);
+  case 3: 
+    return y(t) * signal - 
+      (y(t) + phi) * std::log(phi + u(t) * std::exp(signal));
+  case 4:
+    return -phi * (signal + y(t) * std::exp(-signal) / u(t));
+  }
+  return 0.0;
+}
 
 // these are really not constant in all cases (note phi)
 double ssm_ung::compute_const_term() {
@@ -404,7 +542,7 @@ arma::vec ssm_ung::log_weights(
       for (unsigned int i = 0; i < alpha.n_slices; i++) {
         double simsignal = arma::as_scalar(D(t * Dtv) + Z.col(t * Ztv).t() *
           alpha.slice(i).col(t) + xbeta(t));
-        weights(i) = y(t) * simsignal - u(t) * std::log1p(std::exp(simsignal)) +
+        weights(i) = y(t) * simsignal - u(t) * log1p_exp(simsignal) +
           0.5 * std::pow((approx_model.y(t) - simsignal) / approx_model.H(t), 2.0);
       }
       break;
@@ -464,7 +602,7 @@ arma::vec ssm_ung::log_obs_density(const unsigned int t,
       for (unsigned int i = 0; i < alpha.n_slices; i++) {
         double simsignal = arma::as_scalar(D(t * Dtv) + Z.col(t * Ztv).t() *
           alpha.slice(i).col(t) + xbeta(t));
-        weights(i) = y(t) * simsignal - u(t) * std::log1p(std::exp(simsignal));
+        weights(i) = y(t) * simsignal - u(t) * log1p_exp(simsignal);
       }
       break;
     case 3  :
@@ -507,13 +645,15 @@ arma::vec ssm_ung::log_obs_density(const unsigned int t,
 double ssm_ung::psi_filter(const unsigned int nsim, arma::cube& alpha, 
   arma::mat& weights, arma::umat& indices) {
   
+  workspace.set_size(m, k, nsim);
+  
   if(approx_state < 2) {
     if (approx_state < 1) {
       mode_estimate = initial_mode;
       approximate(); 
     }
     // compute the log-likelihood of the approximate model
-    double gaussian_loglik = approx_model.log_likelihood();
+    double gaussian_loglik = approx_model_loglik();
     // compute unnormalized mode-based correction terms 
     // log[g(y_t | ^alpha_t) / ~g(y_t | ^alpha_t)]
     update_scales();
@@ -523,24 +663,20 @@ double ssm_ung::psi_filter(const unsigned int nsim, arma::cube& alpha,
     approx_loglik = gaussian_loglik + const_term + arma::accu(scales);
   }
   
-  arma::mat alphahat(m, n + 1);
-  arma::cube Vt(m, m, n + 1);
-  arma::cube Ct(m, m, n + 1);
+  workspace.set_psi_size(m, n);
+  arma::mat& alphahat = workspace.alphahat;
+  arma::cube& Vt = workspace.Vt;
+  arma::cube& Ct = workspace.Ct;
   approx_model.smoother_ccov(alphahat, Vt, Ct);
   conditional_cov(Vt, Ct);
   
-  std::normal_distribution<> normal(0.0, 1.0);
-  
+  normal_fill(workspace.um, engine);
   for (unsigned int i = 0; i < nsim; i++) {
-    arma::vec um(m);
-    for(unsigned int j = 0; j < m; j++) {
-      um(j) = normal(engine);
-    }
-    alpha.slice(i).col(0) = alphahat.col(0) + Vt.slice(0) * um;
+    alpha.slice(i).col(0) = alphahat.col(0) + Vt.slice(0) * workspace.um.col(i);
   }
   
   std::uniform_real_distribution<> unif(0.0, 1.0);
-  arma::vec normalized_weights(nsim);
+  arma::vec& normalized_weights = workspace.normalized_weights;
   double loglik = 0.0;
   if(arma::is_finite(y(0))) {
     weights.col(0) = arma::exp(log_weights(0, alpha) - scales(0));
@@ -558,24 +694,21 @@ double ssm_ung::psi_filter(const unsigned int nsim, arma::cube& alpha,
   }
   
   for (unsigned int t = 0; t < n; t++) {
-    arma::vec r(nsim);
+    arma::vec& r = workspace.r;
     for (unsigned int i = 0; i < nsim; i++) {
       r(i) = unif(engine);
     }
-    indices.col(t) = stratified_sample(normalized_weights, r, nsim);
+    stratified_sample(normalized_weights, r, indices.colptr(t), nsim);
     
-    arma::mat alphatmp(m, nsim);
+    arma::mat& alphatmp = workspace.alphatmp;
     
     for (unsigned int i = 0; i < nsim; i++) {
       alphatmp.col(i) = alpha.slice(indices(i, t)).col(t);
     }
+    normal_fill(workspace.um, engine);
     for (unsigned int i = 0; i < nsim; i++) {
-      arma::vec um(m);
-      for(unsigned int j = 0; j < m; j++) {
-        um(j) = normal(engine);
-      }
       alpha.slice(i).col(t + 1) = alphahat.col(t + 1) +
-        Ct.slice(t + 1) * (alphatmp.col(i) - alphahat.col(t)) + Vt.slice(t + 1) * um;
+        Ct.slice(t + 1) * (alphatmp.col(i) - alphahat.col(t)) + Vt.slice(t + 1) * workspace.um.col(i);
     }
     
     if ((t < (n - 1)) && arma::is_finite(y(t + 1))) {
@@ -599,23 +732,24 @@ double ssm_ung::psi_filter(const unsigned int nsim, arma::cube& alpha,
 double ssm_ung::bsf_filter(const unsigned int nsim, arma::cube& alpha,
   arma::mat& weights, arma::umat& indices) {
   
+  workspace.set_size(m, k, nsim);
+  
   arma::uvec nonzero = arma::find(P1.diag() > 0);
   arma::mat L_P1(m, m, arma::fill::zeros);
   if (nonzero.n_elem > 0) {
     L_P1.submat(nonzero, nonzero) =
       arma::chol(P1.submat(nonzero, nonzero), "lower");
   }
-  std::normal_distribution<> normal(0.0, 1.0);
+  // normal variates of all particles are drawn at once
+  arma::mat& um = workspace.um;
+  normal_fill(um, engine);
+  um = L_P1 * um;
   for (unsigned int i = 0; i < nsim; i++) {
-    arma::vec um(m);
-    for(unsigned int j = 0; j < m; j++) {
-      um(j) = normal(engine);
-    }
-    alpha.slice(i).col(0) = a1 + L_P1 * um;
+    alpha.slice(i).col(0) = a1 + um.col(i);
   }
   
   std::uniform_real_distribution<> unif(0.0, 1.0);
-  arma::vec normalized_weights(nsim);
+  arma::vec& normalized_weights = workspace.normalized_weights;
   double loglik = 0.0;
   
   if(arma::is_finite(y(0))) {
@@ -633,28 +767,27 @@ double ssm_ung::bsf_filter(const unsigned int nsim, arma::cube& alpha,
     weights.col(0).ones();
     normalized_weights.fill(1.0 / nsim);
   }
+  // buffer for the normal variates of the state equation
+  arma::mat& uk = workspace.uk;
   for (unsigned int t = 0; t < n; t++) {
     
-    arma::vec r(nsim);
+    arma::vec& r = workspace.r;
     for (unsigned int i = 0; i < nsim; i++) {
       r(i) = unif(engine);
     }
     
-    indices.col(t) = stratified_sample(normalized_weights, r, nsim);
+    stratified_sample(normalized_weights, r, indices.colptr(t), nsim);
     
-    arma::mat alphatmp(m, nsim);
+    arma::mat& alphatmp = workspace.alphatmp;
     
     for (unsigned int i = 0; i < nsim; i++) {
       alphatmp.col(i) = alpha.slice(indices(i, t)).col(t);
     }
     
+    normal_fill(uk, engine);
+    alphatmp = T.slice(t * Ttv) * alphatmp + R.slice(t * Rtv) * uk;
     for (unsigned int i = 0; i < nsim; i++) {
-      arma::vec uk(k);
-      for(unsigned int j = 0; j < k; j++) {
-        uk(j) = normal(engine);
-      }
-      alpha.slice(i).col(t + 1) = C.col(t * Ctv) +
-        T.slice(t * Ttv) * alphatmp.col(i) + R.slice(t * Rtv) * uk;
+      alpha.slice(i).col(t + 1) = C.col(t * Ctv) + alphatmp.col(i);
     }
     
     if ((t < (n - 1)) && arma::is_finite(y(t + 1))) {
@@ -5,6 +5,7 @@
 #define SSM_UNG_H
 
 #include "bssm.h"
+#include "filter_workspace.h"
 #include <sitmo.h>
 
 #include "model_ssm_ulg.h"
@@ -50,6 +51,12 @@ public:
   unsigned int max_iter;
   double conv_tol;
   const bool local_approx;
+  // find the mode of the approximation using the block tridiagonal 
+  // precision of the states instead of the Kalman smoother
+  const bool banded_approx;
+  // number of expectation propagation sweeps refining the Laplace 
+  // approximation, 0 for the plain Laplace approximation
+  unsigned int ep_iter;
   const arma::mat initial_mode; // creating approx always starts from here
   arma::mat mode_estimate; // current estimate of mode
   
@@ -63,6 +70,8 @@ public:
   
   // random number engine
   sitmo::prng_engine engine;
+  // buffers for the particle filters
+  filter_workspace workspace;
   // zero-tolerance
   const double zero_tol;
   
@@ -74,6 +83,8 @@ public:
   const Rcpp::Function prior_fn;
   
   ssm_ulg approx_model;
+  // factorized precision of the states of approx_model if banded_approx
+  block_tridiag precision;
   
   virtual void update_model(const arma::vec& new_theta);
   virtual double log_prior_pdf(const arma::vec& x) const;
@@ -96,6 +107,19 @@ public:
   void approximate_for_is(const arma::mat& mode_estimate_);
   // given the mode_estimate, compute y and H of the approximating Gaussian model
   void laplace_iter(const arma::vec& signal);
+  // refine y and H of the approximating model by matching the moments of 
+  // the signal, and update the mode_estimate to the smoothed signal
+  void ep_approx();
+  // unnormalized log-density of y_t given the signal
+  double log_signal_density(const unsigned int t, const double signal) const;
+  // smoothed states of approx_model to workspace.smooth, using 
+  // banded_smoother if banded_approx and fast_smoother otherwise
+  void smooth_approx_model();
+  // log-likelihood of approx_model, using the factorized precision if valid
+  double approx_model_loglik() const;
+  // simulate from the smoothing distribution of approx_model with 
+  // antithetic variables, using the factorized precision if valid
+  arma::cube simulate_approx_states(const unsigned int nsim);
 
   // psi-particle filter
   double psi_filter(const unsigned int nsim, arma::cube& alpha, 
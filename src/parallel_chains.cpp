@@ -0,0 +1,75 @@
+#include "parallel_chains.h"
+
+chain_exchange::chain_exchange(const arma::vec& betas,
+  const unsigned int swap_interval, const unsigned int iter,
+  const unsigned int seed) :
+  betas(betas), n_chains(betas.n_elem), swap_interval(swap_interval),
+  n_rounds(swap_interval > 0 ? iter / swap_interval : 0),
+  swap_attempts(arma::uvec(n_chains - 1, arma::fill::zeros)),
+  swap_accepted(arma::uvec(n_chains - 1, arma::fill::zeros)),
+  error_message(""), states(n_chains),
+  rounds(arma::uvec(n_chains, arma::fill::zeros)), round(0),
+  failed(false), stop(false), engine(seed + 2 * n_chains) {
+}
+
+// Each chain stores its state, and one thread proposes swaps between adjacent
+// chains, alternating between even and odd pairs of chains.
+// This needs to be called by all chains at the same iteration.
+bool chain_exchange::swap(const unsigned int chain, chain_state& state,
+  bool& swapped) {
+
+  states[chain] = state;
+  rounds(chain)++;
+
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif
+{
+  ids.resize(n_chains);
+  for (unsigned int k = 0; k < n_chains; k++) {
+    ids[k] = k;
+  }
+  if (!failed) {
+    std::uniform_real_distribution<> unif(0.0, 1.0);
+    for (unsigned int k = round % 2; k + 1 < n_chains; k += 2) {
+      swap_attempts(k)++;
+      double log_alpha = (betas(k) - betas(k + 1)) *
+        (states[k + 1].loglik(0) - states[k].loglik(0));
+      if (std::log(unif(engine)) < log_alpha) {
+        std::swap(states[k], states[k + 1]);
+        std::swap(ids[k], ids[k + 1]);
+        swap_accepted(k)++;
+      }
+    }
+  }
+  round++;
+  // the flag is read only after the barrier so all chains stop at the same round
+  stop = failed;
+}
+  swapped = ids[chain] != chain;
+  if (swapped) {
+    state = states[chain];
+  }
+  return !stop;
+}
+
+void chain_exchange::fail(const unsigned int chain, const std::string& msg) {
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+{
+  failed = true;
+  if (error_message.empty()) {
+    error_message = msg;
+  }
+}
+  // take part in the next swap round so that the other chains are not left
+  // waiting for this one
+  if (rounds(chain) < n_rounds) {
+    bool swapped;
+    chain_state state = states[chain];
+    swap(chain, state, swapped);
+  }
+}
@@ -0,0 +1,192 @@
+// running multiple MCMC chains in parallel, optionally with tempered chains
+// and swap moves between the adjacent chains (parallel tempering)
+
+#ifndef PARALLEL_CHAINS_H
+#define PARALLEL_CHAINS_H
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <sitmo.h>
+#include "bssm.h"
+#include "mcmc.h"
+#include "rng_streams.h"
+
+// current state of the chain, exchanged between the chains in swap moves
+struct chain_state {
+  arma::vec theta;
+  double logprior;
+  // first element is the log-likelihood (estimate) which is tempered
+  arma::vec loglik;
+  // sampled states or the mode estimate
+  arma::mat alpha;
+  arma::mat alphahat;
+  arma::cube Vt;
+};
+
+class chain_exchange {
+
+public:
+
+  chain_exchange(const arma::vec& betas, const unsigned int swap_interval,
+    const unsigned int iter, const unsigned int seed);
+
+  // inverse temperatures of the chains, first chain is the untempered one
+  const arma::vec betas;
+  const unsigned int n_chains;
+  // number of iterations between the swap moves, zero for independent chains
+  const unsigned int swap_interval;
+  // total number of swap rounds
+  const unsigned int n_rounds;
+
+  // called by all the chains at the same iteration,
+  // returns false if some chain has failed and the chains should stop
+  bool swap(const unsigned int chain, chain_state& state, bool& swapped);
+  // mark the chain as failed so that the other chains can stop as well
+  void fail(const unsigned int chain, const std::string& msg);
+
+  arma::uvec swap_attempts;
+  arma::uvec swap_accepted;
+  std::string error_message;
+
+private:
+
+  std::vector<chain_state> states;
+  std::vector<unsigned int> ids;
+  arma::uvec rounds;
+  unsigned int round;
+  bool failed;
+  bool stop;
+  sitmo::prng_engine engine;
+};
+
+template <class M, class T, class F>
+void mcmc::run_chains(M& main_chain, const T& model, F sampler) {
+
+  unsigned int n_chains = chain_betas.n_elem;
+  bool tempering = swap_interval > 0;
+
+#ifndef _OPENMP
+  if (tempering) {
+    Rcpp::stop("Tempering of parallel chains requires OpenMP support.");
+  }
+#endif
+  // check the initial value here, as errors within parallel region are not passed to R
+  if (!arma::is_finite(model.log_prior_pdf(model.theta))) {
+    Rcpp::stop("Initial prior probability is not finite.");
+  }
+
+  chain_exchange exchange(chain_betas, swap_interval, iter, chain_seed);
+
+  // copies are made here as copying R objects is not thread safe
+  std::vector<M> chains(n_chains, main_chain);
+  std::vector<T> models(n_chains, model);
+  for (unsigned int k = 0; k < n_chains; k++) {
+    chains[k].exchange = &exchange;
+    chains[k].chain_id = k;
+    chains[k].beta = chain_betas(k);
+    // independent streams for each chain
+    set_streams(models[k], chain_seed, k, 0);
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(n_chains) default(shared)
+{
+  unsigned int n_team = omp_get_num_threads();
+  if (tempering && n_team != n_chains) {
+    if (omp_get_thread_num() == 0) {
+      exchange.error_message = "Could not start a separate thread for each tempered chain.";
+    }
+  } else {
+    for (unsigned int k = omp_get_thread_num(); k < n_chains; k += n_team) {
+      try {
+        sampler(chains[k], models[k]);
+      } catch (std::exception& e) {
+        exchange.fail(k, e.what());
+      } catch (...) {
+        exchange.fail(k, "Unknown error in parallel chain.");
+      }
+    }
+  }
+}
+#else
+  for (unsigned int k = 0; k < n_chains; k++) {
+    sampler(chains[k], models[k]);
+  }
+#endif
+
+  if (!exchange.error_message.empty()) {
+    Rcpp::stop(exchange.error_message);
+  }
+
+  main_chain.merge_chains(chains, tempering);
+  if (tempering) {
+    swap_rate.zeros(n_chains - 1);
+    for (unsigned int k = 0; k < n_chains - 1; k++) {
+      if (exchange.swap_attempts(k) > 0) {
+        swap_rate(k) = double(exchange.swap_accepted(k)) / exchange.swap_attempts(k);
+      }
+    }
+  }
+}
+
+// combine the output of the chains, in case of tempering only the first
+// (untempered) chain is used
+template <class M>
+void mcmc::merge_chains(const std::vector<M>& chains, const bool tempered) {
+
+  unsigned int n_chains = chains.size();
+  unsigned int n_used = tempered ? 1 : n_chains;
+
+  chain_acceptance_rate.set_size(n_chains);
+  unsigned int n_merged = 0;
+  for (unsigned int k = 0; k < n_chains; k++) {
+    chain_acceptance_rate(k) = chains[k].acceptance_rate;
+    if (k < n_used) n_merged += chains[k].n_stored;
+  }
+
+  theta_storage.set_size(n_par, n_merged);
+  posterior_storage.set_size(n_merged);
+  count_storage.set_size(n_merged);
+  chain_storage.set_size(n_merged);
+  if (output_type == 1) {
+    alpha_storage.set_size(alpha_storage.n_rows, alpha_storage.n_cols, n_merged);
+  }
+  unsigned int start = 0;
+  for (unsigned int k = 0; k < n_used; k++) {
+    unsigned int n_k = chains[k].n_stored;
+    if (n_k > 0) {
+      unsigned int end = start + n_k - 1;
+      theta_storage.cols(start, end) = chains[k].theta_storage;
+      posterior_storage.rows(start, end) = chains[k].posterior_storage;
+      count_storage.rows(start, end) = chains[k].count_storage;
+      chain_storage.rows(start, end).fill(k + 1);
+      if (output_type == 1) {
+        alpha_storage.slices(start, end) = chains[k].alpha_storage;
+      }
+    }
+    start += n_k;
+  }
+
+  if (output_type == 2) {
+    // Var[E(alpha)] + E[Var(alpha)] over the chains
+    alphahat.zeros();
+    Vt.zeros();
+    for (unsigned int k = 0; k < n_used; k++) {
+      alphahat += chains[k].alphahat / n_used;
+      Vt += chains[k].Vt / n_used;
+    }
+    for (unsigned int k = 0; k < n_used; k++) {
+      arma::mat diff = chains[k].alphahat - alphahat;
+      for (unsigned int t = 0; t < alphahat.n_cols; t++) {
+        Vt.slice(t) += diff.col(t) * diff.col(t).t() / n_used;
+      }
+    }
+  }
+
+  S = chains[0].S;
+  acceptance_rate = arma::mean(chain_acceptance_rate.head(n_used));
+  n_stored = n_merged;
+}
+
+#endif
@@ -0,0 +1,64 @@
+// reproducible random number streams based on the counter-based sitmo engine,
+// so that the results of the parallel computations do not depend on the
+// number of threads or on the order of the computations
+
+#ifndef RNG_STREAMS_H
+#define RNG_STREAMS_H
+
+#include <sitmo.h>
+#include "bssm.h"
+#include "model_ssm_mng.h"
+#include "model_ssm_ung.h"
+#include "model_ssm_nlg.h"
+#include "model_ssm_sde.h"
+#include "model_ssm_msde.h"
+
+// engine for the stream identified by the key (derived from the seed),
+// chain, index (e.g. of the posterior sample), and substream
+inline sitmo::prng_engine stream_engine(const uint64_t key, const uint64_t chain,
+  const uint64_t index, const uint64_t substream = 0) {
+  sitmo::prng_engine engine;
+  engine.set_key(key, chain, index, substream);
+  return engine;
+}
+
+// draw a new 64-bit key from the engine
+inline uint64_t draw_key(sitmo::prng_engine& engine) {
+  uint64_t key = engine();
+  return (key << 32) | engine();
+}
+
+// set the additional random number generators of the model
+inline void set_extra_streams(void* model, const uint64_t key,
+  const uint64_t chain, const uint64_t index) {}
+inline void set_extra_streams(ssm_ung* model, const uint64_t key,
+  const uint64_t chain, const uint64_t index) {
+  model->approx_model.engine = stream_engine(key, chain, index, 1);
+}
+inline void set_extra_streams(ssm_mng* model, const uint64_t key,
+  const uint64_t chain, const uint64_t index) {
+  model->approx_model.engine = stream_engine(key, chain, index, 1);
+}
+inline void set_extra_streams(ssm_nlg* model, const uint64_t key,
+  const uint64_t chain, const uint64_t index) {
+  model->approx_model.engine = stream_engine(key, chain, index, 1);
+}
+inline void set_extra_streams(ssm_sde* model, const uint64_t key,
+  const uint64_t chain, const uint64_t index) {
+  model->coarse_engine = stream_engine(key, chain, index, 1);
+}
+inline void set_extra_streams(ssm_msde* model, const uint64_t key,
+  const uint64_t chain, const uint64_t index) {
+  model->coarse_engine = stream_engine(key, chain, index, 1);
+}
+
+// set all random number generators of the model to the streams of
+// (key, chain, index)
+template <class T>
+void set_streams(T& model, const uint64_t key, const uint64_t chain,
+  const uint64_t index) {
+  model.engine = stream_engine(key, chain, index, 0);
+  set_extra_streams(&model, key, chain, index);
+}
+
+#endif
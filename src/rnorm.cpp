@@ -0,0 +1,31 @@
+#include "rnorm.h"
+
+// uniform variate on (0, 1] with 53 random bits from two outputs of the engine
+inline double unif53(sitmo::prng_engine& engine) {
+  uint64_t a = engine() >> 5;
+  uint64_t b = engine() >> 6;
+  return (a * 67108864.0 + b + 1.0) / 9007199254740992.0;
+}
+
+// Box-Muller transform, which unlike the polar method of 
+// std::normal_distribution needs no rejection step. The uniforms are 
+// drawn first so that the transformation loop can be vectorised.
+void normal_fill(double* x, const unsigned int n, sitmo::prng_engine& engine) {
+  
+  for (unsigned int i = 0; i < n; i++) {
+    x[i] = unif53(engine);
+  }
+  double u_last = n % 2 ? unif53(engine) : 0.0;
+  
+  const double two_pi = 2.0 * arma::datum::pi;
+  unsigned int n2 = n - n % 2;
+  for (unsigned int i = 0; i < n2; i += 2) {
+    double r = std::sqrt(-2.0 * std::log(x[i]));
+    double phi = two_pi * x[i + 1];
+    x[i] = r * std::cos(phi);
+    x[i + 1] = r * std::sin(phi);
+  }
+  if (n2 < n) {
+    x[n2] = std::sqrt(-2.0 * std::log(x[n2])) * std::cos(two_pi * u_last);
+  }
+}
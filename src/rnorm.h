@@ -0,0 +1,17 @@
+// generation of standard normal variates in bulk
+
+#ifndef RNORM_H
+#define RNORM_H
+
+#include <sitmo.h>
+#include "bssm.h"
+
+// fill x[0], ..., x[n - 1] with independent standard normal variates
+void normal_fill(double* x, const unsigned int n, sitmo::prng_engine& engine);
+
+// fill the vector or matrix x with independent standard normal variates
+inline void normal_fill(arma::mat& x, sitmo::prng_engine& engine) {
+  normal_fill(x.memptr(), x.n_elem, engine);
+}
+
+#endif
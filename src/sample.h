@@ -4,5 +4,8 @@
 #include "bssm.h"
 
 arma::uvec stratified_sample(arma::vec& p, const arma::vec& r, const unsigned int N);
+// writes the samples to xp without temporaries
+void stratified_sample(arma::vec& p, const arma::vec& r, arma::uword* xp, 
+  const unsigned int N);
 
 #endif
@@ -9,20 +9,29 @@
 arma::uvec stratified_sample(arma::vec& p, const arma::vec& r, const unsigned int N) {
 
   arma::uvec xp(N);
-  p = arma::cumsum(p);
+  stratified_sample(p, r, xp.memptr(), N);
+  return xp;
+}
+
+// p is replaced by its cumulative sum
+void stratified_sample(arma::vec& p, const arma::vec& r, arma::uword* xp, 
+  const unsigned int N) {
+  
+  for(unsigned int k = 1; k < p.n_elem; k++) {
+    p(k) += p(k - 1);
+  }
   p(p.n_elem - 1) = 1;
   
   unsigned int j = 0;
   double alpha = 1.0/N;
   for(unsigned int k = 0; k < p.n_elem && j < N; k++) {
     while (j < N && (r(j) + j) * alpha <= p(k)) {
-      xp(j) = k;
+      xp[j] = k;
       j++;
     }
   }
   while (j < N) {
-    xp(j) = p.n_elem - 1;
+    xp[j] = p.n_elem - 1;
     j++;
   }
-  return xp;
 }
@@ -0,0 +1,56 @@
+// Two independent Ornstein-Uhlenbeck processes with Gaussian observations 
+// for the tests of ssm_msde models
+// dx_it = -\rho x_it dt + \sigma dB_it, y_it ~ N(x_it, sd_y^2), i = 1, 2
+
+#include <RcppArmadillo.h>
+// [[Rcpp::depends(RcppArmadillo)]]
+
+// theta(0) = rho
+// theta(1) = sigma
+// theta(2) = sd_y
+
+arma::vec drift(const arma::vec& x, const arma::vec& theta) {
+  return -theta(0) * x;
+}
+
+arma::mat diffusion(const arma::vec& x, const arma::vec& theta) {
+  return theta(1) * arma::eye(x.n_elem, x.n_elem);
+}
+
+double log_prior_pdf(const arma::vec& theta) {
+  
+  if(arma::any(theta <= 0.0)) {
+    return -std::numeric_limits<double>::infinity();
+  }
+  return R::dnorm(theta(0), 0, 10, 1) + R::dnorm(theta(1), 0, 10, 1) + 
+    R::dnorm(theta(2), 0, 10, 1);
+}
+
+arma::vec log_obs_density(const arma::vec& y, 
+  const arma::mat& alpha, const arma::vec& theta) {
+  
+  arma::vec log_pdf(alpha.n_cols, arma::fill::zeros);
+  for (unsigned int i = 0; i < alpha.n_cols; i++) {
+    for (unsigned int j = 0; j < y.n_elem; j++) {
+      if (arma::is_finite(y(j))) {
+        log_pdf(i) += R::dnorm(y(j), alpha(j, i), theta(2), 1);
+      }
+    }
+  }
+  return log_pdf;
+}
+
+// [[Rcpp::export]]
+Rcpp::List create_msde_xptrs() {
+  typedef arma::vec (*vec_fnPtr)(const arma::vec& x, const arma::vec& theta);
+  typedef arma::mat (*mat_fnPtr)(const arma::vec& x, const arma::vec& theta);
+  typedef double (*prior_fnPtr)(const arma::vec& theta);
+  typedef arma::vec (*obs_fnPtr)(const arma::vec& y, 
+    const arma::mat& alpha, const arma::vec& theta);
+  
+  return Rcpp::List::create(
+    Rcpp::Named("drift") = Rcpp::XPtr<vec_fnPtr>(new vec_fnPtr(&drift)),
+    Rcpp::Named("diffusion") = Rcpp::XPtr<mat_fnPtr>(new mat_fnPtr(&diffusion)),
+    Rcpp::Named("prior") = Rcpp::XPtr<prior_fnPtr>(new prior_fnPtr(&log_prior_pdf)),
+    Rcpp::Named("obs_density") = Rcpp::XPtr<obs_fnPtr>(new obs_fnPtr(&log_obs_density)));
+}
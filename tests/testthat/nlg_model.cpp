@@ -0,0 +1,185 @@
+// Two-state model for the tests of ssm_nlg models, where the nonlinearity 
+// is scaled by kappa = known_params(0) and the state dependence of R by 
+// lambda = known_params(1), so that kappa = lambda = 0 gives a linear-Gaussian 
+// model:
+// y_t = x_1t + 0.5 x_2t + 0.3 kappa sin(x_1t) + theta(0) eps_t
+// x_1,t+1 = 0.8 x_1t + 0.1 x_2t + 0.2 kappa sin(x_2t) + theta(1) s_t eta_1t
+// x_2,t+1 = 0.9 x_2t + theta(1) eta_2t
+// s_t = sqrt(1 + lambda x_1t^2), x_1 ~ N(0, known_params(2) I)
+
+#include <RcppArmadillo.h>
+#include <bssm_ad.h>
+// [[Rcpp::depends(RcppArmadillo, bssm)]]
+
+// [[Rcpp::export]]
+arma::vec a1_fn(const arma::vec& theta, const arma::vec& known_params) {
+  return arma::zeros(2);
+}
+
+// [[Rcpp::export]]
+arma::mat P1_fn(const arma::vec& theta, const arma::vec& known_params) {
+  return known_params(2) * arma::eye(2, 2);
+}
+
+// [[Rcpp::export]]
+arma::mat H_fn(const unsigned int t, const arma::vec& alpha, const arma::vec& theta, 
+  const arma::vec& known_params, const arma::mat& known_tv_params) {
+  arma::mat H(1, 1);
+  H(0, 0) = theta(0);
+  return H;
+}
+
+// [[Rcpp::export]]
+arma::mat R_fn(const unsigned int t, const arma::vec& alpha, const arma::vec& theta, 
+  const arma::vec& known_params, const arma::mat& known_tv_params) {
+  arma::mat R(2, 2, arma::fill::zeros);
+  R(0, 0) = theta(1) * std::sqrt(1.0 + known_params(1) * alpha(0) * alpha(0));
+  R(1, 1) = theta(1);
+  return R;
+}
+
+// [[Rcpp::export]]
+arma::vec Z_fn(const unsigned int t, const arma::vec& alpha, const arma::vec& theta, 
+  const arma::vec& known_params, const arma::mat& known_tv_params) {
+  arma::vec Z(1);
+  Z(0) = alpha(0) + 0.5 * alpha(1) + 0.3 * known_params(0) * std::sin(alpha(0));
+  return Z;
+}
+
+// [[Rcpp::export]]
+arma::mat Z_gn(const unsigned int t, const arma::vec& alpha, const arma::vec& theta, 
+  const arma::vec& known_params, const arma::mat& known_tv_params) {
+  arma::mat Z_gn(1, 2);
+  Z_gn(0, 0) = 1.0 + 0.3 * known_params(0) * std::cos(alpha(0));
+  Z_gn(0, 1) = 0.5;
+  return Z_gn;
+}
+
+// [[Rcpp::export]]
+arma::vec T_fn(const unsigned int t, const arma::vec& alpha, const arma::vec& theta, 
+  const arma::vec& known_params, const arma::mat& known_tv_params) {
+  arma::vec T(2);
+  T(0) = 0.8 * alpha(0) + 0.1 * alpha(1) + 0.2 * known_params(0) * std::sin(alpha(1));
+  T(1) = 0.9 * alpha(1);
+  return T;
+}
+
+// [[Rcpp::export]]
+arma::mat T_gn(const unsigned int t, const arma::vec& alpha, const arma::vec& theta, 
+  const arma::vec& known_params, const arma::mat& known_tv_params) {
+  arma::mat T_gn(2, 2);
+  T_gn(0, 0) = 0.8;
+  T_gn(0, 1) = 0.1 + 0.2 * known_params(0) * std::cos(alpha(1));
+  T_gn(1, 0) = 0.0;
+  T_gn(1, 1) = 0.9;
+  return T_gn;
+}
+
+// batched versions of T and Z for all particles (columns of alpha)
+void T_batch(const unsigned int t, const arma::mat& alpha, const arma::vec& theta, 
+  const arma::vec& known_params, const arma::mat& known_tv_params, arma::mat& out) {
+  out.row(0) = 0.8 * alpha.row(0) + 0.1 * alpha.row(1) + 
+    0.2 * known_params(0) * arma::sin(alpha.row(1));
+  out.row(1) = 0.9 * alpha.row(1);
+}
+
+void Z_batch(const unsigned int t, const arma::mat& alpha, const arma::vec& theta, 
+  const arma::vec& known_params, const arma::mat& known_tv_params, arma::mat& out) {
+  out.row(0) = alpha.row(0) + 0.5 * alpha.row(1) + 
+    0.3 * known_params(0) * arma::sin(alpha.row(0));
+}
+
+// T and Z for automatic differentiation
+struct T_model {
+  static const unsigned int n_states = 2;
+  static const unsigned int n_out = 2;
+  template <class Type>
+  void operator()(const unsigned int t, const std::vector<Type>& alpha,
+    const arma::vec& theta, const arma::vec& known_params,
+    const arma::mat& known_tv_params, std::vector<Type>& out) const {
+    using std::sin;
+    out[0] = 0.8 * alpha[0] + 0.1 * alpha[1] + 0.2 * known_params(0) * sin(alpha[1]);
+    out[1] = 0.9 * alpha[1];
+  }
+};
+
+struct Z_model {
+  static const unsigned int n_states = 2;
+  static const unsigned int n_out = 1;
+  template <class Type>
+  void operator()(const unsigned int t, const std::vector<Type>& alpha,
+    const arma::vec& theta, const arma::vec& known_params,
+    const arma::mat& known_tv_params, std::vector<Type>& out) const {
+    using std::sin;
+    out[0] = alpha[0] + 0.5 * alpha[1] + 0.3 * known_params(0) * sin(alpha[0]);
+  }
+};
+
+// values and Jacobians of T and Z by automatic differentiation
+// [[Rcpp::export]]
+Rcpp::List ad_derivatives(const arma::vec& alpha, const arma::vec& theta, 
+  const arma::vec& known_params) {
+  
+  bssm_ad::check_n_states<T_model>(alpha.n_elem);
+  arma::mat known_tv_params(1, 1);
+  arma::vec T_value;
+  arma::mat T_gradient;
+  bssm_ad::joint<T_model>(0, alpha, theta, known_params, known_tv_params, 
+    T_value, T_gradient);
+  arma::vec Z_value;
+  arma::mat Z_gradient;
+  bssm_ad::joint<Z_model>(0, alpha, theta, known_params, known_tv_params, 
+    Z_value, Z_gradient);
+  
+  return Rcpp::List::create(
+    Rcpp::Named("T") = T_value, Rcpp::Named("T_gn") = T_gradient,
+    Rcpp::Named("Z") = Z_value, Rcpp::Named("Z_gn") = Z_gradient,
+    Rcpp::Named("T_value") = bssm_ad::value<T_model>(0, alpha, theta, 
+      known_params, known_tv_params),
+    Rcpp::Named("T_jacobian") = bssm_ad::jacobian<T_model>(0, alpha, theta, 
+      known_params, known_tv_params));
+}
+
+// [[Rcpp::export]]
+double log_prior_pdf(const arma::vec& theta) {
+  
+  if(arma::any(theta <= 0)) {
+    return -arma::datum::inf;
+  }
+  return R::dnorm(theta(0), 0, 10, 1) + R::dnorm(theta(1), 0, 10, 1);
+}
+
+// [[Rcpp::export]]
+Rcpp::List create_nlg_xptrs() {
+  
+  typedef arma::vec (*nvec_fnPtr)(const unsigned int t, const arma::vec& alpha, 
+    const arma::vec& theta, const arma::vec& known_params, const arma::mat& known_tv_params);
+  typedef arma::mat (*nmat_fnPtr)(const unsigned int t, const arma::vec& alpha, 
+    const arma::vec& theta, const arma::vec& known_params, const arma::mat& known_tv_params);
+  typedef void (*nbatch_fnPtr)(const unsigned int t, const arma::mat& alpha, 
+    const arma::vec& theta, const arma::vec& known_params, 
+    const arma::mat& known_tv_params, arma::mat& out);
+  typedef arma::vec (*a1_fnPtr)(const arma::vec& theta, const arma::vec& known_params);
+  typedef arma::mat (*P1_fnPtr)(const arma::vec& theta, const arma::vec& known_params);
+  typedef double (*prior_fnPtr)(const arma::vec&);
+  
+  return Rcpp::List::create(
+    Rcpp::Named("a1_fn") = Rcpp::XPtr<a1_fnPtr>(new a1_fnPtr(&a1_fn)),
+    Rcpp::Named("P1_fn") = Rcpp::XPtr<P1_fnPtr>(new P1_fnPtr(&P1_fn)),
+    Rcpp::Named("Z_fn") = Rcpp::XPtr<nvec_fnPtr>(new nvec_fnPtr(&Z_fn)),
+    Rcpp::Named("H_fn") = Rcpp::XPtr<nmat_fnPtr>(new nmat_fnPtr(&H_fn)),
+    Rcpp::Named("T_fn") = Rcpp::XPtr<nvec_fnPtr>(new nvec_fnPtr(&T_fn)),
+    Rcpp::Named("R_fn") = Rcpp::XPtr<nmat_fnPtr>(new nmat_fnPtr(&R_fn)),
+    Rcpp::Named("Z_gn") = Rcpp::XPtr<nmat_fnPtr>(new nmat_fnPtr(&Z_gn)),
+    Rcpp::Named("T_gn") = Rcpp::XPtr<nmat_fnPtr>(new nmat_fnPtr(&T_gn)),
+    Rcpp::Named("T_batch") = Rcpp::XPtr<nbatch_fnPtr>(new nbatch_fnPtr(&T_batch)),
+    Rcpp::Named("Z_batch") = Rcpp::XPtr<nbatch_fnPtr>(new nbatch_fnPtr(&Z_batch)),
+    Rcpp::Named("Z_ad") = bssm_ad::xptr<Z_model>(&bssm_ad::value<Z_model>),
+    Rcpp::Named("T_ad") = bssm_ad::xptr<T_model>(&bssm_ad::value<T_model>),
+    Rcpp::Named("Z_gn_ad") = bssm_ad::xptr<Z_model>(&bssm_ad::jacobian<Z_model>),
+    Rcpp::Named("T_gn_ad") = bssm_ad::xptr<T_model>(&bssm_ad::jacobian<T_model>),
+    Rcpp::Named("Z_joint") = bssm_ad::xptr<Z_model>(&bssm_ad::joint<Z_model>),
+    Rcpp::Named("T_joint") = bssm_ad::xptr<T_model>(&bssm_ad::joint<T_model>),
+    Rcpp::Named("log_prior_pdf") = 
+      Rcpp::XPtr<prior_fnPtr>(new prior_fnPtr(&log_prior_pdf)));
+}
@@ -0,0 +1,72 @@
+// Ornstein-Uhlenbeck process with Poisson observations for the tests of 
+// ssm_sde models, see vignettes/ssm_sde_template.cpp
+// d\alpha_t = \rho (\nu - \alpha_t) dt + \sigma dB_t, t>=0
+// y_k ~ Poisson(exp(\alpha_k)), k = 1,...,n
+
+#include <RcppArmadillo.h>
+// [[Rcpp::depends(RcppArmadillo)]]
+
+// theta(0) = rho
+// theta(1) = nu
+// theta(2) = sigma
+
+double drift(const double x, const arma::vec& theta) {
+  return theta(0) * (theta(1) - x);
+}
+
+double diffusion(const double x, const arma::vec& theta) {
+  return theta(2);
+}
+
+double ddiffusion(const double x, const arma::vec& theta) {
+  return 0.0;
+}
+
+// all coefficients for all particles at once
+void coef_batch(const arma::vec& x, const arma::vec& theta, 
+  arma::vec& drift, arma::vec& diffusion, arma::vec& ddiffusion) {
+  drift = theta(0) * (theta(1) - x);
+  diffusion.fill(theta(2));
+  ddiffusion.zeros();
+}
+
+double log_prior_pdf(const arma::vec& theta) {
+  
+  double log_pdf;
+  if(theta(0) <= 0.0 || theta(2) <= 0.0) {
+    log_pdf = -std::numeric_limits<double>::infinity();
+  } else {
+    log_pdf = R::dnorm(theta(0), 0, 10, 1) + R::dnorm(theta(1), 0, 10, 1) + 
+      R::dnorm(theta(2), 0, 10, 1);
+  }
+  return log_pdf;
+}
+
+arma::vec log_obs_density(const double y, 
+  const arma::vec& alpha, const arma::vec& theta) {
+  
+  arma::vec log_pdf(alpha.n_elem);
+  for (unsigned int i = 0; i < alpha.n_elem; i++) {
+    log_pdf(i) = R::dpois(y, exp(alpha(i)), 1);
+  }
+  return log_pdf;
+}
+
+// [[Rcpp::export]]
+Rcpp::List create_sde_xptrs() {
+  typedef double (*fnPtr)(const double x, const arma::vec& theta);
+  typedef double (*prior_fnPtr)(const arma::vec& theta);
+  typedef arma::vec (*obs_fnPtr)(const double y, 
+    const arma::vec& alpha, const arma::vec& theta);
+  typedef void (*coef_batch_fnPtr)(const arma::vec& x, const arma::vec& theta, 
+    arma::vec& drift, arma::vec& diffusion, arma::vec& ddiffusion);
+  
+  return Rcpp::List::create(
+    Rcpp::Named("drift") = Rcpp::XPtr<fnPtr>(new fnPtr(&drift)),
+    Rcpp::Named("diffusion") = Rcpp::XPtr<fnPtr>(new fnPtr(&diffusion)),
+    Rcpp::Named("ddiffusion") = Rcpp::XPtr<fnPtr>(new fnPtr(&ddiffusion)),
+    Rcpp::Named("coef_batch") = 
+      Rcpp::XPtr<coef_batch_fnPtr>(new coef_batch_fnPtr(&coef_batch)),
+    Rcpp::Named("prior") = Rcpp::XPtr<prior_fnPtr>(new prior_fnPtr(&log_prior_pdf)),
+    Rcpp::Named("obs_density") = Rcpp::XPtr<obs_fnPtr>(new obs_fnPtr(&log_obs_density)));
+}